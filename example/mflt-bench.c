@@ -0,0 +1,280 @@
+/* mflt-bench.c -- Benchmark of Font Layout Tables	-*- coding: utf-8; -*-
+   Copyright (C) 2026
+     National Institute of Advanced Industrial Science and Technology (AIST)
+     Registration Number H15PRO112
+
+   This file is part of the m17n library.
+
+   The m17n library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   The m17n library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the m17n library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   02111-1307, USA.  */
+
+/***en
+    @enpage m17n-flt-bench benchmark Font Layout Tables
+
+    @section m17n-flt-bench-synopsis SYNOPSIS
+
+    m17n-flt-bench [ OPTION ... ]
+
+    @section m17n-flt-bench-description DESCRIPTION
+
+    Measure the speed of the installed Font Layout Tables (FLTs).
+
+    Each built-in sample text (Devanagari, Bengali, Tamil, Thai,
+    Khmer, Tibetan, and Myanmar) is laid out repeatedly by each
+    installed FLT that covers the script, and the number of clusters
+    laid out per second is printed.  No font file is used.  Instead,
+    a synthetic font is given to the FLTs; it maps a character to a
+    glyph of the same code, gives the same metrics to all glyphs, and
+    claims to support any OpenType features without changing glyphs.
+
+    The following OPTIONs are available.
+
+    <ul>
+
+    <li> -n COUNT
+
+    COUNT is the number of times each sample text is laid out.  The
+    default count is 1000.
+
+    <li> -s SCRIPT
+
+    Use only the sample text of SCRIPT, which is one of deva, beng,
+    taml, thai, khmr, tibt, and mymr.
+
+    <li> -f FLT
+
+    Use only the FLT named FLT.
+
+    <li> -w
+
+    Use a workspace (see mflt_run_with_workspace ()) for layout.
+
+    <li> --version
+
+    Print the version number.
+
+    <li> -h, --help
+
+    Print this message.
+
+    </ul>
+*/
+
+#ifndef FOR_DOXYGEN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <m17n-flt.h>
+#include <m17n-misc.h>
+
+#include "mflt-stub.h"
+
+/* Print the usage of this program (the name is PROG), and exit with
+   EXIT_CODE.  */
+
+void
+help_exit (char *prog, int exit_code)
+{
+  char *p = prog;
+
+  while (*p)
+    if (*p++ == '/')
+      prog = p;
+
+  printf ("Usage: %s [ OPTION ...]\n", prog);
+  printf ("Measure the speed of the installed Font Layout Tables.\n");
+  printf ("The following OPTIONs are available.\n");
+  printf ("  %-13s %s", "-n COUNT",
+	  "Number of times to lay out each text (default 1000).\n");
+  printf ("  %-13s %s", "-s SCRIPT",
+	  "Use only the text of SCRIPT (deva, beng, taml, thai, khmr,\n"
+	  "                tibt, or mymr).\n");
+  printf ("  %-13s %s", "-f FLT", "Use only the FLT named FLT.\n");
+  printf ("  %-13s %s", "-w", "Use a workspace for layout.\n");
+  printf ("  %-13s %s", "--version", "Print the version number.\n");
+  printf ("  %-13s %s", "-h, --help", "Print this message.\n");
+  exit (exit_code);
+}
+
+
+/* Lay out the characters CODES (length LEN) with FLT and FONT COUNT
+   times, and print the speed.  */
+
+static void
+bench (char *script, int *codes, int len, MFLT *flt, MFLTFont *font,
+       int count, MFLTWorkspace *workspace)
+{
+  MFLTGlyphString gstring;
+  MFLTGlyph *g;
+  struct timeval tv0, tv1;
+  double sec;
+  int clusters = 0;
+  int i, n, result;
+
+  memset (&gstring, 0, sizeof gstring);
+  gstring.glyph_size = sizeof (MFLTGlyph);
+  gstring.allocated = len * 2;
+  gstring.glyphs = malloc (gstring.glyph_size * gstring.allocated);
+  if (! gstring.glyphs)
+    return;
+  gettimeofday (&tv0, NULL);
+  for (n = 0; n < count; n++)
+    {
+      while (1)
+	{
+	  memset (gstring.glyphs, 0, gstring.glyph_size * gstring.allocated);
+	  for (i = 0; i < len; i++)
+	    gstring.glyphs[i].c = codes[i];
+	  gstring.used = len;
+	  font->internal = NULL;
+	  result = mflt_run_with_workspace (&gstring, 0, len, font, flt,
+					    workspace);
+	  if (result != -2)
+	    break;
+	  gstring.allocated *= 2;
+	  free (gstring.glyphs);
+	  gstring.glyphs = malloc (gstring.glyph_size * gstring.allocated);
+	  if (! gstring.glyphs)
+	    return;
+	}
+      if (result < 0)
+	{
+	  printf ("%-6s %-24s layout failed\n", script, mflt_name (flt));
+	  free (gstring.glyphs);
+	  return;
+	}
+    }
+  gettimeofday (&tv1, NULL);
+
+  /* Count clusters in the last result.  */
+  for (i = 0, g = gstring.glyphs; i < gstring.used; i++, g++)
+    if (i == 0 || g->from != g[-1].from)
+      clusters++;
+  sec = (tv1.tv_sec - tv0.tv_sec) + (tv1.tv_usec - tv0.tv_usec) / 1000000.0;
+  printf ("%-6s %-24s %6d clusters %12.0f clusters/sec\n",
+	  script, mflt_name (flt), clusters,
+	  sec > 0 ? clusters * count / sec : 0.0);
+  free (gstring.glyphs);
+}
+
+int
+main (int argc, char **argv)
+{
+  MFLTFont font;
+  MFLTWorkspace *workspace = NULL;
+  int use_workspace = 0;
+  char *script = NULL;
+  MSymbol flt_name = Mnil;
+  int count = 1000;
+  MPlist *plist, *pl, *done;
+  int i, j;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (! strcmp (argv[i], "--help")
+	  || ! strcmp (argv[i], "-h")
+	  || ! strcmp (argv[i], "-?"))
+	help_exit (argv[0], 0);
+      else if (! strcmp (argv[i], "--version"))
+	{
+	  printf ("m17n-flt-bench (m17n library) %s\n", M17NLIB_VERSION_NAME);
+	  printf ("Copyright (C) 2026 AIST, JAPAN\n");
+	  exit (0);
+	}
+      else if (! strcmp (argv[i], "-n") && i + 1 < argc)
+	{
+	  count = atoi (argv[++i]);
+	  if (count <= 0)
+	    help_exit (argv[0], 1);
+	}
+      else if (! strcmp (argv[i], "-s") && i + 1 < argc)
+	script = argv[++i];
+      else if (! strcmp (argv[i], "-f") && i + 1 < argc)
+	flt_name = msymbol (argv[++i]);
+      else if (! strcmp (argv[i], "-w"))
+	use_workspace = 1;
+      else
+	help_exit (argv[0], 1);
+    }
+
+  M17N_INIT ();
+  if (merror_code != MERROR_NONE)
+    {
+      fprintf (stderr, "Fail to initialize the m17n library!\n");
+      exit (1);
+    }
+  if (use_workspace)
+    workspace = mflt_create_workspace ();
+
+  init_stub_font (&font);
+
+  plist = mdatabase_list (msymbol ("font"), msymbol ("layouter"), Mnil, Mnil);
+  if (! plist)
+    {
+      fprintf (stderr, "No FLT installed!\n");
+      M17N_FINI ();
+      exit (1);
+    }
+
+  for (i = 0; i < CORPUS_NUM; i++)
+    {
+      MText *mt;
+      int *codes;
+      int len, c = 0;
+
+      if (script && strcmp (script, corpus[i].script))
+	continue;
+      mt = mtext_from_data (corpus[i].text, strlen (corpus[i].text),
+			    MTEXT_FORMAT_UTF_8);
+      len = mtext_len (mt);
+      codes = malloc (sizeof (int) * len);
+      if (! codes)
+	break;
+      for (j = 0; j < len; j++)
+	{
+	  codes[j] = mtext_ref_char (mt, j);
+	  if (! c && codes[j] >= 0x80)
+	    c = codes[j];
+	}
+      m17n_object_unref (mt);
+
+      done = mplist ();
+      for (pl = plist; mplist_key (pl) != Mnil; pl = mplist_next (pl))
+	{
+	  MSymbol name = mdatabase_tag (mplist_value (pl))[2];
+	  MFLT *flt;
+
+	  if (name == Mnil
+	      || (flt_name != Mnil && name != flt_name)
+	      || mplist_get (done, name))
+	    continue;
+	  mplist_add (done, name, Mt);
+	  flt = mflt_get (name);
+	  if (flt && mchartable_lookup (mflt_coverage (flt), c))
+	    bench (corpus[i].script, codes, len, flt, &font, count, workspace);
+	}
+      m17n_object_unref (done);
+      free (codes);
+    }
+
+  m17n_object_unref (plist);
+  mflt_destroy_workspace (workspace);
+  M17N_FINI ();
+  exit (0);
+}
+#endif /* not FOR_DOXYGEN */
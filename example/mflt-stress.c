@@ -0,0 +1,395 @@
+/* mflt-stress.c -- Stress test of Font Layout Tables in threads	-*- coding: utf-8; -*-
+   Copyright (C) 2026
+     National Institute of Advanced Industrial Science and Technology (AIST)
+     Registration Number H15PRO112
+
+   This file is part of the m17n library.
+
+   The m17n library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   The m17n library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the m17n library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   02111-1307, USA.  */
+
+/***en
+    @enpage m17n-flt-stress lay out text by Font Layout Tables in threads
+
+    @section m17n-flt-stress-synopsis SYNOPSIS
+
+    m17n-flt-stress [ OPTION ... ]
+
+    @section m17n-flt-stress-description DESCRIPTION
+
+    Check that the installed Font Layout Tables (FLTs) give the same
+    results when mflt_run () is called from multiple threads at once.
+
+    The sample texts of m17n-flt-bench are laid out by each installed
+    FLT that covers the script, first in a single thread to get the
+    expected glyphs.  Then several threads lay out all of them
+    repeatedly at the same time, each starting from a different text,
+    and compare every result with the expected one.  The same
+    synthetic font as m17n-flt-bench is used, so no font file is
+    needed.
+
+    The exit status is 0 if all results agree, 1 if some result
+    differs or layout fails, and 77 if no FLT is installed.
+
+    The following OPTIONs are available.
+
+    <ul>
+
+    <li> -t THREADS
+
+    THREADS is the number of threads.  The default number is 4.
+
+    <li> -n COUNT
+
+    COUNT is the number of times each thread lays out all the texts.
+    The default count is 100.
+
+    <li> -w
+
+    Make each thread use its own workspace (see
+    mflt_run_with_workspace ()) for layout.
+
+    <li> --version
+
+    Print the version number.
+
+    <li> -h, --help
+
+    Print this message.
+
+    </ul>
+*/
+
+#ifndef FOR_DOXYGEN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <m17n-flt.h>
+#include <m17n-misc.h>
+
+#include "mflt-stub.h"
+
+/* A text laid out by an FLT, and the glyphs expected for it.  */
+
+typedef struct
+{
+  char *script;
+  char *flt_name;
+  MSymbol name;
+  int *codes;
+  int len;
+  MFLTGlyph *expected;
+  int nexpected;
+} Job;
+
+static Job *jobs;
+static int njobs;
+static int count = 100;
+static int use_workspace;
+
+typedef struct
+{
+  pthread_t thread;
+  int index;
+  int failures;
+} Worker;
+
+
+/* Print the usage of this program (the name is PROG), and exit with
+   EXIT_CODE.  */
+
+void
+help_exit (char *prog, int exit_code)
+{
+  char *p = prog;
+
+  while (*p)
+    if (*p++ == '/')
+      prog = p;
+
+  printf ("Usage: %s [ OPTION ...]\n", prog);
+  printf ("Lay out texts by the installed Font Layout Tables in threads.\n");
+  printf ("The following OPTIONs are available.\n");
+  printf ("  %-13s %s", "-t THREADS", "Number of threads (default 4).\n");
+  printf ("  %-13s %s", "-n COUNT",
+	  "Number of times each thread lays out the texts (default 100).\n");
+  printf ("  %-13s %s", "-w", "Use a workspace in each thread.\n");
+  printf ("  %-13s %s", "--version", "Print the version number.\n");
+  printf ("  %-13s %s", "-h, --help", "Print this message.\n");
+  exit (exit_code);
+}
+
+
+/* Lay out JOB with FLT and FONT into GSTRING, whose glyph array is
+   grown if necessary.  Return the result of
+   mflt_run_with_workspace ().  */
+
+static int
+layout (Job *job, MFLT *flt, MFLTFont *font, MFLTGlyphString *gstring,
+	MFLTWorkspace *workspace)
+{
+  int i, result;
+
+  while (1)
+    {
+      memset (gstring->glyphs, 0, gstring->glyph_size * gstring->allocated);
+      for (i = 0; i < job->len; i++)
+	gstring->glyphs[i].c = job->codes[i];
+      gstring->used = job->len;
+      font->internal = NULL;
+      result = mflt_run_with_workspace (gstring, 0, job->len, font, flt,
+					workspace);
+      if (result != -2)
+	return result;
+      gstring->allocated *= 2;
+      free (gstring->glyphs);
+      gstring->glyphs = malloc (gstring->glyph_size * gstring->allocated);
+      if (! gstring->glyphs)
+	return -1;
+    }
+}
+
+/* Return 1 if the glyphs in GSTRING are the same as expected by JOB,
+   and 0 otherwise.  */
+
+static int
+same_glyphs (Job *job, MFLTGlyphString *gstring)
+{
+  int i;
+
+  if (gstring->used != job->nexpected)
+    return 0;
+  for (i = 0; i < gstring->used; i++)
+    {
+      MFLTGlyph *g = gstring->glyphs + i, *e = job->expected + i;
+
+      if (g->c != e->c || g->code != e->code
+	  || g->from != e->from || g->to != e->to
+	  || g->xadv != e->xadv || g->yadv != e->yadv
+	  || g->xoff != e->xoff || g->yoff != e->yoff)
+	return 0;
+    }
+  return 1;
+}
+
+static void *
+run_worker (void *arg)
+{
+  Worker *worker = arg;
+  MFLTFont font;
+  MFLTGlyphString gstring;
+  MFLTWorkspace *workspace = use_workspace ? mflt_create_workspace () : NULL;
+  int n, i;
+
+  init_stub_font (&font);
+  memset (&gstring, 0, sizeof gstring);
+  gstring.glyph_size = sizeof (MFLTGlyph);
+  gstring.allocated = 256;
+  gstring.glyphs = malloc (gstring.glyph_size * gstring.allocated);
+  if (! gstring.glyphs)
+    {
+      worker->failures++;
+      return NULL;
+    }
+  for (n = 0; n < count; n++)
+    for (i = 0; i < njobs; i++)
+      {
+	/* Start from a different text in each thread so that different
+	   FLTs run at the same time.  */
+	Job *job = jobs + (i + worker->index) % njobs;
+
+	MFLT *flt = mflt_get (job->name);
+
+	if (! flt
+	    || layout (job, flt, &font, &gstring, workspace) < 0
+	    || ! same_glyphs (job, &gstring))
+	  worker->failures++;
+      }
+  free (gstring.glyphs);
+  mflt_destroy_workspace (workspace);
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  MFLTFont font;
+  MFLTGlyphString gstring;
+  Worker *workers;
+  int *codes[CORPUS_NUM];
+  int nthreads = 4;
+  MPlist *plist, *pl, *done;
+  int failures = 0;
+  int i, j;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (! strcmp (argv[i], "--help")
+	  || ! strcmp (argv[i], "-h")
+	  || ! strcmp (argv[i], "-?"))
+	help_exit (argv[0], 0);
+      else if (! strcmp (argv[i], "--version"))
+	{
+	  printf ("m17n-flt-stress (m17n library) %s\n", M17NLIB_VERSION_NAME);
+	  printf ("Copyright (C) 2026 AIST, JAPAN\n");
+	  exit (0);
+	}
+      else if (! strcmp (argv[i], "-t") && i + 1 < argc)
+	{
+	  nthreads = atoi (argv[++i]);
+	  if (nthreads <= 0)
+	    help_exit (argv[0], 1);
+	}
+      else if (! strcmp (argv[i], "-n") && i + 1 < argc)
+	{
+	  count = atoi (argv[++i]);
+	  if (count <= 0)
+	    help_exit (argv[0], 1);
+	}
+      else if (! strcmp (argv[i], "-w"))
+	use_workspace = 1;
+      else
+	help_exit (argv[0], 1);
+    }
+
+  M17N_INIT ();
+  if (merror_code != MERROR_NONE)
+    {
+      fprintf (stderr, "Fail to initialize the m17n library!\n");
+      exit (1);
+    }
+
+  plist = mdatabase_list (msymbol ("font"), msymbol ("layouter"), Mnil, Mnil);
+  if (! plist)
+    {
+      fprintf (stderr, "No FLT installed!\n");
+      M17N_FINI ();
+      exit (77);
+    }
+
+  /* Get the expected glyphs in this thread.  */
+  init_stub_font (&font);
+  memset (&gstring, 0, sizeof gstring);
+  gstring.glyph_size = sizeof (MFLTGlyph);
+  gstring.allocated = 256;
+  gstring.glyphs = malloc (gstring.glyph_size * gstring.allocated);
+  jobs = malloc (sizeof (Job) * CORPUS_NUM * mplist_length (plist));
+  if (! gstring.glyphs || ! jobs)
+    exit (1);
+  for (i = 0; i < CORPUS_NUM; i++)
+    {
+      MText *mt;
+      int len, c = 0;
+
+      mt = mtext_from_data (corpus[i].text, strlen (corpus[i].text),
+			    MTEXT_FORMAT_UTF_8);
+      len = mtext_len (mt);
+      codes[i] = malloc (sizeof (int) * len);
+      if (! codes[i])
+	exit (1);
+      for (j = 0; j < len; j++)
+	{
+	  codes[i][j] = mtext_ref_char (mt, j);
+	  if (! c && codes[i][j] >= 0x80)
+	    c = codes[i][j];
+	}
+      m17n_object_unref (mt);
+
+      done = mplist ();
+      for (pl = plist; mplist_key (pl) != Mnil; pl = mplist_next (pl))
+	{
+	  MSymbol name = mdatabase_tag (mplist_value (pl))[2];
+	  Job *job = jobs + njobs;
+	  MFLT *flt;
+
+	  if (name == Mnil || mplist_get (done, name))
+	    continue;
+	  mplist_add (done, name, Mt);
+	  flt = mflt_get (name);
+	  if (! flt || ! mchartable_lookup (mflt_coverage (flt), c))
+	    continue;
+	  job->script = corpus[i].script;
+	  job->codes = codes[i];
+	  job->len = len;
+	  if (layout (job, flt, &font, &gstring, NULL) < 0)
+	    {
+	      printf ("%-6s %-24s layout failed\n",
+		      job->script, mflt_name (flt));
+	      failures++;
+	      continue;
+	    }
+	  job->flt_name = strdup (msymbol_name (name));
+	  job->nexpected = gstring.used;
+	  job->expected = malloc (sizeof (MFLTGlyph) * gstring.used);
+	  if (! job->expected || ! job->flt_name)
+	    exit (1);
+	  memcpy (job->expected, gstring.glyphs,
+		  sizeof (MFLTGlyph) * gstring.used);
+	  njobs++;
+	}
+      m17n_object_unref (done);
+    }
+  free (gstring.glyphs);
+  m17n_object_unref (plist);
+  if (njobs == 0)
+    {
+      fprintf (stderr, "No FLT covers the sample texts!\n");
+      M17N_FINI ();
+      exit (77);
+    }
+
+  /* Restart the library so that the threads load the FLTs at the
+     same time.  */
+  M17N_FINI ();
+  M17N_INIT ();
+  for (i = 0; i < njobs; i++)
+    jobs[i].name = msymbol (jobs[i].flt_name);
+
+  workers = calloc (nthreads, sizeof (Worker));
+  if (! workers)
+    exit (1);
+  for (i = 0; i < nthreads; i++)
+    {
+      workers[i].index = i;
+      if (pthread_create (&workers[i].thread, NULL, run_worker, workers + i))
+	{
+	  fprintf (stderr, "Can't create a thread!\n");
+	  exit (1);
+	}
+    }
+  for (i = 0; i < nthreads; i++)
+    {
+      pthread_join (workers[i].thread, NULL);
+      failures += workers[i].failures;
+    }
+  printf ("%d threads, %d layouts each, %d failures\n",
+	  nthreads, count * njobs, failures);
+
+  for (i = 0; i < njobs; i++)
+    {
+      free (jobs[i].flt_name);
+      free (jobs[i].expected);
+    }
+  free (jobs);
+  free (workers);
+  for (i = 0; i < CORPUS_NUM; i++)
+    free (codes[i]);
+  M17N_FINI ();
+  exit (failures > 0);
+}
+#endif /* not FOR_DOXYGEN */
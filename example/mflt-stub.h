@@ -0,0 +1,135 @@
+/* mflt-stub.h -- Sample texts and a synthetic font for FLTs	-*- coding: utf-8; -*-
+   Copyright (C) 2026
+     National Institute of Advanced Industrial Science and Technology (AIST)
+     Registration Number H15PRO112
+
+   This file is part of the m17n library.
+
+   The m17n library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   The m17n library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the m17n library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   02111-1307, USA.  */
+
+/* This file is included by mflt-bench.c and mflt-stress.c.  */
+
+/* Sample texts.  */
+struct
+{
+  char *script;
+  char *text;
+} corpus[] =
+  {
+    { "deva",
+      "नमस्ते दुनिया। हिन्दी भाषा में क्षत्रिय, ज्ञान, श्री और "
+      "द्वन्द्व जैसे संयुक्ताक्षर बहुत हैं।" },
+    { "beng",
+      "আমার সোনার বাংলা, আমি তোমায় ভালোবাসি। ক্ষমা, স্বপ্ন, "
+      "রাষ্ট্র এবং জ্ঞান বাংলা যুক্তাক্ষর।" },
+    { "taml",
+      "யாதும் ஊரே யாவரும் கேளிர். தமிழ் மொழியில் க்ஷ, ஸ்ரீ, "
+      "கொ, கோ, கௌ போன்ற எழுத்துகள் உண்டு." },
+    { "thai",
+      "ภาษาไทยเป็นภาษาที่มีวรรณยุกต์ น้ำใจ ผู้ใหญ่ กำลัง "
+      "ปั้น ญี่ปุ่น ฤๅษี" },
+    { "khmr",
+      "ភាសាខ្មែរ គឺជាភាសាកំណើតរបស់ជនជាតិខ្មែរ។ ស្ត្រី "
+      "ព្រះរាជាណាចក្រកម្ពុជា" },
+    { "tibt",
+      "བོད་ཀྱི་སྐད་ཡིག་ནི་བོད་ལྗོངས་ཀྱི་སྐད་ཡིག་རེད། "
+      "བསྒྲུབས་ སྒྲོལ་མ་ ཧཱུྃ་" },
+    { "mymr",
+      "မြန်မာဘာသာစကား သည် မြန်မာနိုင်ငံ၏ ရုံးသုံးဘာသာစကား "
+      "ဖြစ်သည်။ ကျွန်ုပ် သင်္ချိုင်း" }
+  };
+
+#define CORPUS_NUM (sizeof corpus / sizeof corpus[0])
+
+/* Callback functions of the synthetic font.  */
+
+static int
+get_glyph_id (MFLTFont *font, MFLTGlyphString *gstring, int from, int to)
+{
+  for (; from < to; from++)
+    {
+      MFLTGlyph *g = (MFLTGlyph *) ((char *) gstring->glyphs
+				    + gstring->glyph_size * from);
+
+      if (! g->encoded)
+	{
+	  g->code = g->c;
+	  g->encoded = 1;
+	}
+    }
+  return 0;
+}
+
+static int
+get_metrics (MFLTFont *font, MFLTGlyphString *gstring, int from, int to)
+{
+  for (; from < to; from++)
+    {
+      MFLTGlyph *g = (MFLTGlyph *) ((char *) gstring->glyphs
+				    + gstring->glyph_size * from);
+
+      if (! g->measured)
+	{
+	  g->xadv = font->x_ppem << 6;
+	  g->yadv = 0;
+	  g->ascent = (font->y_ppem * 4 / 5) << 6;
+	  g->descent = (font->y_ppem / 5) << 6;
+	  g->lbearing = 0;
+	  g->rbearing = g->xadv;
+	  g->measured = 1;
+	}
+    }
+  return 0;
+}
+
+static int
+check_otf (MFLTFont *font, MFLTOtfSpec *spec)
+{
+  return 1;
+}
+
+static int
+drive_otf (MFLTFont *font, MFLTOtfSpec *spec,
+	   MFLTGlyphString *in, int from, int to,
+	   MFLTGlyphString *out, MFLTGlyphAdjustment *adjustment)
+{
+  int len = to - from;
+
+  if (out)
+    {
+      if (out->allocated < out->used + len)
+	return -2;
+      font->get_metrics (font, in, from, to);
+      memcpy ((char *) out->glyphs + out->glyph_size * out->used,
+	      (char *) in->glyphs + in->glyph_size * from,
+	      in->glyph_size * len);
+      out->used += len;
+    }
+  return to;
+}
+
+/* Initialize FONT as the synthetic font.  */
+
+static void
+init_stub_font (MFLTFont *font)
+{
+  memset (font, 0, sizeof *font);
+  font->x_ppem = font->y_ppem = 20;
+  font->get_glyph_id = get_glyph_id;
+  font->get_metrics = get_metrics;
+  font->check_otf = check_otf;
+  font->drive_otf = drive_otf;
+}
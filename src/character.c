@@ -92,6 +92,11 @@ free_string (int from, int to, void *str, void *arg)
 
 /* Internal API */
 
+/* Incremented each time a character property is defined or modified
+   by mchar_put_prop () so that a cache of the property can tell that
+   it is out of date.  */
+int mchar__prop_tick;
+
 int
 mchar__init ()
 {
@@ -138,6 +143,7 @@ mchar__define_prop (MSymbol key, MSymbol type, void *mdb)
 {
   MCharPropRecord *record;
 
+  mchar__prop_tick++;
   if (char_prop_list)
     record = mplist_get (char_prop_list, key);
   else
@@ -598,6 +604,7 @@ mchar_put_prop (int c, MSymbol key, void *val)
 	MERROR (MERROR_DB, -1);
       record->mdb = NULL;
     }
+  mchar__prop_tick++;
   return mchartable_set (record->table, c, val);
 }
 
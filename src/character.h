@@ -287,4 +287,6 @@
 
 extern void mchar__define_prop (MSymbol key, MSymbol type, void *mdb);
 
+extern int mchar__prop_tick;
+
 #endif /* not _M17N_CHARACTER_H_ */
@@ -64,6 +64,7 @@
 #include "m17n-misc.h"
 #include "internal.h"
 #include "symbol.h"
+#include "character.h"
 #include "mtext.h"
 #include "textprop.h"
 #include "internal-gui.h"
@@ -75,11 +76,58 @@
 #include <fribidi/fribidi.h>
 #endif /* HAVE_FRIBIDI */
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 
+/* Lock for the drawing functions (mdraw_text () etc.) and the
+   measuring functions (mdraw_text_extents () etc.).  They may be
+   called from multiple threads, typically on frames of the null
+   device, but they share the workspace of the FLT, the glyph string
+   pools, the realized faces, fonts, and fontsets, and the FreeType
+   library.  It is recursive because the external API functions call
+   each other.  */
+
+#ifdef HAVE_PTHREAD
+
+static pthread_once_t draw_lock_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t draw_lock;
+
+static void
+init_draw_lock (void)
+{
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init (&attr);
+  pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init (&draw_lock, &attr);
+  pthread_mutexattr_destroy (&attr);
+}
+
+#define DRAW_LOCK()					\
+  do {							\
+    pthread_once (&draw_lock_once, init_draw_lock);	\
+    pthread_mutex_lock (&draw_lock);			\
+  } while (0)
+
+#define DRAW_UNLOCK() pthread_mutex_unlock (&draw_lock)
+
+#else  /* not HAVE_PTHREAD */
+
+#define DRAW_LOCK() do { } while (0)
+#define DRAW_UNLOCK() do { } while (0)
+
+#endif /* not HAVE_PTHREAD */
+
 static MSymbol M_glyph_string;
 
+/* Workspace of mflt_run_with_workspace () used by run_flt ().  It
+   is used only while DRAW_LOCK is held.  */
+static MFLTWorkspace *flt_workspace;
+
 /* Special scripts */
 static MSymbol Mcommon;
 /* Special categories */
@@ -100,60 +148,173 @@ static MSymbol MbidiBN;
 static MSymbol MbidiS;
 static MSymbol MbidiNSM;
 
+/* Bitmap of the characters in BMP whose bidi category is R, AL, RLE,
+   or RLO, i.e. those that make a text bidi-sensitive.  It is built
+   from the table of the character property Mbidi_category by
+   update_bidi_rtl_bitmap (), and lets a text of left-to-right
+   characters be scanned without looking up the property of each
+   character.  */
+static unsigned char bidi_rtl_bitmap[0x10000 / 8];
+
+/* Value of mchar__prop_tick when bidi_rtl_bitmap was built, or -1 if
+   it is not yet built.  */
+static int bidi_rtl_bitmap_tick = -1;
+
+/* The smallest character set in bidi_rtl_bitmap, or 0x10000 if none.
+   It is U+0590 (the Hebrew block) unless the table is modified.  */
+static int bidi_rtl_min_char;
+
+static void
+set_bidi_rtl_bits (int from, int to, void *val, void *arg)
+{
+  MSymbol bidi = (MSymbol) val;
+
+  if (bidi != MbidiR && bidi != MbidiAL
+      && bidi != MbidiRLE && bidi != MbidiRLO)
+    return;
+  if (to > 0xFFFF)
+    to = 0xFFFF;
+  if (from < bidi_rtl_min_char)
+    bidi_rtl_min_char = from;
+  for (; from <= to; from++)
+    bidi_rtl_bitmap[from >> 3] |= 1 << (from & 7);
+}
+
+static int
+bidi_rtl_p (int c)
+{
+  if (c < bidi_rtl_min_char)
+    return 0;
+  if (c >= 0x10000)
+    {
+      MSymbol bidi = (MSymbol) mchar_get_prop (c, Mbidi_category);
+
+      return (bidi == MbidiR || bidi == MbidiAL
+	      || bidi == MbidiRLE || bidi == MbidiRLO);
+    }
+  return (bidi_rtl_bitmap[c >> 3] & (1 << (c & 7))) != 0;
+}
+
+/* Build bidi_rtl_bitmap again if a character property has been
+   changed since it was built.  */
+
+static void
+update_bidi_rtl_bitmap (void)
+{
+  DRAW_LOCK ();
+  if (bidi_rtl_bitmap_tick != mchar__prop_tick)
+    {
+      MCharTable *table = mchar_get_prop_table (Mbidi_category, NULL);
+
+      memset (bidi_rtl_bitmap, 0, sizeof bidi_rtl_bitmap);
+      bidi_rtl_min_char = 0x10000;
+      if (table)
+	mchartable_map (table, Mnil, set_bidi_rtl_bits, NULL);
+      bidi_rtl_bitmap_tick = mchar__prop_tick;
+    }
+  DRAW_UNLOCK ();
+}
+
+/* Cache of bidi levels of paragraphs analysed on a frame.  A
+   paragraph redrawn with different faces, or after the lines laid
+   out for it are discarded, is then reordered without running the
+   bidi algorithm again.  An entry is looked up by the characters of a
+   paragraph and its base direction, and is valid only while no
+   character property is changed.  */
+
+#define BIDI_LEVELS_CACHE_SIZE 64
+
+struct MBidiLevelsEntry
+{
+  unsigned hash;
+  int reversed;
+  /* Value of mchar__prop_tick when the entry was made.  */
+  int prop_tick;
+  int len;
+  int *chars;
+  char *levels;
+  int max_level;
+};
+
 static int
 analyse_bidi_level (MGlyphString *gstring)
 {
+  MFrame *frame = gstring->frame;
   int len = gstring->used - 2;
-  int bidi_sensitive = gstring->control.orientation_reversed;
+  int reversed = gstring->control.orientation_reversed;
+  int bidi_sensitive = reversed;
   int max_level;
+  MBidiLevelsEntry *entry;
+  unsigned hash;
   MGlyph *g;
   int i;
 #ifdef HAVE_FRIBIDI
-  FriBidiParType base = bidi_sensitive ? FRIBIDI_TYPE_RTL : FRIBIDI_TYPE_LTR;
-  FriBidiChar *logical = alloca (sizeof (FriBidiChar) * len);
+  FriBidiParType base = reversed ? FRIBIDI_TYPE_RTL : FRIBIDI_TYPE_LTR;
+  FriBidiChar *logical;
   FriBidiLevel *levels;
   FriBidiStrIndex *indices;
 #else  /* not HAVE_FRIBIDI */
-  int *logical = alloca (sizeof (int) * len);
-  char *levels = alloca (len);
-
-  memset (levels, 0, sizeof (int) * len);
+  char *levels;
 #endif /* not HAVE_FRIBIDI */
 
-  for (g = MGLYPH (1), i = 0; g->type != GLYPH_ANCHOR; g++, i++)
-    {
-      if (! bidi_sensitive
+  if (len <= 0)
+    return 0;
+  update_bidi_rtl_bitmap ();
 #ifndef HAVE_FRIBIDI
-	  || 1
+  /* The levels are all zero unless the text contains a right-to-left
+     character, whatever the base direction is.  */
+  bidi_sensitive = 0;
 #endif	/* not HAVE_FRIBIDI */
-	  )
-	{
-	  MSymbol bidi = (MSymbol) mchar_get_prop (g->g.c, Mbidi_category);
+  if (! bidi_sensitive)
+    {
+      for (g = MGLYPH (1); g->type != GLYPH_ANCHOR; g++)
+	if (bidi_rtl_p (g->g.c))
+	  break;
+      if (g->type == GLYPH_ANCHOR)
+	return 0;
+    }
 
-	  if (bidi == MbidiR || bidi == MbidiAL
-	      || bidi == MbidiRLE || bidi == MbidiRLO)
-	    {
-	      bidi_sensitive = 1;
-#ifndef HAVE_FRIBIDI
-	      levels[i] = 1;
-#endif	/* not HAVE_FRIBIDI */
-	    }
-#ifndef HAVE_FRIBIDI
-	  else if (bidi == MbidiNSM && i > 0 && levels[i - 1])
-	    levels[i] = 1;	    
-#endif	/* not HAVE_FRIBIDI */
+  hash = reversed;
+  for (g = MGLYPH (1); g->type != GLYPH_ANCHOR; g++)
+    hash = (hash << 5) + hash + g->g.c;
+  entry = (frame->bidi_levels_cache
+	   ? frame->bidi_levels_cache[hash % BIDI_LEVELS_CACHE_SIZE] : NULL);
+  if (entry && entry->hash == hash && entry->reversed == reversed
+      && entry->prop_tick == mchar__prop_tick && entry->len == len)
+    {
+      for (g = MGLYPH (1), i = 0; i < len; g++, i++)
+	if (entry->chars[i] != g->g.c)
+	  break;
+      if (i == len)
+	{
+	  MGLYPH (0)->bidi_level = 0;
+	  for (g = MGLYPH (1), i = 0; i < len; g++, i++)
+	    g->bidi_level = entry->levels[i];
+	  MGLYPH (i)->bidi_level = 0;
+	  return entry->max_level;
 	}
-      logical[i] = g->g.c;
     }
 
-  if (! bidi_sensitive)
-    return 0;
-
 #ifdef HAVE_FRIBIDI
+  logical = alloca (sizeof (FriBidiChar) * len);
+  for (g = MGLYPH (1), i = 0; i < len; g++, i++)
+    logical[i] = g->g.c;
   levels = alloca (sizeof (FriBidiLevel) * (len + 1));
   indices = alloca (sizeof (FriBidiStrIndex) * (len + 1));
 
   fribidi_log2vis (logical, len, &base, NULL, NULL, indices, levels);
+#else  /* not HAVE_FRIBIDI */
+  levels = alloca (len);
+  memset (levels, 0, len);
+  for (g = MGLYPH (1), i = 0; i < len; g++, i++)
+    {
+      if (bidi_rtl_p (g->g.c))
+	levels[i] = 1;
+      else if (i > 0 && levels[i - 1]
+	       && ((MSymbol) mchar_get_prop (g->g.c, Mbidi_category)
+		   == MbidiNSM))
+	levels[i] = 1;
+    }
 #endif /* not HAVE_FRIBIDI */
 
   MGLYPH (0)->bidi_level = 0;
@@ -165,6 +326,30 @@ analyse_bidi_level (MGlyphString *gstring)
 	max_level = g->bidi_level;
     }
   MGLYPH (i)->bidi_level = 0;
+
+  if (! frame->bidi_levels_cache)
+    MTABLE_CALLOC (frame->bidi_levels_cache, BIDI_LEVELS_CACHE_SIZE,
+		   MERROR_DRAW);
+  if (! entry)
+    {
+      MSTRUCT_CALLOC (entry, MERROR_DRAW);
+      frame->bidi_levels_cache[hash % BIDI_LEVELS_CACHE_SIZE] = entry;
+    }
+  if (entry->len != len)
+    {
+      MTABLE_REALLOC (entry->chars, len, MERROR_DRAW);
+      MTABLE_REALLOC (entry->levels, len, MERROR_DRAW);
+    }
+  entry->hash = hash;
+  entry->reversed = reversed;
+  entry->prop_tick = mchar__prop_tick;
+  entry->len = len;
+  for (g = MGLYPH (1), i = 0; i < len; g++, i++)
+    {
+      entry->chars[i] = g->g.c;
+      entry->levels[i] = levels[i];
+    }
+  entry->max_level = max_level;
   return max_level;
 }
 
@@ -278,7 +463,8 @@ run_flt (MGlyphString *gstring, int from, int to, MRealizedFace *rface)
   mflt_try_otf = rfont->driver->try_otf;
   for (i = 0; i < 3; i++)
     {
-      to = mflt_run (&flt_gstr, from, to, &font.font, flt);
+      to = mflt_run_with_workspace (&flt_gstr, from, to, &font.font, flt,
+				    flt_workspace);
       if (to != -2)
 	break;
       APPEND_GLYPH (gstring, *MGLYPH (0));
@@ -1356,33 +1542,118 @@ render_glyph_string (MFrame *frame, MDrawWindow win, int x, int y,
 
 static int gstring_num;
 
+/* Pool of glyph strings of a frame.  A glyph string released while
+   the frame is alive is kept in the pool with its glyph array and
+   reused by alloc_gstring (), so lines are composed without
+   allocating memory once the pool has warmed up.  As a glyph string
+   may be released after the frame is freed (e.g. when an M-text it
+   was attached to is freed), every glyph string taken from the pool
+   keeps a reference to it, and the pool itself is freed when both
+   the frame and all such glyph strings have gone.  */
+
+#define GSTRING_POOL_SIZE 64
+
+/* A glyph string that has more glyphs than this is not pooled, so
+   that a single long paragraph doesn't keep a large glyph array for
+   every glyph string of the pool.  */
+#define GSTRING_POOL_MAX_GLYPHS 1024
+
+struct MGlyphStringPool
+{
+  M17NObject control;
+
+  /* The frame of the pool, or NULL after the frame is freed.  */
+  MFrame *frame;
+
+  /* Glyph strings ready for reuse, chained by the member <next>.  */
+  MGlyphString *free_list;
+  int nfree;
+
+  /* The largest size of the glyph arrays of the pooled glyph
+     strings.  A new glyph string is given a glyph array of this
+     size.  */
+  int max_glyphs;
+
+  /* Glyph string for the end of an M-text, which is never attached
+     to the M-text.  Its reference count is always zero.  */
+  MGlyphString scratch;
+};
+
+static void
+free_gstring_pool (void *object)
+{
+  MGlyphStringPool *pool = (MGlyphStringPool *) object;
+
+  MLIST_FREE1 (&pool->scratch, glyphs);
+  free (pool);
+}
+
 static void
 free_gstring (void *object)
 {
   MGlyphString *gstring = (MGlyphString *) object;
+  MGlyphStringPool *pool = gstring->pool;
 
   if (gstring->next)
     free_gstring (gstring->next);
-  if (gstring->size > 0)
-    free (gstring->glyphs);
-  free (gstring);
+  DRAW_LOCK ();
   gstring_num--;
+  if (pool->frame && pool->nfree < GSTRING_POOL_SIZE
+      && gstring->size <= GSTRING_POOL_MAX_GLYPHS)
+    {
+      if (pool->max_glyphs < gstring->size)
+	pool->max_glyphs = gstring->size;
+      gstring->next = pool->free_list;
+      pool->free_list = gstring;
+      pool->nfree++;
+    }
+  else
+    {
+      if (gstring->size > 0)
+	free (gstring->glyphs);
+      free (gstring);
+      M17N_OBJECT_UNREF (pool);
+    }
+  DRAW_UNLOCK ();
 }
 
+/* Release the glyph strings containing GSTRING.  M17N_OBJECT_UNREF
+   can't be applied to GSTRING->top itself because it clears the
+   member after the glyph strings are freed.  */
+
+#define UNREF_GSTRING(gstring)			\
+  do {						\
+    MGlyphString *top = (gstring)->top;		\
+						\
+    M17N_OBJECT_UNREF (top);			\
+  } while (0)
 
-static MGlyphString scratch_gstring;
 
 static MGlyphString *
 alloc_gstring (MFrame *frame, MText *mt, int pos, MDrawControl *control,
 	       int line, int y)
 {
+  MGlyphStringPool *pool;
   MGlyphString *gstring;
 
+  /* The pool and its scratch glyph string are shared by all threads
+     drawing on FRAME.  The drawing entry points already hold
+     DRAW_LOCK, and the scratch glyph string stays valid only while
+     they do; here we just keep the lock until GSTRING is set up.  */
+  DRAW_LOCK ();
+  pool = frame->gstring_pool;
+  if (! pool)
+    {
+      M17N_OBJECT (pool, free_gstring_pool, MERROR_DRAW);
+      pool->frame = frame;
+      MLIST_INIT1 (&pool->scratch, glyphs, 3);
+      frame->gstring_pool = pool;
+    }
   if (pos == mt->nchars)
     {
       MGlyph *g;
 
-      gstring = &scratch_gstring;
+      gstring = &pool->scratch;
       if (gstring->size == 0)
 	{
 	  MGlyph g_tmp;
@@ -1408,10 +1679,34 @@ alloc_gstring (MFrame *frame, MText *mt, int pos, MDrawControl *control,
       g->g.from = g->g.to = pos;
       gstring->to = pos;
     }
+  else if (pool->free_list)
+    {
+      MGlyph *glyphs;
+      int size;
+
+      gstring = pool->free_list;
+      pool->free_list = gstring->next;
+      pool->nfree--;
+      glyphs = gstring->glyphs, size = gstring->size;
+      memset (gstring, 0, sizeof (MGlyphString));
+      ((M17NObject *) gstring)->ref_count = 1;
+      ((M17NObject *) gstring)->u.freer = free_gstring;
+      MLIST_INIT1 (gstring, glyphs, 128);
+      gstring->glyphs = glyphs, gstring->size = size;
+      gstring->pool = pool;
+      gstring_num++;
+    }
   else
     {
       M17N_OBJECT (gstring, free_gstring, MERROR_DRAW);
       MLIST_INIT1 (gstring, glyphs, 128);
+      if (pool->max_glyphs > 0)
+	{
+	  MTABLE_MALLOC (gstring->glyphs, pool->max_glyphs, MERROR_DRAW);
+	  gstring->size = pool->max_glyphs;
+	}
+      gstring->pool = pool;
+      M17N_OBJECT_REF (pool);
       gstring_num++;
     }
 
@@ -1425,6 +1720,7 @@ alloc_gstring (MFrame *frame, MText *mt, int pos, MDrawControl *control,
   else
     gstring->width_limit = control->max_line_width;
   gstring->anti_alias = control->anti_alias;
+  DRAW_UNLOCK ();
   return gstring;
 }
 
@@ -1461,6 +1757,8 @@ truncate_gstring (MFrame *frame, MText *mt, MGlyphString *gstring)
     }
 
   pos = gstring->from + i;
+  gstring->overflow = pos;
+  gstring->context_to = find_glyph_in_gstring (gstring, pos, 1)->g.to + 1;
   if (gstring->control.line_break)
     {
       pos = (*gstring->control.line_break) (mt, gstring->from + i,
@@ -1487,6 +1785,449 @@ truncate_gstring (MFrame *frame, MText *mt, MGlyphString *gstring)
 }
 
 
+/* Return 1 if glyph strings laid out with the control C1 can be used
+   for the control C2, else return 0.  The members that affect only
+   how the glyphs are drawn (e.g. cursor_pos) are not compared.  */
+
+static int
+layout_control_equal_p (MDrawControl *c1, MDrawControl *c2)
+{
+  return (c1->align_head == c2->align_head
+	  && c1->two_dimensional == c2->two_dimensional
+	  && c1->orientation_reversed == c2->orientation_reversed
+	  && c1->enable_bidi == c2->enable_bidi
+	  && c1->ignore_formatting_char == c2->ignore_formatting_char
+	  && c1->fixed_width == c2->fixed_width
+	  && (c1->disable_overlapping_adjustment
+	      == c2->disable_overlapping_adjustment)
+	  && c1->min_line_ascent == c2->min_line_ascent
+	  && c1->min_line_descent == c2->min_line_descent
+	  && c1->max_line_ascent == c2->max_line_ascent
+	  && c1->max_line_descent == c2->max_line_descent
+	  && c1->max_line_width == c2->max_line_width
+	  && c1->tab_width == c2->tab_width
+	  && c1->format == c2->format
+	  && c1->line_break == c2->line_break
+	  && c1->cursor_width == c2->cursor_width
+	  && c1->cursor_bidi == c2->cursor_bidi);
+}
+
+
+/* Lines of paragraphs laid out on a frame.  They are reused as is
+   while a paragraph is not changed, and after the paragraph laid out
+   last is edited, its leading lines that are not affected by the edit
+   are reused instead of being composed again.  A paragraph is looked
+   up by its characters, not by the M-text, because a frame without an
+   output device doesn't attach glyph strings to M-texts.  */
+
+/* Number of buckets of MLineCache.  */
+#define LINE_CACHE_SIZE 256
+
+/* When the total number of characters of the entries of MLineCache
+   exceeds this, all the entries are discarded.  */
+#define LINE_CACHE_MAX_CHARS 65536
+
+typedef struct MLineCacheEntry MLineCacheEntry;
+
+struct MLineCacheEntry
+{
+  /* Next entry in the same bucket.  */
+  MLineCacheEntry *next;
+
+  unsigned hash;
+
+  /* The first glyph string of the lines.  */
+  MGlyphString *gstring;
+
+  /* Number of characters of the paragraph including the pseudo
+     character for the cursor at the end of text.  */
+  int length;
+
+  /* Number of characters of the paragraph.  */
+  int nchars;
+
+  /* Text data of the paragraph in the format of the M-text.  */
+  int format, nbytes;
+  unsigned char *data;
+};
+
+struct MLineCache
+{
+  /* Buckets of entries chained by the member next.  An entry is put
+     in the bucket indexed by its hash value.  */
+  MLineCacheEntry *buckets[LINE_CACHE_SIZE];
+
+  /* Total number of characters of the entries.  */
+  int nchars;
+
+  /* The entry stored or found last, or NULL.  */
+  MLineCacheEntry *last;
+};
+
+/* Free all the entries of CACHE.  */
+
+static void
+free_line_cache_entries (MLineCache *cache)
+{
+  int i;
+
+  for (i = 0; i < LINE_CACHE_SIZE; i++)
+    while (cache->buckets[i])
+      {
+	MLineCacheEntry *entry = cache->buckets[i];
+
+	cache->buckets[i] = entry->next;
+	M17N_OBJECT_UNREF (entry->gstring);
+	free (entry->data);
+	free (entry);
+      }
+  cache->nchars = 0;
+  cache->last = NULL;
+}
+
+/* Return the hash value of the paragraph of MT between BEG and END,
+   and set *FROM_BYTE and *NBYTES to the byte position and the number
+   of bytes of the paragraph in MT->data.  */
+
+static unsigned
+paragraph_hash (MText *mt, int beg, int end, int *from_byte, int *nbytes)
+{
+  int unit_bytes = UNIT_BYTES (mt->format);
+  unsigned h = end - beg;
+  unsigned char *p, *pend;
+
+  if (end > mtext_nchars (mt))
+    end = mtext_nchars (mt);
+  *from_byte = POS_CHAR_TO_BYTE (mt, beg) * unit_bytes;
+  *nbytes = POS_CHAR_TO_BYTE (mt, end) * unit_bytes - *from_byte;
+  for (p = mt->data + *from_byte, pend = p + *nbytes; p < pend; p++)
+    h = (h << 5) + h + *p;
+  return h;
+}
+
+/* Find an entry of the paragraph of MT between BEG and END in
+   FRAME->line_cache.  HASH, FROM_BYTE, and NBYTES are what
+   paragraph_hash () returned for the paragraph.  Return NULL if no
+   entry has the same characters.  */
+
+static MLineCacheEntry *
+find_line_cache_entry (MFrame *frame, MText *mt, int beg, int end,
+		       unsigned hash, int from_byte, int nbytes)
+{
+  MLineCacheEntry *entry;
+
+  for (entry = frame->line_cache->buckets[hash % LINE_CACHE_SIZE]; entry;
+       entry = entry->next)
+    if (entry->hash == hash
+	&& entry->length == end - beg
+	&& entry->format == mt->format
+	&& entry->nchars == MIN (end, mtext_nchars (mt)) - beg
+	&& entry->nbytes == nbytes
+	&& memcmp (entry->data, mt->data + from_byte, nbytes) == 0)
+      break;
+  return entry;
+}
+
+/* Return the character at *P in the text data of ENTRY, and advance
+   *P to the next character.  */
+
+static int
+line_cache_char (MLineCacheEntry *entry, unsigned char **p)
+{
+  int c, units;
+
+  if (entry->format <= MTEXT_FORMAT_UTF_8)
+    c = STRING_CHAR_AND_UNITS_UTF8 (*p, units);
+  else if (entry->format <= MTEXT_FORMAT_UTF_16BE)
+    {
+      unsigned short *q = (unsigned short *) *p;
+      unsigned short q1[2];
+
+      if (entry->format != MTEXT_FORMAT_UTF_16)
+	{
+	  q1[0] = SWAP_16 (q[0]);
+	  if (q1[0] >= 0xD800 && q1[0] < 0xDC00)
+	    q1[1] = SWAP_16 (q[1]);
+	  q = q1;
+	}
+      c = STRING_CHAR_AND_UNITS_UTF16 (q, units);
+    }
+  else
+    {
+      c = *(unsigned *) *p;
+      if (entry->format != MTEXT_FORMAT_UTF_32)
+	c = SWAP_32 (c);
+      units = 1;
+    }
+  *p += units * UNIT_BYTES (entry->format);
+  return c;
+}
+
+/* Memorize the lines GSTRING of the paragraph of MT ending at END in
+   FRAME->line_cache.  */
+
+static void
+remember_lines (MFrame *frame, MText *mt, int end, MGlyphString *gstring)
+{
+  MLineCache *cache = frame->line_cache;
+  MLineCacheEntry *entry;
+  unsigned hash;
+  int from_byte, nbytes;
+
+  if (! cache)
+    {
+      MSTRUCT_CALLOC (cache, MERROR_DRAW);
+      frame->line_cache = cache;
+    }
+  hash = paragraph_hash (mt, gstring->from, end, &from_byte, &nbytes);
+  entry = find_line_cache_entry (frame, mt, gstring->from, end,
+				 hash, from_byte, nbytes);
+  if (entry)
+    {
+      /* The lines in the entry are obsolete.  */
+      M17N_OBJECT_UNREF (entry->gstring);
+      entry->gstring = gstring;
+      M17N_OBJECT_REF (gstring);
+      cache->last = entry;
+      return;
+    }
+  if (cache->nchars + end - gstring->from > LINE_CACHE_MAX_CHARS)
+    free_line_cache_entries (cache);
+  MSTRUCT_CALLOC (entry, MERROR_DRAW);
+  entry->next = cache->buckets[hash % LINE_CACHE_SIZE];
+  cache->buckets[hash % LINE_CACHE_SIZE] = entry;
+  entry->hash = hash;
+  entry->length = end - gstring->from;
+  if (end > mtext_nchars (mt))
+    end = mtext_nchars (mt);
+  entry->nchars = end - gstring->from;
+  cache->nchars += entry->nchars;
+  entry->format = mt->format;
+  entry->nbytes = nbytes;
+  MTABLE_MALLOC (entry->data, nbytes, MERROR_DRAW);
+  memcpy (entry->data, mt->data + from_byte, nbytes);
+  M17N_OBJECT_REF (gstring);
+  entry->gstring = gstring;
+  cache->last = entry;
+}
+
+/* Nonzero if GSTRING is referred to by more than one owner.  Such
+   lines must not be shifted in place.  */
+#define GSTRING_SHARED_P(gstring)				\
+  (((M17NObject *) (gstring))->ref_count_extended		\
+   || ((M17NObject *) (gstring))->ref_count > 1)
+
+/* Shift the positions of the lines GSTRING by OFFSET characters and
+   update their anti-aliasing flag by CONTROL.  */
+
+static void
+shift_lines (MGlyphString *gstring, int offset, MDrawControl *control)
+{
+  for (; gstring; gstring = gstring->next)
+    {
+      int i;
+
+      gstring->anti_alias = control->anti_alias;
+      if (! offset)
+	continue;
+      gstring->from += offset;
+      gstring->to += offset;
+      gstring->overflow += offset;
+      gstring->context_to += offset;
+      for (i = 0; i < gstring->used; i++)
+	{
+	  gstring->glyphs[i].g.from += offset;
+	  gstring->glyphs[i].g.to += offset;
+	}
+    }
+}
+
+/* Return a copy of the line SRC shifted by OFFSET characters.  */
+
+static MGlyphString *
+copy_line (MFrame *frame, MText *mt, MGlyphString *src, int offset,
+	   MDrawControl *control, int line, int y)
+{
+  MGlyphString *gstring;
+  int i;
+
+  /* SRC may be a line of the cursor alone at the end of text, but the
+     copy must not be the scratch glyph string.  */
+  gstring = alloc_gstring (frame, mt, src->top->from + offset, control,
+			   line, y);
+  for (i = 0; i < src->used; i++)
+    {
+      MGlyph g = src->glyphs[i];
+
+      g.g.from += offset;
+      g.g.to += offset;
+      APPEND_GLYPH (gstring, g);
+    }
+  gstring->from = src->from + offset;
+  gstring->to = src->to + offset;
+  gstring->width = src->width;
+  gstring->height = src->height;
+  gstring->ascent = src->ascent;
+  gstring->descent = src->descent;
+  gstring->physical_ascent = src->physical_ascent;
+  gstring->physical_descent = src->physical_descent;
+  gstring->lbearing = src->lbearing;
+  gstring->rbearing = src->rbearing;
+  gstring->text_ascent = src->text_ascent;
+  gstring->text_descent = src->text_descent;
+  gstring->line_ascent = src->line_ascent;
+  gstring->line_descent = src->line_descent;
+  gstring->overflow = src->overflow + offset;
+  gstring->context_to = src->context_to + offset;
+  return gstring;
+}
+
+/* Return a copy of the lines SRC shifted by OFFSET characters.  */
+
+static MGlyphString *
+copy_lines (MFrame *frame, MText *mt, MGlyphString *src, int offset,
+	    MDrawControl *control)
+{
+  MGlyphString *gstring, *gst;
+  int line = 0, y = 0;
+
+  gstring = gst = copy_line (frame, mt, src, offset, control, 0, 0);
+  for (src = src->next; src; src = src->next)
+    {
+      line++, y += gst->height;
+      gst->next = copy_line (frame, mt, src, offset, control, line, y);
+      gst->next->top = gstring;
+      gst = gst->next;
+    }
+  return gstring;
+}
+
+/* If FRAME->line_cache holds the lines of the same paragraph as that
+   of MT between BEG and END, return them shifted to BEG.  They are
+   copied if they must be shifted but are also used by someone other
+   than the cache.  Otherwise, return NULL.  */
+
+static MGlyphString *
+find_lines (MFrame *frame, MText *mt, int beg, int end,
+	    MDrawControl *control)
+{
+  MLineCache *cache = frame->line_cache;
+  MLineCacheEntry *entry;
+  unsigned hash;
+  int from_byte, nbytes;
+
+  if (! cache)
+    return NULL;
+  hash = paragraph_hash (mt, beg, end, &from_byte, &nbytes);
+  entry = find_line_cache_entry (frame, mt, beg, end, hash, from_byte, nbytes);
+  if (! entry
+      || entry->gstring->tick != frame->tick
+      || ! layout_control_equal_p (&entry->gstring->control, control)
+      || mtext__other_property_p (mt, M_glyph_string))
+    return NULL;
+  cache->last = entry;
+  if (entry->gstring->from != beg && GSTRING_SHARED_P (entry->gstring))
+    return copy_lines (frame, mt, entry->gstring,
+		       beg - entry->gstring->from, control);
+  shift_lines (entry->gstring, beg - entry->gstring->from, control);
+  M17N_OBJECT_REF (entry->gstring);
+  return entry->gstring;
+}
+
+/* Copy the leading lines in the entry of FRAME->line_cache stored or
+   found last that are still valid for the paragraph of MT between BEG
+   and END.  If some lines are copied, return the last of them and set
+   *LINE and *Y to its line number and Y coordinate.  Otherwise,
+   return NULL.
+
+   A line is valid if the characters that determined its line break
+   are not changed, and none of them is laid out by FLT, reordered by
+   bidi, or of such a script that its font depends on the following
+   characters.  Finally, the line break is confirmed with the
+   control's line_break function.  */
+
+static MGlyphString *
+reuse_lines (MFrame *frame, MText *mt, int beg, int end,
+	     MDrawControl *control, int *line, int *y)
+{
+  MLineCacheEntry *entry
+    = frame->line_cache ? frame->line_cache->last : NULL;
+  MGlyphString *src, *gstring = NULL, *gst = NULL;
+  unsigned char *p;
+  MGlyph *g;
+  int nchars = mtext_nchars (mt);
+  int limit, offset, i;
+
+  if (! entry
+      || entry->gstring->tick != frame->tick
+      || ! layout_control_equal_p (&entry->gstring->control, control)
+      || control->orientation_reversed
+      || mtext__other_property_p (mt, M_glyph_string))
+    return NULL;
+  offset = beg - entry->gstring->from;
+  for (limit = beg, p = entry->data; limit < end && limit < nchars; limit++)
+    {
+      int c = mtext_ref_char (mt, limit);
+      MSymbol script;
+
+      if (limit - beg >= entry->nchars
+	  || c != line_cache_char (entry, &p))
+	break;
+      if (c >= 0x100
+	  && ((script = mchar_get_prop (c, Mscript)) == Mcommon
+	      || script == Minherited))
+	break;
+    }
+  for (src = entry->gstring; src; src = src->next)
+    for (g = src->glyphs + 1; g->type != GLYPH_ANCHOR; g++)
+      if ((g->bidi_level || (g->rface && g->rface->layouter != Mnil))
+	  && g->g.from + offset < limit)
+	limit = g->g.from + offset;
+  if (control->enable_bidi)
+    for (i = limit; i < end && i < nchars; i++)
+      {
+	MSymbol bidi = mchar_get_prop (mtext_ref_char (mt, i),
+				       Mbidi_category);
+
+	if (bidi == MbidiR || bidi == MbidiAL
+	    || bidi == MbidiRLE || bidi == MbidiRLO)
+	  return NULL;
+      }
+
+  *line = *y = 0;
+  for (src = entry->gstring; src->next; src = src->next)
+    {
+      int pos = src->overflow + offset;
+      int from = src->from + offset;
+
+      if (src->context_to + offset > limit)
+	break;
+      if (control->line_break)
+	{
+	  pos = (*control->line_break) (mt, pos, from, pos, 0, 0);
+	  if (pos <= from)
+	    pos = find_glyph_in_gstring (src, src->from, 1)->g.to + offset;
+	  else if (pos >= end)
+	    pos = end;
+	}
+      else if (pos == from)
+	pos = find_glyph_in_gstring (src, src->from, 1)->g.to + offset;
+      if (pos != src->to + offset)
+	break;
+      if (gst)
+	{
+	  (*line)++, *y += gst->height;
+	  gst->next = copy_line (frame, mt, src, offset, control, *line, *y);
+	  gst->next->top = gstring;
+	  gst = gst->next;
+	}
+      else
+	gstring = gst = copy_line (frame, mt, src, offset, control, 0, 0);
+    }
+  return gst;
+}
+
+
 /* Return a gstring that covers a character at POS.  */
 
 static MGlyphString *
@@ -1512,12 +2253,11 @@ get_gstring (MFrame *frame, MText *mt, int pos, int to, MDrawControl *control)
 	  gstring = prop->val;
 	  if (gstring->frame != frame
 	      || gstring->tick != frame->tick
-	      || memcmp (control, &gstring->control,
-			 (char *) (&control->with_cursor)
-			 - (char *) (control))
-	      || control->cursor_pos != gstring->control.cursor_pos
-	      || control->cursor_width != gstring->control.cursor_width
-	      || control->cursor_bidi != gstring->control.cursor_bidi)
+	      || ! layout_control_equal_p (control, &gstring->control)
+	      /* The paragraph has moved, and the lines are also used
+		 by someone else, e.g. the line cache.  */
+	      || (prop->start != gstring->from
+		  && GSTRING_SHARED_P (gstring)))
 	    {
 	      mtext_detach_property (prop);
 	      gstring = NULL;
@@ -1529,7 +2269,6 @@ get_gstring (MFrame *frame, MText *mt, int pos, int to, MDrawControl *control)
 
   if (gstring)
     {
-      MGlyphString *gst;
       int offset;
 
       offset = mtext_character (mt, pos, 0, '\n');
@@ -1537,26 +2276,14 @@ get_gstring (MFrame *frame, MText *mt, int pos, int to, MDrawControl *control)
 	offset = 0;
       else
 	offset++;
-      offset -= gstring->from;
-      if (offset)
-	for (gst = gstring; gst; gst = gst->next)
-	  {
-	    int i;
-
-	    gst->from += offset;
-	    gst->to += offset;
-	    for (i = 0; i < gst->used; i++)
-	      {
-		gst->glyphs[i].g.from += offset;
-		gst->glyphs[i].g.to += offset;
-	      }
-	  }
+      shift_lines (gstring, offset - gstring->from, control);
       M17N_OBJECT_REF (gstring);
     }
   else
     {
-      int beg, end;
-      int line = 0, y = 0;
+      int beg, end, para_end;
+      int line = 0, y = 0, cached = 0;
+      MGlyphString *gst = NULL;
 
       if (pos < mtext_nchars (mt))
 	{
@@ -1568,34 +2295,72 @@ get_gstring (MFrame *frame, MText *mt, int pos, int to, MDrawControl *control)
 	}
       else
 	beg = pos;
-      end = mtext_nchars (mt) + (control->cursor_width != 0);
-      gstring = alloc_gstring (frame, mt, beg, control, line, y);
-      if (beg < mtext_nchars (mt))
-	compose_glyph_string (frame, mt, beg, end, gstring);
-      layout_glyph_string (frame, gstring);
-      end = gstring->to;
-      if (gstring->width_limit
-	  && gstring->width > gstring->width_limit)
+      end = para_end = mtext_nchars (mt) + (control->cursor_width != 0);
+      if (beg < mtext_nchars (mt) && control->two_dimensional)
 	{
-	  MGlyphString *gst = gstring;
+	  int nl = mtext_character (mt, beg, mtext_nchars (mt), '\n');
 
-	  truncate_gstring (frame, mt, gst);
-	  while (gst->to < end)
+	  if (nl >= 0)
+	    para_end = nl + 1;
+	}
+      if (beg < mtext_nchars (mt) && ! control->disable_caching)
+	{
+	  gstring = find_lines (frame, mt, beg, para_end, control);
+	  if (gstring)
+	    end = para_end, cached = 1;
+	  else if (control->two_dimensional)
 	    {
-	      line++, y += gst->height;
-	      gst->next = alloc_gstring (frame, mt, gst->from, control,
-					 line, y);
-	      gst->next->top = gstring;
-	      compose_glyph_string (frame, mt, gst->to, end, gst->next);
-	      gst = gst->next;
-	      layout_glyph_string (frame, gst);
-	      if (gst->width <= gst->width_limit)
+	      gst = reuse_lines (frame, mt, beg, para_end, control,
+				 &line, &y);
+	      if (gst)
+		{
+		  gstring = gst->top;
+		  end = para_end;
+		}
+	    }
+	}
+      if (! gstring)
+	{
+	  gstring = alloc_gstring (frame, mt, beg, control, line, y);
+	  if (beg < mtext_nchars (mt))
+	    compose_glyph_string (frame, mt, beg, end, gstring);
+	  layout_glyph_string (frame, gstring);
+	  end = gstring->to;
+	  if (gstring->width_limit
+	      && gstring->width > gstring->width_limit)
+	    {
+	      gst = gstring;
+	      truncate_gstring (frame, mt, gst);
+	    }
+	}
+      if (gst)
+	{
+	  while (gst->to < end)
+	    {
+	      line++, y += gst->height;
+	      gst->next = alloc_gstring (frame, mt, gst->from, control,
+					 line, y);
+	      gst->next->top = gstring;
+	      compose_glyph_string (frame, mt, gst->to, end, gst->next);
+	      gst = gst->next;
+	      layout_glyph_string (frame, gst);
+	      if (gst->width <= gst->width_limit)
 		break;
 	      truncate_gstring (frame, mt, gst);
 	    }
 	}
-
-      if (! control->disable_caching && pos < mtext_nchars (mt))
+      if (! cached
+	  && beg < mtext_nchars (mt)
+	  && ! control->disable_caching
+	  && ! mtext__other_property_p (mt, M_glyph_string))
+	remember_lines (frame, mt, end, gstring);
+
+      /* On a frame without an output device, M-texts are just
+	 measured, possibly by multiple threads, and the text extents
+	 are memorized in the frame instead.  */
+      if (! control->disable_caching
+	  && frame->device_type & MDEVICE_SUPPORT_OUTPUT
+	  && pos < mtext_nchars (mt))
 	{
 	  MTextProperty *prop = mtext_property (M_glyph_string, gstring,
 						MTEXTPROP_VOLATILE_STRONG);
@@ -1649,18 +2414,117 @@ draw_text (MFrame *frame, MDrawWindow win, int x, int y,
   while (from < to)
     {
       y += gstring->line_descent;
-      M17N_OBJECT_UNREF (gstring->top);
+      UNREF_GSTRING (gstring);
       gstring = get_gstring (frame, mt, from, to, control);
       y += gstring->line_ascent;
       render_glyph_string (frame, win, x, y, gstring, from, to);
       from = gstring->to;
     }
-  M17N_OBJECT_UNREF (gstring->top);
+  UNREF_GSTRING (gstring);
 
   return 0;
 }
 
 
+/* Cache of text extents measured on a frame without an output
+   device.  Such a frame is used just to measure texts, and the same
+   short texts tend to be measured repeatedly, often as different
+   M-texts.  So, an entry is looked up by the characters of a text
+   instead of by the M-text itself, which is how the glyph strings
+   attached as M_glyph_string properties are found.  */
+
+#define TEXT_EXTENTS_CACHE_SIZE 256
+#define TEXT_EXTENTS_CACHE_MAX_BYTES 256
+
+struct MTextExtentsEntry
+{
+  unsigned hash;
+  unsigned tick;
+  MDrawControl control;
+  int from, to;
+  int format, nbytes;
+  unsigned char data[TEXT_EXTENTS_CACHE_MAX_BYTES];
+  int width;
+  MDrawMetric ink, logical, line;
+};
+
+/* Return 1 if the extents of the text between FROM and TO of MT
+   drawn on FRAME with CONTROL can be cached, and set *HASH to the
+   hash value of them.  Otherwise return 0.  */
+
+static int
+text_extents_cacheable_p (MFrame *frame, MText *mt, int from, int to,
+			  MDrawControl *control, unsigned *hash)
+{
+  unsigned h;
+  int nbytes = mt->nbytes * UNIT_BYTES (mt->format);
+  int i;
+
+  if (frame->device_type & MDEVICE_SUPPORT_OUTPUT
+      || control->format || control->line_break
+      || nbytes > TEXT_EXTENTS_CACHE_MAX_BYTES
+      || mtext__other_property_p (mt, M_glyph_string))
+    return 0;
+  h = mt->format;
+  for (i = 0; i < nbytes; i++)
+    h = (h << 5) + h + mt->data[i];
+  h = (h << 5) + h + from;
+  *hash = (h << 5) + h + to;
+  return 1;
+}
+
+static MTextExtentsEntry *
+lookup_text_extents (MFrame *frame, MText *mt, int from, int to,
+		     MDrawControl *control, unsigned hash)
+{
+  MTextExtentsEntry *entry;
+  int nbytes = mt->nbytes * UNIT_BYTES (mt->format);
+
+  if (! frame->extents_cache)
+    return NULL;
+  entry = frame->extents_cache[hash % TEXT_EXTENTS_CACHE_SIZE];
+  if (entry
+      && entry->hash == hash
+      && entry->tick == frame->tick
+      && entry->from == from && entry->to == to
+      && entry->format == mt->format
+      && entry->nbytes == nbytes
+      && memcmp (entry->data, mt->data, nbytes) == 0
+      && memcmp (&entry->control, control, sizeof (MDrawControl)) == 0)
+    return entry;
+  return NULL;
+}
+
+static void
+store_text_extents (MFrame *frame, MText *mt, int from, int to,
+		    MDrawControl *control, unsigned hash, int width,
+		    MDrawMetric *ink, MDrawMetric *logical, MDrawMetric *line)
+{
+  MTextExtentsEntry *entry;
+
+  if (! frame->extents_cache)
+    MTABLE_CALLOC (frame->extents_cache, TEXT_EXTENTS_CACHE_SIZE,
+		   MERROR_DRAW);
+  entry = frame->extents_cache[hash % TEXT_EXTENTS_CACHE_SIZE];
+  if (! entry)
+    {
+      MSTRUCT_MALLOC (entry, MERROR_DRAW);
+      frame->extents_cache[hash % TEXT_EXTENTS_CACHE_SIZE] = entry;
+    }
+  entry->hash = hash;
+  entry->tick = frame->tick;
+  entry->control = *control;
+  entry->from = from, entry->to = to;
+  entry->format = mt->format;
+  entry->nbytes = mt->nbytes * UNIT_BYTES (mt->format);
+  memcpy (entry->data, mt->data, entry->nbytes);
+  entry->width = width;
+  entry->ink = *ink;
+  entry->logical = *logical;
+  entry->line = *line;
+}
+
+
 static MGlyph *
 find_glyph_in_gstring (MGlyphString *gstring, int pos, int forwardp)
 {
@@ -1733,9 +2597,6 @@ mdraw__init ()
 {
   M_glyph_string = msymbol_as_managing_key ("  glyph-string");
 
-  memset (&scratch_gstring, 0, sizeof (scratch_gstring));
-  MLIST_INIT1 (&scratch_gstring, glyphs, 3);
-
   Mcommon = msymbol ("common");
 
   McatCc = msymbol ("Cc");
@@ -1763,6 +2624,7 @@ mdraw__init ()
   M_kinsoku_eol = msymbol ("ke");
 
   mflt_enable_new_feature = 1;
+  flt_workspace = mflt_create_workspace ();
 
   return 0;
 }
@@ -1770,9 +2632,66 @@ mdraw__init ()
 void
 mdraw__fini ()
 {
-  MLIST_FREE1 (&scratch_gstring, glyphs);
+  mflt_destroy_workspace (flt_workspace);
+  flt_workspace = NULL;
   M17N_OBJECT_UNREF (linebreak_table);
   linebreak_table = NULL;
+  bidi_rtl_bitmap_tick = -1;
+}
+
+void
+mdraw__free_cache (MFrame *frame)
+{
+  if (frame->extents_cache)
+    {
+      int i;
+
+      for (i = 0; i < TEXT_EXTENTS_CACHE_SIZE; i++)
+	free (frame->extents_cache[i]);
+      free (frame->extents_cache);
+      frame->extents_cache = NULL;
+    }
+  if (frame->line_cache)
+    {
+      free_line_cache_entries (frame->line_cache);
+      free (frame->line_cache);
+      frame->line_cache = NULL;
+    }
+  if (frame->bidi_levels_cache)
+    {
+      int i;
+
+      for (i = 0; i < BIDI_LEVELS_CACHE_SIZE; i++)
+	if (frame->bidi_levels_cache[i])
+	  {
+	    free (frame->bidi_levels_cache[i]->chars);
+	    free (frame->bidi_levels_cache[i]->levels);
+	    free (frame->bidi_levels_cache[i]);
+	  }
+      free (frame->bidi_levels_cache);
+      frame->bidi_levels_cache = NULL;
+    }
+  if (frame->gstring_pool)
+    {
+      MGlyphStringPool *pool = frame->gstring_pool;
+
+      DRAW_LOCK ();
+      while (pool->free_list)
+	{
+	  MGlyphString *gstring = pool->free_list;
+
+	  pool->free_list = gstring->next;
+	  if (gstring->size > 0)
+	    free (gstring->glyphs);
+	  free (gstring);
+	  M17N_OBJECT_UNREF (pool);
+	}
+      pool->nfree = 0;
+      pool->frame = NULL;
+      frame->gstring_pool = NULL;
+      M17N_OBJECT_UNREF (pool);
+      DRAW_UNLOCK ();
+    }
 }
 
 /*** @} */
@@ -1924,11 +2843,15 @@ mdraw_text (MFrame *frame, MDrawWindow win, int x, int y,
 	    MText *mt, int from, int to)
 {
   MDrawControl control;
+  int result;
 
   M_CHECK_WRITABLE (frame, MERROR_DRAW, -1);
   memset (&control, 0, sizeof control);
   control.as_image = 0;
-  return draw_text (frame, win, x, y, mt, from, to, &control);
+  DRAW_LOCK ();
+  result = draw_text (frame, win, x, y, mt, from, to, &control);
+  DRAW_UNLOCK ();
+  return result;
 }
 
 /*=*/
@@ -1986,11 +2909,15 @@ mdraw_image_text (MFrame *frame, MDrawWindow win, int x, int y,
 		  MText *mt, int from, int to)
 {
   MDrawControl control;
+  int result;
 
   M_CHECK_WRITABLE (frame, MERROR_DRAW, -1);
   memset (&control, 0, sizeof control);
   control.as_image = 1;
-  return draw_text (frame, win, x, y, mt, from, to, &control);
+  DRAW_LOCK ();
+  result = draw_text (frame, win, x, y, mt, from, to, &control);
+  DRAW_UNLOCK ();
+  return result;
 }
 
 /*=*/
@@ -2030,8 +2957,129 @@ int
 mdraw_text_with_control (MFrame *frame, MDrawWindow win, int x, int y,
 			 MText *mt, int from, int to, MDrawControl *control)
 {
+  int result;
+
   M_CHECK_WRITABLE (frame, MERROR_DRAW, -1);
-  return draw_text (frame, win, x, y, mt, from, to, control);
+  DRAW_LOCK ();
+  result = draw_text (frame, win, x, y, mt, from, to, control);
+  DRAW_UNLOCK ();
+  return result;
+}
+
+/*=*/
+
+static int
+text_extents (MFrame *frame,
+	      MText *mt, int from, int to, MDrawControl *control,
+	      MDrawMetric *overall_ink_return,
+	      MDrawMetric *overall_logical_return,
+	      MDrawMetric *overall_line_return)
+{
+  MGlyphString *gstring;
+  int y = 0;
+  int width, lbearing, rbearing;
+
+  ASSURE_CONTROL (control);
+  M_CHECK_POS_X (mt, from, -1);
+  if (to > mtext_nchars (mt) + (control->cursor_width != 0))
+    to = mtext_nchars (mt) + (control->cursor_width != 0);
+  else if (to < from)
+    to = from;
+
+  gstring = get_gstring (frame, mt, from, to, control);
+  if (! gstring)
+    MERROR (MERROR_DRAW, -1);
+  width = gstring_width (gstring, from, to, &lbearing, &rbearing);
+  if (overall_ink_return)
+    overall_ink_return->y = - gstring->physical_ascent;
+  if (overall_logical_return)
+    overall_logical_return->y = - gstring->ascent;
+  if (overall_line_return)
+    overall_line_return->y = - gstring->line_ascent;
+
+  for (from = gstring->to; from < to; from = gstring->to)
+    {
+      int this_width, this_lbearing, this_rbearing;
+
+      y += gstring->line_descent;
+      UNREF_GSTRING (gstring);
+      gstring = get_gstring (frame, mt, from, to, control);
+      this_width = gstring_width (gstring, from, to,
+				  &this_lbearing, &this_rbearing);
+      y += gstring->line_ascent;
+      if (width < this_width)
+	width = this_width;
+      if (rbearing < this_rbearing)
+	rbearing = this_rbearing;
+      if (lbearing > this_lbearing)
+	lbearing = this_lbearing;
+    }
+  if (overall_ink_return)
+    {
+      overall_ink_return->x = lbearing;
+      overall_ink_return->width = rbearing - lbearing;
+      overall_ink_return->height
+	= y + gstring->physical_descent - overall_ink_return->y;
+    }
+  if (overall_logical_return)
+    {
+      overall_logical_return->x = 0;
+      overall_logical_return->width = width;
+      overall_logical_return->height
+	= y + gstring->descent - overall_logical_return->y;
+    }
+  if (overall_line_return)
+    {
+      overall_line_return->x = lbearing;
+      overall_line_return->width = MAX (width, rbearing - lbearing);
+      overall_line_return->height
+	= y + gstring->line_descent - overall_line_return->y;
+    }
+
+  UNREF_GSTRING (gstring);
+  return width;
+}
+
+/* Call text_extents () while looking up and updating the text
+   extents cache of FRAME.  */
+
+static int
+cached_text_extents (MFrame *frame,
+		     MText *mt, int from, int to, MDrawControl *control,
+		     MDrawMetric *overall_ink_return,
+		     MDrawMetric *overall_logical_return,
+		     MDrawMetric *overall_line_return)
+{
+  MTextExtentsEntry *entry;
+  MDrawMetric ink, logical, line;
+  unsigned hash;
+  int width;
+
+  if (! text_extents_cacheable_p (frame, mt, from, to, control, &hash))
+    return text_extents (frame, mt, from, to, control, overall_ink_return,
+			 overall_logical_return, overall_line_return);
+  entry = lookup_text_extents (frame, mt, from, to, control, hash);
+  if (entry)
+    {
+      width = entry->width;
+      ink = entry->ink, logical = entry->logical, line = entry->line;
+    }
+  else
+    {
+      width = text_extents (frame, mt, from, to, control,
+			    &ink, &logical, &line);
+      if (width < 0)
+	return -1;
+      store_text_extents (frame, mt, from, to, control, hash,
+			  width, &ink, &logical, &line);
+    }
+  if (overall_ink_return)
+    *overall_ink_return = ink;
+  if (overall_logical_return)
+    *overall_logical_return = logical;
+  if (overall_line_return)
+    *overall_line_return = line;
+  return width;
 }
 
 /*=*/
@@ -2064,6 +3112,18 @@ mdraw_text_with_control (MFrame *frame, MDrawWindow win, int x, int y,
     min_line_ascent, min_line_descent, max_line_ascent, and
     max_line_descent of $CONTROL are all zero.
 
+    $FRAME may be a frame of the null device (see mframe ()), which
+    measures texts with FreeType fonts without any window system.  On
+    such a frame, no glyph string is cached in $MT.  Instead, the
+    extents of a text that has no text property are memorized in
+    $FRAME, and they are reused for any M-text of the same characters
+    measured with the same $CONTROL.  If the library is configured
+    with POSIX threads, this function, as well as
+    mdraw_text_per_char_extents (), mdraw_coordinates_position (),
+    mdraw_glyph_info (), and mdraw_glyph_list (), can be called from
+    multiple threads simultaneously as long as each M-text is used
+    by one thread at a time; the calls are serialized.
+
     @return
     This function returns the width of the text to be drawn in the
     unit of pixels.  If $CONTROL->two_dimensional is nonzero and the
@@ -2114,134 +3174,85 @@ mdraw_text_extents (MFrame *frame,
 		    MDrawMetric *overall_logical_return,
 		    MDrawMetric *overall_line_return)
 {
-  MGlyphString *gstring;
-  int y = 0;
-  int width, lbearing, rbearing;
+  int width;
 
   ASSURE_CONTROL (control);
-  M_CHECK_POS_X (mt, from, -1);
-  if (to > mtext_nchars (mt) + (control->cursor_width != 0))
-    to = mtext_nchars (mt) + (control->cursor_width != 0);
-  else if (to < from)
-    to = from;
-
-  gstring = get_gstring (frame, mt, from, to, control);
-  if (! gstring)
-    MERROR (MERROR_DRAW, -1);
-  width = gstring_width (gstring, from, to, &lbearing, &rbearing);
-  if (overall_ink_return)
-    overall_ink_return->y = - gstring->physical_ascent;
-  if (overall_logical_return)
-    overall_logical_return->y = - gstring->ascent;
-  if (overall_line_return)
-    overall_line_return->y = - gstring->line_ascent;
-
-  for (from = gstring->to; from < to; from = gstring->to)
-    {
-      int this_width, this_lbearing, this_rbearing;
-
-      y += gstring->line_descent;
-      M17N_OBJECT_UNREF (gstring->top);
-      gstring = get_gstring (frame, mt, from, to, control);
-      this_width = gstring_width (gstring, from, to,
-				  &this_lbearing, &this_rbearing);
-      y += gstring->line_ascent;
-      if (width < this_width)
-	width = this_width;
-      if (rbearing < this_rbearing)
-	rbearing = this_rbearing;
-      if (lbearing > this_lbearing)
-	lbearing = this_lbearing;
-    }
-  if (overall_ink_return)
-    {
-      overall_ink_return->x = lbearing;
-      overall_ink_return->width = rbearing - lbearing;
-      overall_ink_return->height
-	= y + gstring->physical_descent - overall_ink_return->y;
-    }
-  if (overall_logical_return)
-    {
-      overall_logical_return->x = 0;
-      overall_logical_return->width = width;
-      overall_logical_return->height
-	= y + gstring->descent - overall_logical_return->y;
-    }
-  if (overall_line_return)
-    {
-      overall_line_return->x = lbearing;
-      overall_line_return->width = MAX (width, rbearing - lbearing);
-      overall_line_return->height
-	= y + gstring->line_descent - overall_line_return->y;
-    }
-
-  M17N_OBJECT_UNREF (gstring->top);
+  DRAW_LOCK ();
+  width = cached_text_extents (frame, mt, from, to, control,
+			       overall_ink_return, overall_logical_return,
+			       overall_line_return);
+  DRAW_UNLOCK ();
   return width;
 }
 
 /*=*/
 
 /***en
-    @brief Compute the text dimensions of each character of M-text.
+    @brief Compute the text dimensions of multiple M-texts.
 
-    The mdraw_text_per_char_extents () function computes the drawn
-    metric of each character between $FROM and $TO of M-text $MT
-    assuming that they are drawn on a window of frame $FRAME using the
-    mdraw_text_with_control () function with the drawing control
-    object $CONTROL.
+    The mdraw_text_extents_batch () function computes the logical
+    metrics of each of the $N M-texts in the array $MTS as
+    mdraw_text_extents () does for the whole text of each M-text, and
+    stores them in the corresponding elements of the array
+    $METRICS_RETURN.
 
-    $ARRAY_SIZE specifies the size of $INK_ARRAY_RETURN and
-    $LOGICAL_ARRAY_RETURN.  Each successive element of
-    $INK_ARRAY_RETURN and $LOGICAL_ARRAY_RETURN are set to the drawn
-    ink and logical metrics of successive characters respectively,
-    relative to the drawing origin of the M-text.  The number of
-    elements of $INK_ARRAY_RETURN and $LOGICAL_ARRAY_RETURN that have
-    been set is returned to $NUM_CHARS_RETURN.
+    The M-texts are measured with the drawing control object $CONTROL
+    in one go, sharing the realized faces, the fonts selected from
+    the fontsets, and the buffers for layout.  No glyph string is
+    cached in the M-texts regardless of $CONTROL->disable_caching.
+    The metrics of an empty M-text are all zero.
 
-    If $ARRAY_SIZE is too small to return all metrics, the function
-    returns -1 and store the requested size in $NUM_CHARS_RETURN.
-    Otherwise, it returns zero.
+    @return
+    If the operation was successful, mdraw_text_extents_batch ()
+    returns 0.  Otherwise, it returns -1 and assigns an error code to
+    the external variable #merror_code.  In that case, the elements
+    of $METRICS_RETURN for the M-texts after the failed one are not
+    set.  */
 
-    If pointer $OVERALL_INK_RETURN and $OVERALL_LOGICAL_RETURN are not
-    @c NULL, this function also computes the metrics of the overall
-    text and stores the results in the members of the structure
-    pointed to by $OVERALL_INK_RETURN and $OVERALL_LOGICAL_RETURN.
+/***
+    @errors
+    @c MERROR_RANGE, @c MERROR_DRAW  */
 
-    If $CONTROL->two_dimensional is nonzero, this function computes
-    only the metrics of characters in the first line.  */
-/***ja
-    @brief  M-text γʸɽϰϤ׻.
+int
+mdraw_text_extents_batch (MFrame *frame, MText **mts, int n,
+			  MDrawControl *control, MDrawMetric *metrics_return)
+{
+  MDrawControl batch_control;
+  int i;
 
-    ؿ mdraw_text_per_char_extents () ϡؿ mdraw_text_with_control ()
-    楪֥ $CONTROL Ѥ M-text $MT  $FROM  $TO 
-    ޤǤե졼 $FRAME ɽݤγʸΥ׻롣
+  ASSURE_CONTROL (control);
+  batch_control = *control;
+  /* A frame without an output device never caches glyph strings in
+     M-texts.  Leave the control as is for such a frame so that the
+     text extents cache is shared with mdraw_text_extents ().  */
+  if (frame->device_type & MDEVICE_SUPPORT_OUTPUT)
+    batch_control.disable_caching = 1;
+  DRAW_LOCK ();
+  for (i = 0; i < n; i++)
+    {
+      if (mtext_nchars (mts[i]) == 0 && ! control->cursor_width)
+	memset (metrics_return + i, 0, sizeof (MDrawMetric));
+      else if (cached_text_extents (frame, mts[i], 0, mtext_nchars (mts[i]),
+				    &batch_control, NULL, metrics_return + i,
+				    NULL) < 0)
+	break;
+    }
+  DRAW_UNLOCK ();
+  return (i < n ? -1 : 0);
+}
 
-    $ARRAY_SIZE ˤä $INK_ARRAY_RETURN $LOGICAL_ARRAY_RETURN 
-    Υꤹ롣$INK_ARRAY_RETURN $LOGICAL_ARRAY_RETURN 
-    γǤϡ줾ʸ襤󥯤M-text 
-    ɽа͡ˤˤäƽ롣ꤵ줿 $INK_ARRAY_RETURN  
-    $LOGICAL_ARRAY_RETURN Ǥοϡ$NUM_CHARS_RETURN ᤵ롣
-   
-    $ARRAY_SIZE ٤Ƥˡ᤻ʤۤɾˤϡؿ -1 
-    ֤ɬפ礭 $NUM_CHARS_RETURN ֤Ǥʤ 0 
-    ֤
-
-    ݥ $OVERALL_INK_RETURN  $OVERALL_LOGICAL_RETURN @c NULL 
-    ǤʤСδؿϥƥΤΥ׻̤
-    $OVERALL_INK_RETURN  $OVERALL_LOGICAL_RETURN ǻؤ빽¤ΥФ¸롣
-
-    $CONTROL->two_dimensional 0ǤʤСδؿϺǽιԤʸΥ׻롣 */
+/*=*/
 
-int
-mdraw_text_per_char_extents (MFrame *frame,
-			     MText *mt, int from, int to,
-			     MDrawControl *control,
-			     MDrawMetric *ink_array_return,
-			     MDrawMetric *logical_array_return,
-			     int array_size,
-			     int *num_chars_return,
-			     MDrawMetric *overall_ink_return,
-			     MDrawMetric *overall_logical_return)
+static int
+text_per_char_extents (MFrame *frame,
+		       MText *mt, int from, int to,
+		       MDrawControl *control,
+		       MDrawMetric *ink_array_return,
+		       MDrawMetric *logical_array_return,
+		       int array_size,
+		       int *num_chars_return,
+		       MDrawMetric *overall_ink_return,
+		       MDrawMetric *overall_logical_return)
 {
   MGlyphString *gstring;
   MGlyph *g;
@@ -2340,65 +3351,90 @@ mdraw_text_per_char_extents (MFrame *frame,
       overall_logical_return->height = gstring->ascent + gstring->descent;
     }
 
-  M17N_OBJECT_UNREF (gstring->top);
+  UNREF_GSTRING (gstring);
   return 0;
 }
 
 /*=*/
 
 /***en
-    @brief Return the character position nearest to the coordinates.
+    @brief Compute the text dimensions of each character of M-text.
 
-    The mdraw_coordinates_position () function checks which character
-    is to be drawn at coordinate ($X, $Y) when the text between $FROM
-    and $TO of M-text $MT is drawn at the coordinate (0, 0) using the
+    The mdraw_text_per_char_extents () function computes the drawn
+    metric of each character between $FROM and $TO of M-text $MT
+    assuming that they are drawn on a window of frame $FRAME using the
     mdraw_text_with_control () function with the drawing control
-    object $CONTROL.  Here, the character position means the number of
-    characters that precede the character in question in $MT, that is,
-    the character position of the first character is 0.
+    object $CONTROL.
 
-    $FRAME is used only to get the default face information.
+    $ARRAY_SIZE specifies the size of $INK_ARRAY_RETURN and
+    $LOGICAL_ARRAY_RETURN.  Each successive element of
+    $INK_ARRAY_RETURN and $LOGICAL_ARRAY_RETURN are set to the drawn
+    ink and logical metrics of successive characters respectively,
+    relative to the drawing origin of the M-text.  The number of
+    elements of $INK_ARRAY_RETURN and $LOGICAL_ARRAY_RETURN that have
+    been set is returned to $NUM_CHARS_RETURN.
 
-    @return
-    If the glyph image of a character covers coordinate ($X, $Y),
-    mdraw_coordinates_position () returns the character position of
-    that character.\n\n
-    If $Y is less than the minimum Y-coordinate of the drawn area, it
-    returns $FROM.\n\n
-    If $Y is greater than the maximum Y-coordinate of the drawn area,
-    it returns $TO.\n\n
-    If $Y fits in with the drawn area but $X is less than the minimum
-    X-coordinate, it returns the character position of the first
-    character drawn on the line $Y.\n\n
-    If $Y fits in with the drawn area but $X is greater than the
-    maximum X-coordinate, it returns the character position of the
-    last character drawn on the line $Y.  */
+    If $ARRAY_SIZE is too small to return all metrics, the function
+    returns -1 and store the requested size in $NUM_CHARS_RETURN.
+    Otherwise, it returns zero.
 
+    If pointer $OVERALL_INK_RETURN and $OVERALL_LOGICAL_RETURN are not
+    @c NULL, this function also computes the metrics of the overall
+    text and stores the results in the members of the structure
+    pointed to by $OVERALL_INK_RETURN and $OVERALL_LOGICAL_RETURN.
+
+    If $CONTROL->two_dimensional is nonzero, this function computes
+    only the metrics of characters in the first line.  */
 /***ja
-    @brief ꤷɸ˺Ǥᤤʸʸ֤.
+    @brief  M-text γʸɽϰϤ׻.
 
-    ؿ mdraw_coordinates_position () ϡؿ 
-    mdraw_text_with_control () 楪֥ $CONTROL Ѥơ
-    M-text $MT  $FROM  $TO ޤǤɸ (0, 0) 
-    Ȥ褹ݤˡɸ ($X, $Y) 
-    褵ʸʸ֤֤ʸ֤Ȥϡ
-    M-text ˤƤʸǽ餫鲿ܤ򼨤Ǥ롣ǽʸʸ֤0Ȥ롣
+    ؿ mdraw_text_per_char_extents () ϡؿ mdraw_text_with_control ()
+    楪֥ $CONTROL Ѥ M-text $MT  $FROM  $TO 
+    ޤǤե졼 $FRAME ɽݤγʸΥ׻롣
 
-    $FRAME ϥǥեȤΥեξ뤿Ѥ롣
+    $ARRAY_SIZE ˤä $INK_ARRAY_RETURN $LOGICAL_ARRAY_RETURN 
+    Υꤹ롣$INK_ARRAY_RETURN $LOGICAL_ARRAY_RETURN 
+    γǤϡ줾ʸ襤󥯤M-text 
+    ɽа͡ˤˤäƽ롣ꤵ줿 $INK_ARRAY_RETURN  
+    $LOGICAL_ARRAY_RETURN Ǥοϡ$NUM_CHARS_RETURN ᤵ롣
+   
+    $ARRAY_SIZE ٤Ƥˡ᤻ʤۤɾˤϡؿ -1 
+    ֤ɬפ礭 $NUM_CHARS_RETURN ֤Ǥʤ 0 
+    ֤
 
-    @return
-    ɸ ($X, $Y) ʸΥդʤ硢 ؿ 
-    mdraw_coordinates_position () Ϥʸʸ֤֤\n\n
-    ⤷ $Y ΰκǾYɸ⾮ʤ $FROM ֤\n\n
-    ⤷ $Y ΰκYɸ礭ʤ $TO ֤\n\n
-    ⤷ $Y ΰ˾äƤƤ $X ΰκǾXɸ
-    ϡľ y = $Y 褵ǽʸʸ֤֤\n\n
-    ⤷ $Y ΰ˾äƤƤ $X ΰκXɸ
-    礭ϡľ y = $Y 褵Ǹʸʸ֤֤ */
+    ݥ $OVERALL_INK_RETURN  $OVERALL_LOGICAL_RETURN @c NULL 
+    ǤʤСδؿϥƥΤΥ׻̤
+    $OVERALL_INK_RETURN  $OVERALL_LOGICAL_RETURN ǻؤ빽¤ΥФ¸롣
+
+    $CONTROL->two_dimensional 0ǤʤСδؿϺǽιԤʸΥ׻롣 */
 
 int
-mdraw_coordinates_position (MFrame *frame, MText *mt, int from, int to,
-			    int x_offset, int y_offset, MDrawControl *control)
+mdraw_text_per_char_extents (MFrame *frame,
+			     MText *mt, int from, int to,
+			     MDrawControl *control,
+			     MDrawMetric *ink_array_return,
+			     MDrawMetric *logical_array_return,
+			     int array_size,
+			     int *num_chars_return,
+			     MDrawMetric *overall_ink_return,
+			     MDrawMetric *overall_logical_return)
+{
+  int ret;
+
+  DRAW_LOCK ();
+  ret = text_per_char_extents (frame, mt, from, to, control,
+			       ink_array_return, logical_array_return,
+			       array_size, num_chars_return,
+			       overall_ink_return, overall_logical_return);
+  DRAW_UNLOCK ();
+  return ret;
+}
+
+/*=*/
+
+static int
+coordinates_position (MFrame *frame, MText *mt, int from, int to,
+		      int x_offset, int y_offset, MDrawControl *control)
 {
   MGlyphString *gstring;
   int y = 0;
@@ -2420,7 +3456,7 @@ mdraw_coordinates_position (MFrame *frame, MText *mt, int from, int to,
     {
       from = gstring->to;
       y += gstring->line_descent;
-      M17N_OBJECT_UNREF (gstring->top);
+      UNREF_GSTRING (gstring);
       gstring = get_gstring (frame, mt, from, to, control);
       y += gstring->line_ascent;
     }
@@ -2453,7 +3489,7 @@ mdraw_coordinates_position (MFrame *frame, MText *mt, int from, int to,
       && g[-1].g.c == '\n')
     g--;
   from = g->g.from;
-  M17N_OBJECT_UNREF (gstring->top);
+  UNREF_GSTRING (gstring);
 
   return from;
 }
@@ -2461,33 +3497,73 @@ mdraw_coordinates_position (MFrame *frame, MText *mt, int from, int to,
 /*=*/
 
 /***en
-    @brief Compute information about a glyph.
+    @brief Return the character position nearest to the coordinates.
 
-    The mdraw_glyph_info () function computes information about a
-    glyph that covers a character at position $POS of the M-text $MT
-    assuming that the text is drawn from the character at $FROM of $MT
-    on a window of frame $FRAME using the mdraw_text_with_control ()
-    function with the drawing control object $CONTROL.
+    The mdraw_coordinates_position () function checks which character
+    is to be drawn at coordinate ($X, $Y) when the text between $FROM
+    and $TO of M-text $MT is drawn at the coordinate (0, 0) using the
+    mdraw_text_with_control () function with the drawing control
+    object $CONTROL.  Here, the character position means the number of
+    characters that precede the character in question in $MT, that is,
+    the character position of the first character is 0.
+
+    $FRAME is used only to get the default face information.
+
+    @return
+    If the glyph image of a character covers coordinate ($X, $Y),
+    mdraw_coordinates_position () returns the character position of
+    that character.\n\n
+    If $Y is less than the minimum Y-coordinate of the drawn area, it
+    returns $FROM.\n\n
+    If $Y is greater than the maximum Y-coordinate of the drawn area,
+    it returns $TO.\n\n
+    If $Y fits in with the drawn area but $X is less than the minimum
+    X-coordinate, it returns the character position of the first
+    character drawn on the line $Y.\n\n
+    If $Y fits in with the drawn area but $X is greater than the
+    maximum X-coordinate, it returns the character position of the
+    last character drawn on the line $Y.  */
 
-    The information is stored in the members of $INFO.  */
 /***ja
-    @brief դ˴ؤ׻.
+    @brief ꤷɸ˺Ǥᤤʸʸ֤.
 
-    ؿ mdraw_glyph_info () ϡؿ mdraw_text_with_control () 
-     楪֥ $CONTROL ѤM-text $MT  $FROM  $TO 
-    ޤǤե졼 $FRAME 褷硢M-text ʸ $POS 
-    ʸʤդ˴ؤ׻롣
+    ؿ mdraw_coordinates_position () ϡؿ 
+    mdraw_text_with_control () 楪֥ $CONTROL Ѥơ
+    M-text $MT  $FROM  $TO ޤǤɸ (0, 0) 
+    Ȥ褹ݤˡɸ ($X, $Y) 
+    褵ʸʸ֤֤ʸ֤Ȥϡ
+    M-text ˤƤʸǽ餫鲿ܤ򼨤Ǥ롣ǽʸʸ֤0Ȥ롣
 
-    $INFO ΥФݻ롣  */
+    $FRAME ϥǥեȤΥեξ뤿Ѥ롣
 
-/***
-    @seealso
-    MDrawGlyphInfo
-*/
+    @return
+    ɸ ($X, $Y) ʸΥդʤ硢 ؿ 
+    mdraw_coordinates_position () Ϥʸʸ֤֤\n\n
+    ⤷ $Y ΰκǾYɸ⾮ʤ $FROM ֤\n\n
+    ⤷ $Y ΰκYɸ礭ʤ $TO ֤\n\n
+    ⤷ $Y ΰ˾äƤƤ $X ΰκǾXɸ
+    ϡľ y = $Y 褵ǽʸʸ֤֤\n\n
+    ⤷ $Y ΰ˾äƤƤ $X ΰκXɸ
+    礭ϡľ y = $Y 褵Ǹʸʸ֤֤ */
 
 int
-mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
-		  MDrawControl *control, MDrawGlyphInfo *info)
+mdraw_coordinates_position (MFrame *frame, MText *mt, int from, int to,
+			    int x_offset, int y_offset, MDrawControl *control)
+{
+  int pos;
+
+  DRAW_LOCK ();
+  pos = coordinates_position (frame, mt, from, to, x_offset, y_offset,
+			      control);
+  DRAW_UNLOCK ();
+  return pos;
+}
+
+/*=*/
+
+static int
+glyph_info (MFrame *frame, MText *mt, int from, int pos,
+	    MDrawControl *control, MDrawGlyphInfo *info)
 {
   MGlyphString *gstring;
   MGlyph *g;
@@ -2501,9 +3577,11 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
     MERROR (MERROR_DRAW, -1);
   while (gstring->to <= pos)
     {
+      int to = gstring->to;
+
       y += gstring->line_descent;
-      M17N_OBJECT_UNREF (gstring->top);
-      gstring = get_gstring (frame, mt, gstring->to, pos + 1, control);
+      UNREF_GSTRING (gstring);
+      gstring = get_gstring (frame, mt, to, pos + 1, control);
       y += gstring->line_ascent;
     }
   info->line_from = gstring->from;
@@ -2554,7 +3632,7 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
       MGlyph *g_tmp = find_glyph_in_gstring (gst, info->from - 1, 1);
 
       info->prev_from = g_tmp->g.from;
-      M17N_OBJECT_UNREF (gst->top);
+      UNREF_GSTRING (gst);
     }
   else
     info->prev_from = -1;
@@ -2572,7 +3650,7 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
 	  gst = get_gstring (frame, mt, p, gstring->from, control);
 	  g_tmp = gst->glyphs + (gst->used - 2);
 	  info->left_from = g_tmp->g.from, info->left_to = g_tmp->g.to;
-	  M17N_OBJECT_UNREF (gst->top);
+	  UNREF_GSTRING (gst);
 	}
       else
 	info->left_from = info->left_to = -1;
@@ -2588,7 +3666,7 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
 	  gst = get_gstring (frame, mt, p, p + 1, control);
 	  g_tmp = gst->glyphs + (gst->used - 2);
 	  info->left_from = g_tmp->g.from, info->left_to = g_tmp->g.to;
-	  M17N_OBJECT_UNREF (gst->top);
+	  UNREF_GSTRING (gst);
 	}
       else
 	info->left_from = info->left_to = -1;
@@ -2609,7 +3687,7 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
       MGlyph *g_tmp = find_glyph_in_gstring (gst, p, 0);
 
       info->next_to = g_tmp->g.to;
-      M17N_OBJECT_UNREF (gst->top);
+      UNREF_GSTRING (gst);
     }
   else
     info->next_to = -1;
@@ -2626,7 +3704,7 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
       if (gstring->to + (control->cursor_width == 0) <= mtext_nchars (mt))
 	{
 	  pos = gstring->to;
-	  M17N_OBJECT_UNREF (gstring->top);
+	  UNREF_GSTRING (gstring);
 	  gstring = get_gstring (frame, mt, pos, pos + 1, control);
 	  g = MGLYPH (1);
 	  info->right_from = g->g.from, info->right_to = g->g.to;
@@ -2639,7 +3717,7 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
       if (info->line_from > 0)
 	{
 	  pos = gstring->from - 1;
-	  M17N_OBJECT_UNREF (gstring->top);
+	  UNREF_GSTRING (gstring);
 	  gstring = get_gstring (frame, mt, pos, pos + 1, control);
 	  g = MGLYPH (1);
 	  info->right_from = g->g.from, info->right_to = g->g.to;
@@ -2648,54 +3726,55 @@ mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
 	info->right_from = info->right_to = -1;
     }
 
-  M17N_OBJECT_UNREF (gstring->top);
+  UNREF_GSTRING (gstring);
   return 0;
 }
 
 /*=*/
 
 /***en
-    @brief Compute information about glyph sequence.
-
-    The mdraw_glyph_list () function computes information about glyphs
-    corresponding to the text between $FROM and $TO of M-text $MT when
-    it is drawn on a window of frame $FRAME using the
-    mdraw_text_with_control () function with the drawing control
-    object $CONTROL.  $GLYPHS is an array of objects to store the
-    information, and $ARRAY_SIZE is the array size.
-
-    If $ARRAY_SIZE is large enough to cover all glyphs, it stores the
-    number of actually filled elements in the place pointed by
-    $NUM_GLYPHS_RETURN, and returns 0.
+    @brief Compute information about a glyph.
 
-    Otherwise, it stores the required array size in the place pointed
-    by $NUM_GLYPHS_RETURN, and returns -1.  */
+    The mdraw_glyph_info () function computes information about a
+    glyph that covers a character at position $POS of the M-text $MT
+    assuming that the text is drawn from the character at $FROM of $MT
+    on a window of frame $FRAME using the mdraw_text_with_control ()
+    function with the drawing control object $CONTROL.
 
+    The information is stored in the members of $INFO.  */
 /***ja
-    @brief ˴ؤ׻.
-
-    ؿ mdraw_glyph_list () ϡؿ mdraw_text_with_control () 
-    楪֥ $CONTROL ѤM-text $MT  $FROM  $TO
-    ޤǤե졼 $FRAME 褷Ρƥդξ $GLYPHS 
-    ؤ˳Ǽ롣 $ARRAY_SIZE ϤΥǤ롣
+    @brief դ˴ؤ׻.
 
-    ⤷ $ARRAY_SIZE ٤ƤΥդˤĤƤξǼΤ˽ʬǤС
-    $NUM_GLYPHS_RETURN ؤ˼ºݤ᤿Ǥοꤷ 0 ֤
+    ؿ mdraw_glyph_info () ϡؿ mdraw_text_with_control () 
+     楪֥ $CONTROL ѤM-text $MT  $FROM  $TO 
+    ޤǤե졼 $FRAME 褷硢M-text ʸ $POS 
+    ʸʤդ˴ؤ׻롣
 
-    
-    ǤʤС$NUM_GLYPHS_RETURN ؤɬפΥꤷ
-    -1 ֤
-    */
+    $INFO ΥФݻ롣  */
 
 /***
     @seealso
-    MDrawGlyph
+    MDrawGlyphInfo
 */
 
 int
-mdraw_glyph_list (MFrame *frame, MText *mt, int from, int to,
-		  MDrawControl *control, MDrawGlyph *glyphs,
-		  int array_size, int *num_glyphs_return)
+mdraw_glyph_info (MFrame *frame, MText *mt, int from, int pos,
+		  MDrawControl *control, MDrawGlyphInfo *info)
+{
+  int ret;
+
+  DRAW_LOCK ();
+  ret = glyph_info (frame, mt, from, pos, control, info);
+  DRAW_UNLOCK ();
+  return ret;
+}
+
+/*=*/
+
+static int
+glyph_list (MFrame *frame, MText *mt, int from, int to,
+	    MDrawControl *control, MDrawGlyph *glyphs,
+	    int array_size, int *num_glyphs_return)
 {
   MGlyphString *gstring;
   MGlyph *g;
@@ -2761,7 +3840,7 @@ mdraw_glyph_list (MFrame *frame, MText *mt, int from, int to,
 	}
       n++;
     }
-  M17N_OBJECT_UNREF (gstring->top);
+  UNREF_GSTRING (gstring);
 
   *num_glyphs_return = n;
   return (n <= array_size ? 0 : -1);
@@ -2769,6 +3848,60 @@ mdraw_glyph_list (MFrame *frame, MText *mt, int from, int to,
 
 /*=*/
 
+/***en
+    @brief Compute information about glyph sequence.
+
+    The mdraw_glyph_list () function computes information about glyphs
+    corresponding to the text between $FROM and $TO of M-text $MT when
+    it is drawn on a window of frame $FRAME using the
+    mdraw_text_with_control () function with the drawing control
+    object $CONTROL.  $GLYPHS is an array of objects to store the
+    information, and $ARRAY_SIZE is the array size.
+
+    If $ARRAY_SIZE is large enough to cover all glyphs, it stores the
+    number of actually filled elements in the place pointed by
+    $NUM_GLYPHS_RETURN, and returns 0.
+
+    Otherwise, it stores the required array size in the place pointed
+    by $NUM_GLYPHS_RETURN, and returns -1.  */
+
+/***ja
+    @brief ˴ؤ׻.
+
+    ؿ mdraw_glyph_list () ϡؿ mdraw_text_with_control () 
+    楪֥ $CONTROL ѤM-text $MT  $FROM  $TO
+    ޤǤե졼 $FRAME 褷Ρƥդξ $GLYPHS 
+    ؤ˳Ǽ롣 $ARRAY_SIZE ϤΥǤ롣
+
+    ⤷ $ARRAY_SIZE ٤ƤΥդˤĤƤξǼΤ˽ʬǤС
+    $NUM_GLYPHS_RETURN ؤ˼ºݤ᤿Ǥοꤷ 0 ֤
+
+    
+    ǤʤС$NUM_GLYPHS_RETURN ؤɬפΥꤷ
+    -1 ֤
+    */
+
+/***
+    @seealso
+    MDrawGlyph
+*/
+
+int
+mdraw_glyph_list (MFrame *frame, MText *mt, int from, int to,
+		  MDrawControl *control, MDrawGlyph *glyphs,
+		  int array_size, int *num_glyphs_return)
+{
+  int ret;
+
+  DRAW_LOCK ();
+  ret = glyph_list (frame, mt, from, to, control, glyphs, array_size,
+		    num_glyphs_return);
+  DRAW_UNLOCK ();
+  return ret;
+}
+
+/*=*/
+
 /***en
     @brief Draw one or more textitems.
 
@@ -2796,6 +3929,7 @@ mdraw_text_items (MFrame *frame, MDrawWindow win, int x, int y,
 {
   if (! (frame->device_type & MDEVICE_SUPPORT_OUTPUT))
     return;
+  DRAW_LOCK ();
   while (nitems-- > 0)
     {
       if (items->face)
@@ -2810,6 +3944,7 @@ mdraw_text_items (MFrame *frame, MDrawWindow win, int x, int y,
       if (items->face)
 	mtext_pop_prop (items->mt, 0, mtext_nchars (items->mt), Mface);
     }
+  DRAW_UNLOCK ();
 }
 
 /*=*/
@@ -2823,6 +3958,7 @@ mdraw_text_items (MFrame *frame, MDrawWindow win, int x, int y,
     
 int mdraw_line_break_option;
 
+
 /*=*/
 /***en 
     @brief Calculate a line breaking position.
@@ -160,6 +160,29 @@ get_box_create (MFaceBoxProp *prop)
   return box;
 }
 
+/* Number assigned to the next face object.  */
+static unsigned face_id;
+
+/* Maximum number of faces of an entry of MFaceCacheEntry.  */
+#define MFACE_CACHE_MAX_FACES 8
+
+/* Result of mface__realize () memorized in a frame.  */
+
+struct MFaceCacheEntry
+{
+  unsigned hash;
+  /* FRAME->tick when the entry was made.  */
+  unsigned tick;
+  int num;
+  unsigned ids[MFACE_CACHE_MAX_FACES];
+  int with_font;
+  MFont font;
+  MRealizedFace *rface;
+};
+
+/* Size of the direct-mapped table of MFaceCacheEntry.  */
+#define MFACE_CACHE_SIZE 128
+
 /** From FRAME->realized_face_list, find a realized face based on
     FACE.  */
 
@@ -605,10 +628,48 @@ mface__realize (MFrame *frame, MFace **faces, int num, int size, MFont *font)
   int i, j;
   MFaceHookFunc func;
   MFont spec;
+  MFaceCacheEntry key, *entry;
 
   if (num == 0 && frame->rface && ! font)
     return frame->rface;
 
+  /* The result depends only on FRAME->face, FACES, and FONT, and any
+     modification of them increments FRAME->tick.  LIMITTED_SIZE is
+     used only for a new realized face, thus it is not in the key.  */
+  key.num = num <= MFACE_CACHE_MAX_FACES ? num : -1;
+  key.hash = key.num;
+  for (i = 0; i < key.num; i++)
+    {
+      if (! faces[i]->id)
+	{
+	  /* This is the face of a realized face.  */
+	  key.num = -1;
+	  break;
+	}
+      key.ids[i] = faces[i]->id;
+      key.hash = key.hash * 31 + key.ids[i];
+    }
+  key.with_font = font != NULL;
+  if (font)
+    {
+      key.font = *font;
+      key.hash = key.hash * 31 + (size_t) FONT_PROPERTY (font, MFONT_FAMILY);
+      key.hash = key.hash * 31 + font->size;
+    }
+  if (key.num >= 0 && frame->face_cache)
+    {
+      entry = frame->face_cache[key.hash % MFACE_CACHE_SIZE];
+      if (entry
+	  && entry->hash == key.hash
+	  && entry->tick == frame->tick
+	  && entry->num == key.num
+	  && ! memcmp (entry->ids, key.ids, sizeof (unsigned) * key.num)
+	  && entry->with_font == key.with_font
+	  && (! font || ! memcmp (&entry->font, font, sizeof (MFont))))
+	return entry->rface;
+    }
+  merged_face.id = 0;
+
   if (! mplist_find_by_value (frame->face->frame_list, frame))
     mplist_push (frame->face->frame_list, Mt, frame);
   for (i = 0; i < num; i++)
@@ -666,7 +727,7 @@ mface__realize (MFrame *frame, MFace **faces, int num, int size, MFont *font)
     {
       if (font && font->type != MFONT_TYPE_REALIZED)
 	free (font);
-      return rface;
+      goto done;
     }
 
   MSTRUCT_CALLOC (rface, MERROR_FACE);
@@ -791,9 +852,40 @@ mface__realize (MFrame *frame, MFace **faces, int num, int size, MFont *font)
       mplist_add (rface->non_ascii_list, Mt, nofont);
     }
 
+ done:
+  if (key.num >= 0)
+    {
+      if (! frame->face_cache)
+	MTABLE_CALLOC (frame->face_cache, MFACE_CACHE_SIZE, MERROR_FACE);
+      entry = frame->face_cache[key.hash % MFACE_CACHE_SIZE];
+      if (! entry)
+	{
+	  MSTRUCT_MALLOC (entry, MERROR_FACE);
+	  frame->face_cache[key.hash % MFACE_CACHE_SIZE] = entry;
+	}
+      *entry = key;
+      entry->tick = frame->tick;
+      entry->rface = rface;
+    }
   return rface;
 }
 
+/** Free the table of realized faces of FRAME.  */
+
+void
+mface__free_cache (MFrame *frame)
+{
+  if (frame->face_cache)
+    {
+      int i;
+
+      for (i = 0; i < MFACE_CACHE_SIZE; i++)
+	free (frame->face_cache[i]);
+      free (frame->face_cache);
+      frame->face_cache = NULL;
+    }
+}
+
 
 MGlyph *
 mface__for_chars (MSymbol script, MSymbol language, MSymbol charset,
@@ -1642,6 +1734,7 @@ mface ()
 
   M17N_OBJECT (face, free_face, MERROR_FACE);
   face->frame_list = mplist ();
+  face->id = ++face_id;
   M17N_OBJECT_REGISTER (face_table, face);
   return face;
 }
@@ -1670,6 +1763,7 @@ mface_copy (MFace *face)
   copy->control.ref_count = 1;
   M17N_OBJECT_REGISTER (face_table, copy);
   copy->frame_list = mplist ();
+  copy->id = ++face_id;
   if (copy->property[MFACE_FONTSET])
     M17N_OBJECT_REF (copy->property[MFACE_FONTSET]);
   return copy;
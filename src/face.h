@@ -66,6 +66,9 @@ struct MFace
 
   /** List of frames affected by the face modification.  */
   MPlist *frame_list;
+
+  /** Unique number of the face, or 0 if it is not a face object.  */
+  unsigned id;
 };
 
 
@@ -128,4 +131,6 @@ extern void mface__free_realized (MRealizedFace *rface);
 
 extern void mface__update_frame_face (MFrame *frame);
 
+extern void mface__free_cache (MFrame *frame);
+
 #endif /* _M17N_FACE_H_ */
@@ -41,6 +41,7 @@
 #include "internal-gui.h"
 #include "font.h"
 #include "face.h"
+#include "database.h"
 
 #ifdef HAVE_FREETYPE
 
@@ -48,6 +49,10 @@
 #include FT_BDF_H
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 static int mdebug_flag = MDEBUG_FONT;
 
 #ifdef HAVE_FONTCONFIG
@@ -67,27 +72,81 @@ static FT_Library ft_library;
 #ifdef HAVE_OTF
 static OTF *invalid_otf = (OTF *) "";
 static OTF *get_otf (MFLTFont *font, FT_Face *ft_face);
+
+typedef struct OTFCacheEntry OTFCacheEntry;
 #endif /* HAVE_OTF */
 
+/* Bitmap of the characters supported by a font.  */
+
+typedef struct
+{
+  /* Number of elements of INDEX.  */
+  int nblocks;
+  /* For each block of 256 characters, 1 + index into PAGES of the
+     bitmap of the block, or 0 if no character of the block is
+     supported.  */
+  unsigned short *index;
+  unsigned char (*pages)[32];
+  int npages;
+} MFontCoverageFT;
+
+#define COVERAGE_HAS_CHAR_P(coverage, c)				\
+  ((c) >= 0 && ((c) >> 8) < (coverage)->nblocks				\
+   && (coverage)->index[(c) >> 8]					\
+   && ((coverage)->pages[(coverage)->index[(c) >> 8] - 1][((c) & 0xFF) >> 3] \
+       & (1 << ((c) & 7))))
+
 typedef struct
 {
   MFont font;
 #ifdef HAVE_OTF
   /* NULL if not yet opened.  invalid_otf if not OTF.  */
   OTF *otf;
+  /* Cache of the results of driving OTF, or NULL if not yet
+     created.  */
+  OTFCacheEntry **otf_cache;
+  int otf_cache_hits, otf_cache_misses;
 #endif /* HAVE_OTF */
 #ifdef HAVE_FONTCONFIG
   FcLangSet *langset;
   FcCharSet *charset;
-#endif	/* HAVE_FONTCONFIG */
+#else  /* not HAVE_FONTCONFIG */
+  /* Sorted ranges of the characters supported by the font; FROM and
+     TO of each range are stored in turn.  NULL if not yet known.  */
+  int *coverage;
+  int coverage_len;
+#endif	/* not HAVE_FONTCONFIG */
+  /* Built from CHARSET or COVERAGE by ft_coverage (), or NULL if not
+     yet built.  */
+  MFontCoverageFT *coverage_bitmap;
 } MFontFT;
 
+static MFontCoverageFT *ft_coverage (MFontFT *ft_info);
+
+/* Metrics of a glyph cached in MRealizedFontFT.  */
+
+typedef struct
+{
+  unsigned code;
+  /* Nonzero if the other members are set.  */
+  int measured;
+  int lbearing, rbearing, xadv, ascent, descent;
+} MGlyphMetricFT;
+
+/* Glyphs whose IDs are less than this are cached in a table indexed
+   by glyph ID, the others in a hash table.  */
+#define METRIC_DENSE_SIZE 512
+
 typedef struct
 {
   M17NObject control;
   FT_Face ft_face;		/* This must be the 2nd member. */
   MPlist *charmap_list;
   int face_encapsulated;
+  /* Cache of glyph metrics, or NULL if not yet created.  */
+  MGlyphMetricFT *metric_dense;
+  MGlyphMetricFT *metric_hash;
+  int metric_hash_size, metric_hash_used;
 } MRealizedFontFT;
 
 typedef struct
@@ -128,6 +187,18 @@ static MPlist *ft_language_list;
 
 static MPlist *ft_file_list;
 
+/** Index of FreeType fonts by weight, style, and stretch.  The Nth
+    element is for the property MFONT_WEIGHT + N.  Keys are property
+    values, values are plists containing fonts having the
+    corresponding value in the reverse order of ft_font_list.  In the
+    deeper plist, keys are the same as ft_font_list, values are
+    (MFontFT *).  */
+static MPlist *ft_property_list[3];
+
+/** Number of families in ft_font_list when ft_property_list was
+    built.  */
+static int ft_property_list_families;
+
 static int all_fonts_scaned;
 
 #define STRDUP_LOWER(s1, size, s2)				\
@@ -144,24 +215,34 @@ static int all_fonts_scaned;
 
 
 static MPlist *ft_list_family (MSymbol, int, int);
+static void flush_bitmap_cache (FT_Face ft_face);
 
 static void
 free_ft_rfont (void *object)
 {
   MRealizedFontFT *ft_rfont = object;
 
+  flush_bitmap_cache (ft_rfont->ft_face);
   if (! ft_rfont->face_encapsulated)
     {
       M17N_OBJECT_UNREF (ft_rfont->charmap_list);
       FT_Done_Face (ft_rfont->ft_face);
     }
+  free (ft_rfont->metric_dense);
+  free (ft_rfont->metric_hash);
   free (ft_rfont);
 }
 
+#ifdef HAVE_OTF
+static void free_otf_cache (MFontFT *ft_info);
+#endif /* HAVE_OTF */
+
 static void
 free_ft_info (MFontFT *ft_info)
 {
 #ifdef HAVE_OTF
+  if (ft_info->otf_cache)
+    free_otf_cache (ft_info);
   if (ft_info->otf && ft_info->otf != invalid_otf)
     OTF_close (ft_info->otf);
 #endif /* HAVE_OTF */
@@ -170,7 +251,15 @@ free_ft_info (MFontFT *ft_info)
     FcLangSetDestroy (ft_info->langset);
   if (ft_info->charset)
     FcCharSetDestroy (ft_info->charset);
-#endif	/* HAVE_FONTCONFIG */
+#else  /* not HAVE_FONTCONFIG */
+  free (ft_info->coverage);
+#endif	/* not HAVE_FONTCONFIG */
+  if (ft_info->coverage_bitmap)
+    {
+      free (ft_info->coverage_bitmap->index);
+      free (ft_info->coverage_bitmap->pages);
+      free (ft_info->coverage_bitmap);
+    }
   free (ft_info);
 }
 
@@ -576,6 +665,51 @@ fc_list_pattern (FcPattern *pattern)
   return plist;
 }
 
+/* Set up all elements of ft_font_list whose values are still NULL.
+   This is the same as calling ft_list_family for each of them, but
+   lists fonts by fontconfig only once.  */
+
+static void
+fc_list_all_families (void)
+{
+  MPlist *pending = mplist (), *plist, *pl;
+  FcPattern *pattern = FcPatternCreate ();
+  FcObjectSet *os = FcObjectSetBuild (FC_FAMILY, FC_FOUNDRY, FC_WEIGHT,
+				      FC_SLANT, FC_WIDTH, FC_PIXEL_SIZE,
+				      FC_LANG, FC_CHARSET, FC_FILE, NULL);
+  FcFontSet *fs = FcFontList (fc_config, pattern, os);
+  char *fam, *buf;
+  int bufsize = 0;
+  int i, j;
+
+  MPLIST_DO (plist, ft_font_list)
+    if (! MPLIST_VAL (plist))
+      {
+	MPLIST_VAL (plist) = mplist ();
+	mplist_push (pending, MPLIST_KEY (plist), MPLIST_VAL (plist));
+      }
+  for (i = 0; fs && i < fs->nfont; i++)
+    for (j = 0; FcPatternGetString (fs->fonts[i], FC_FAMILY, j,
+				    (FcChar8 **) &fam) == FcResultMatch; j++)
+      {
+	MSymbol family;
+
+	STRDUP_LOWER (buf, bufsize, fam);
+	family = msymbol (buf);
+	if ((pl = mplist_get (pending, family)))
+	  {
+	    MFontFT *ft_info = fc_gen_font (fs->fonts[i],
+					    MSYMBOL_NAME (family));
+
+	    mplist_add (pl, ft_info->font.file, ft_info);
+	  }
+      }
+  if (fs) FcFontSetDestroy (fs);
+  FcObjectSetDestroy (os);
+  FcPatternDestroy (pattern);
+  M17N_OBJECT_UNREF (pending);
+}
+
 /* Return FcCharSet object built from CHAR_LIST or MT.  In the latter
    case, it is assured that the M-text contains at least one
    character.  */
@@ -620,29 +754,354 @@ fc_build_charset (MPlist *char_list, MText *mt)
 
 #else	/* not HAVE_FONTCONFIG */
 
+/* Font catalog.
+
+   If mfont_use_font_catalog is nonzero, ft_init_font_list () records
+   the properties and the character coverage of each file found in
+   mfont_freetype_path into the file "font-catalog" of the user's m17n
+   directory, and uses that record instead of opening the file next
+   time as long as the file keeps the same modification time and size.
+
+   The catalog is a text file.  The first line is
+   FONT_CATALOG_MAGIC.  Then, each file has this line:
+	MTIME SIZE N<TAB>FILENAME
+   where N is -1 if the file is not a font.  Otherwise, it is followed
+   by a line of the font properties MFONT_FOUNDRY to MFONT_REGISTRY
+   and the size separated by TAB, and N lines of character ranges
+   "FROM TO" in hexadecimal.  */
+
+#define FONT_CATALOG_MAGIC "M17NFONTCATALOG 1"
+#define FONT_CATALOG_FILE "font-catalog"
+
+typedef struct
+{
+  time_t mtime;
+  off_t size;
+  /* Nonzero if the file is found in the current scan.  */
+  int used;
+  /* NULL if the file is not a font.  */
+  MFontFT *ft_info;
+} FontCatalogEntry;
+
+/* Plist of the entries of the catalog.  Keys are file names, values
+   are pointers to FontCatalogEntry.  NULL if the catalog is not
+   used.  */
+static MPlist *ft_catalog;
+
+/* Nonzero if ft_catalog must be saved.  */
+static int ft_catalog_modified;
+
+static char *
+ft_catalog_file (void)
+{
+  MDatabaseInfo *dir_info;
+  char *filename;
+
+  if (! mdatabase__dir_list)
+    return NULL;
+  dir_info = MPLIST_VAL (mdatabase__dir_list);
+  if (! dir_info->filename)
+    return NULL;
+  filename = malloc (dir_info->len + sizeof FONT_CATALOG_FILE);
+  if (filename)
+    sprintf (filename, "%s%s", dir_info->filename, FONT_CATALOG_FILE);
+  return filename;
+}
+
+/* Read a line from FP into *BUF of *SIZE bytes, extending it if
+   necessary.  Remove the trailing newline.  Return 0 on success, and
+   -1 on EOF or memory shortage.  */
+
+static int
+ft_catalog_read_line (FILE *fp, char **buf, int *size)
+{
+  int len = 0;
+
+  while (1)
+    {
+      if (len + 1 >= *size)
+	{
+	  char *new = realloc (*buf, *size ? *size * 2 : 256);
+
+	  if (! new)
+	    return -1;
+	  *buf = new;
+	  *size = *size ? *size * 2 : 256;
+	}
+      if (! fgets (*buf + len, *size - len, fp))
+	return (len > 0 ? 0 : -1);
+      len += strlen (*buf + len);
+      if (len > 0 && (*buf)[len - 1] == '\n')
+	{
+	  (*buf)[len - 1] = '\0';
+	  return 0;
+	}
+    }
+}
+
+static void
+free_ft_catalog (void)
+{
+  MPlist *plist;
+
+  MPLIST_DO (plist, ft_catalog)
+    {
+      FontCatalogEntry *entry = MPLIST_VAL (plist);
+
+      if (entry->ft_info && ! entry->used)
+	free_ft_info (entry->ft_info);
+      free (entry);
+    }
+  M17N_OBJECT_UNREF (ft_catalog);
+}
+
+static void
+load_ft_catalog (void)
+{
+  char *filename = ft_catalog_file ();
+  FILE *fp = filename ? fopen (filename, "r") : NULL;
+  char *buf = NULL;
+  int bufsize = 0;
+  long mtime, size;
+  int n, i;
+
+  ft_catalog = mplist ();
+  free (filename);
+  if (! fp)
+    return;
+  if (ft_catalog_read_line (fp, &buf, &bufsize) < 0
+      || strcmp (buf, FONT_CATALOG_MAGIC))
+    goto err;
+  while (fscanf (fp, "%ld %ld %d", &mtime, &size, &n) == 3
+	 && getc (fp) == '\t'
+	 && ft_catalog_read_line (fp, &buf, &bufsize) == 0)
+    {
+      FontCatalogEntry *entry;
+      MSymbol file = msymbol (buf);
+
+      MSTRUCT_CALLOC (entry, MERROR_FONT_FT);
+      entry->mtime = mtime;
+      entry->size = size;
+      mplist_push (ft_catalog, file, entry);
+      if (n < 0)
+	continue;
+      MSTRUCT_CALLOC (entry->ft_info, MERROR_FONT_FT);
+      if (ft_catalog_read_line (fp, &buf, &bufsize) < 0)
+	goto err;
+      {
+	MFont *font = &entry->ft_info->font;
+	char *p = buf, *tab;
+
+	MFONT_INIT (font);
+	for (i = MFONT_FOUNDRY; i <= MFONT_REGISTRY; i++, p = tab + 1)
+	  {
+	    if (! (tab = strchr (p, '\t')))
+	      goto err;
+	    *tab = '\0';
+	    mfont__set_property (font, i, msymbol (p));
+	  }
+	font->size = atoi (p);
+	font->type = MFONT_TYPE_OBJECT;
+	font->source = MFONT_SOURCE_FT;
+	font->file = file;
+      }
+      if (n > 0)
+	{
+	  int *coverage = malloc (sizeof (int) * n * 2);
+
+	  if (! coverage)
+	    goto err;
+	  entry->ft_info->coverage = coverage;
+	  entry->ft_info->coverage_len = n * 2;
+	  for (i = 0; i < n * 2; i++)
+	    if (fscanf (fp, "%X", (unsigned *) (coverage + i)) != 1)
+	      goto err;
+	}
+    }
+  fclose (fp);
+  free (buf);
+  MDEBUG_PRINT1 (" [FONT-FT] loaded %d fonts from the catalog\n",
+		 MPLIST_LENGTH (ft_catalog));
+  return;
+
+ err:
+  /* The catalog is broken.  Ignore all of it.  */
+  fclose (fp);
+  free (buf);
+  free_ft_catalog ();
+  ft_catalog = mplist ();
+  ft_catalog_modified = 1;
+}
+
+static void
+save_ft_catalog (void)
+{
+  char *filename = ft_catalog_file ();
+  char *tmp;
+  FILE *fp = NULL;
+  MPlist *plist;
+  int i, error = 0;
+
+  if (! filename)
+    return;
+  /* Write into a temporary file first so that a process reading the
+     catalog never sees an incomplete one.  */
+  tmp = alloca (strlen (filename) + 10);
+  sprintf (tmp, "%s.%X", filename, (unsigned) getpid ());
+  if (! (fp = fopen (tmp, "w")))
+    {
+      char *dir = alloca (strlen (filename) + 1);
+      struct stat buf;
+
+      strcpy (dir, filename);
+      *strrchr (dir, PATH_SEPARATOR) = '\0';
+      if (stat (dir, &buf) == 0
+	  || mkdir (dir, 0777) < 0
+	  || ! (fp = fopen (tmp, "w")))
+	{
+	  free (filename);
+	  return;
+	}
+    }
+  fprintf (fp, "%s\n", FONT_CATALOG_MAGIC);
+  MPLIST_DO (plist, ft_catalog)
+    {
+      FontCatalogEntry *entry = MPLIST_VAL (plist);
+      MFontFT *ft_info = entry->ft_info;
+
+      if (! entry->used || strchr (MSYMBOL_NAME (MPLIST_KEY (plist)), '\n'))
+	continue;
+      fprintf (fp, "%ld %ld %d\t%s\n", (long) entry->mtime,
+	       (long) entry->size, ft_info ? ft_info->coverage_len / 2 : -1,
+	       MSYMBOL_NAME (MPLIST_KEY (plist)));
+      if (! ft_info)
+	continue;
+      for (i = MFONT_FOUNDRY; i <= MFONT_REGISTRY; i++)
+	fprintf (fp, "%s\t", (ft_info->font.property[i]
+			       ? MSYMBOL_NAME (FONT_PROPERTY (&ft_info->font, i))
+			       : "nil"));
+      fprintf (fp, "%d\n", ft_info->font.size);
+      for (i = 0; i < ft_info->coverage_len; i += 2)
+	fprintf (fp, "%X %X\n",
+		 ft_info->coverage[i], ft_info->coverage[i + 1]);
+    }
+  if (ferror (fp))
+    error = 1;
+  if (fclose (fp) != 0)
+    error = 1;
+  if (error || rename (tmp, filename) < 0)
+    unlink (tmp);
+  else
+    MDEBUG_PRINT1 (" [FONT-FT] saved the font catalog into %s\n", filename);
+  free (filename);
+}
+
+/* Set the coverage of FT_INFO to the characters supported by
+   FT_FACE.  */
+
+static void
+ft_set_coverage (MFontFT *ft_info, FT_Face ft_face)
+{
+  FT_ULong c;
+  FT_UInt idx;
+  int *coverage = NULL;
+  int size = 0, len = 0;
+
+  for (c = FT_Get_First_Char (ft_face, &idx); idx;
+       c = FT_Get_Next_Char (ft_face, c, &idx))
+    {
+      if (len > 0 && coverage[len - 1] + 1 == c)
+	{
+	  coverage[len - 1] = c;
+	  continue;
+	}
+      if (len + 2 > size)
+	{
+	  int *new = realloc (coverage, sizeof (int) * (size += 256));
+
+	  if (! new)
+	    {
+	      free (coverage);
+	      return;
+	    }
+	  coverage = new;
+	}
+      coverage[len++] = c;
+      coverage[len++] = c;
+    }
+  ft_info->coverage = coverage;
+  ft_info->coverage_len = len;
+}
+
 static MPlist *
 ft_add_font (char *filename)
 {
   FT_Face ft_face;
-  char *stylename;
-  int size = 0;
   MSymbol family;
-  MFontFT *ft_info;
+  MFontFT *ft_info = NULL;
   MFont *font;
   MPlist *plist;
-  int i;
-  char *buf;
-  int bufsize = 0;
+  FontCatalogEntry *entry = NULL;
+  struct stat buf;
+
+  if (ft_catalog && stat (filename, &buf) == 0)
+    {
+      entry = mplist_get (ft_catalog, msymbol (filename));
+      if (entry && entry->used)
+	/* The file is already added in this scan.  */
+	entry = NULL;
+      else if (entry && (entry->mtime != buf.st_mtime
+			 || entry->size != buf.st_size))
+	{
+	  /* The file has been modified.  */
+	  if (entry->ft_info)
+	    free_ft_info (entry->ft_info);
+	  entry->ft_info = NULL;
+	  entry->mtime = buf.st_mtime;
+	  entry->size = buf.st_size;
+	  ft_catalog_modified = 1;
+	}
+      else if (entry)
+	{
+	  entry->used = 1;
+	  ft_info = entry->ft_info;
+	  if (! ft_info)
+	    return NULL;
+	}
+      else
+	{
+	  MSTRUCT_CALLOC (entry, MERROR_FONT_FT);
+	  entry->mtime = buf.st_mtime;
+	  entry->size = buf.st_size;
+	  mplist_push (ft_catalog, msymbol (filename), entry);
+	  ft_catalog_modified = 1;
+	}
+    }
 
-  if (FT_New_Face (ft_library, filename, 0, &ft_face) != 0)
-    return NULL;
-  ft_info = ft_gen_font (ft_face);
-  FT_Done_Face (ft_face);
   if (! ft_info)
-    return NULL;
+    {
+      if (FT_New_Face (ft_library, filename, 0, &ft_face) != 0)
+	{
+	  if (entry)
+	    entry->used = 1;
+	  return NULL;
+	}
+      ft_info = ft_gen_font (ft_face);
+      if (ft_info)
+	ft_set_coverage (ft_info, ft_face);
+      FT_Done_Face (ft_face);
+      if (entry)
+	{
+	  entry->used = 1;
+	  entry->ft_info = ft_info;
+	}
+      if (! ft_info)
+	return NULL;
+      ft_info->font.file = msymbol (filename);
+    }
 
   font = &ft_info->font;
-  font->file = msymbol (filename);
+  family = FONT_PROPERTY (font, MFONT_FAMILY);
 
   plist = mplist_find_by_key (ft_font_list, family);
   if (plist)
@@ -666,6 +1125,8 @@ ft_init_font_list (void)
   USE_SAFE_ALLOCA;
 
   ft_font_list = mplist ();
+  if (mfont_use_font_catalog)
+    load_ft_catalog ();
   MPLIST_DO (plist, mfont_freetype_path)
     if (MPLIST_STRING_P (plist)
 	&& (pathname = MPLIST_STRING (plist))
@@ -695,6 +1156,17 @@ ft_init_font_list (void)
 	  }
       }
   SAFE_FREE (path);
+  if (ft_catalog)
+    {
+      MPLIST_DO (plist, ft_catalog)
+	if (! ((FontCatalogEntry *) MPLIST_VAL (plist))->used)
+	  ft_catalog_modified = 1;
+      if (ft_catalog_modified)
+	save_ft_catalog ();
+      free_ft_catalog ();
+      ft_catalog = NULL;
+      ft_catalog_modified = 0;
+    }
 }
 
 /* Return 1 iff the font pointed by FT_INFO has all characters in
@@ -706,6 +1178,40 @@ ft_has_char_list_p (MFontFT *ft_info, MPlist *char_list)
   FT_Face ft_face;
   MPlist *cl;
 
+  if (ft_info->coverage)
+    {
+      MFontCoverageFT *coverage = ft_coverage (ft_info);
+
+      MPLIST_DO (cl, char_list)
+	{
+	  int c = MPLIST_INTEGER (cl);
+
+	  if (coverage)
+	    {
+	      if (! COVERAGE_HAS_CHAR_P (coverage, c))
+		break;
+	    }
+	  else
+	    {
+	      int low = 0, high = ft_info->coverage_len / 2;
+
+	      /* Find the range containing C by binary search.  */
+	      while (low < high)
+		{
+		  int mid = (low + high) / 2;
+
+		  if (ft_info->coverage[mid * 2 + 1] < c)
+		    low = mid + 1;
+		  else
+		    high = mid;
+		}
+	      if (low == ft_info->coverage_len / 2
+		  || ft_info->coverage[low * 2] > c)
+		break;
+	    }
+	}
+      return MPLIST_TAIL_P (cl);
+    }
   if (FT_New_Face (ft_library, MSYMBOL_NAME (ft_info->font.file), 0, &ft_face))
     return 0;
   MPLIST_DO (cl, char_list)
@@ -813,11 +1319,7 @@ ft_list_family (MSymbol family, int check_generic, int check_alias)
     {
       if (! all_fonts_scaned)
 	{
-	  MPLIST_DO (plist, ft_font_list)
-	    {
-	      if (! MPLIST_VAL (plist))
-		ft_list_family (MPLIST_KEY (plist), 0, 1);
-	    }
+	  fc_list_all_families ();
 	  all_fonts_scaned = 1;
 	}
       return ft_font_list;
@@ -949,6 +1451,67 @@ ft_list_family (MSymbol family, int check_generic, int check_alias)
   return plist;
 }
 
+static void
+free_ft_property_list ()
+{
+  MPlist *plist;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    if (ft_property_list[i])
+      {
+	MPLIST_DO (plist, ft_property_list[i])
+	  M17N_OBJECT_UNREF (MPLIST_VAL (plist));
+	M17N_OBJECT_UNREF (ft_property_list[i]);
+	ft_property_list[i] = NULL;
+      }
+}
+
+/* Return a plist of all fonts whose property PROP (MFONT_WEIGHT,
+   MFONT_STYLE, or MFONT_STRETCH) is VAL.  Keys are the same as
+   ft_font_list, values are (MFontFT *).  */
+
+static MPlist *
+ft_list_property (enum MFontProperty prop, MSymbol val)
+{
+  MPlist *all = ft_list_family (Mnil, 0, 1);
+  MPlist *family_list, *p, *plist;
+  int nfamilies = 0, i;
+
+  MPLIST_DO (family_list, all)
+    nfamilies++;
+  if (ft_property_list[0] && ft_property_list_families != nfamilies)
+    /* A family was added since the index was built.  */
+    free_ft_property_list ();
+  if (! ft_property_list[0])
+    {
+      for (i = 0; i < 3; i++)
+	ft_property_list[i] = mplist ();
+      MPLIST_DO (family_list, all)
+	MPLIST_DO (p, MPLIST_PLIST (family_list))
+	  {
+	    MFontFT *ft_info = MPLIST_VAL (p);
+
+	    for (i = 0; i < 3; i++)
+	      {
+		MSymbol sym = FONT_PROPERTY (&ft_info->font, MFONT_WEIGHT + i);
+
+		if (sym == Mnil)
+		  continue;
+		plist = mplist_get (ft_property_list[i], sym);
+		if (! plist)
+		  {
+		    plist = mplist ();
+		    mplist_push (ft_property_list[i], sym, plist);
+		  }
+		mplist_push (plist, MPLIST_KEY (p), ft_info);
+	      }
+	  }
+      ft_property_list_families = nfamilies;
+    }
+  return mplist_get (ft_property_list[prop - MFONT_WEIGHT], val);
+}
+
 static MPlist *
 ft_list_language (MSymbol language)
 {
@@ -1079,6 +1642,211 @@ ft_check_cap_otf (MFontFT *ft_info, MFontCapability *cap, FT_Face ft_face)
 #endif	/* not HAVE_OTF */
 }
 
+#ifdef HAVE_FONTCONFIG
+/* Return the charset of the font FT_INFO.  */
+
+static FcCharSet *
+fc_get_charset (MFontFT *ft_info)
+{
+  if (! ft_info->charset)
+    {
+      FcPattern *pat = FcPatternBuild (NULL, FC_FILE, FcTypeString,
+				       MSYMBOL_NAME (ft_info->font.file),
+				       NULL);
+      FcObjectSet *os = FcObjectSetBuild (FC_CHARSET, NULL);
+      FcFontSet *fs = FcFontList (fc_config, pat, os);
+
+      if (fs->nfont > 0
+	  && FcPatternGetCharSet (fs->fonts[0], FC_CHARSET, 0,
+				  &ft_info->charset) == FcResultMatch)
+	ft_info->charset = FcCharSetCopy (ft_info->charset);
+      else
+	ft_info->charset = FcCharSetCreate ();
+      FcFontSetDestroy (fs);
+      FcObjectSetDestroy (os);
+      FcPatternDestroy (pat);
+    }
+  return ft_info->charset;
+}
+#endif	/* HAVE_FONTCONFIG */
+
+/* Mark the characters FROM to TO in COVERAGE.  Return 0 on success,
+   and -1 on memory shortage.  */
+
+static int
+coverage_add_range (MFontCoverageFT *coverage, int from, int to)
+{
+  for (; from <= to; from++)
+    {
+      int block = from >> 8;
+
+      if (block >= coverage->nblocks)
+	{
+	  int nblocks = block + 1;
+	  unsigned short *index = realloc (coverage->index,
+					   sizeof (unsigned short) * nblocks);
+
+	  if (! index)
+	    return -1;
+	  memset (index + coverage->nblocks, 0,
+		  sizeof (unsigned short) * (nblocks - coverage->nblocks));
+	  coverage->index = index;
+	  coverage->nblocks = nblocks;
+	}
+      if (! coverage->index[block])
+	{
+	  unsigned char (*pages)[32]
+	    = realloc (coverage->pages, 32 * (coverage->npages + 1));
+
+	  if (! pages)
+	    return -1;
+	  memset (pages[coverage->npages], 0, 32);
+	  coverage->pages = pages;
+	  coverage->index[block] = ++coverage->npages;
+	}
+      if ((from & 0xFF) == 0 && to - from >= 0xFF)
+	{
+	  /* Mark the whole block at once.  */
+	  memset (coverage->pages[coverage->index[block] - 1], 0xFF, 32);
+	  from += 0xFF;
+	}
+      else
+	coverage->pages[coverage->index[block] - 1][(from & 0xFF) >> 3]
+	  |= 1 << (from & 7);
+    }
+  return 0;
+}
+
+/* Return the coverage bitmap of the font FT_INFO, or NULL if it is
+   not available.  */
+
+static MFontCoverageFT *
+ft_coverage (MFontFT *ft_info)
+{
+  MFontCoverageFT *coverage;
+  int i;
+
+  if (ft_info->coverage_bitmap)
+    return ft_info->coverage_bitmap;
+#ifndef HAVE_FONTCONFIG
+  if (! ft_info->coverage)
+    return NULL;
+#endif	/* not HAVE_FONTCONFIG */
+  coverage = calloc (1, sizeof (MFontCoverageFT));
+  if (! coverage)
+    return NULL;
+#ifdef HAVE_FONTCONFIG
+  {
+    FcCharSet *cs = fc_get_charset (ft_info);
+    FcChar32 map[FC_CHARSET_MAP_SIZE], next, base;
+
+    for (base = FcCharSetFirstPage (cs, map, &next);
+	 base != FC_CHARSET_DONE;
+	 base = FcCharSetNextPage (cs, map, &next))
+      for (i = 0; i < FC_CHARSET_MAP_SIZE * 32; i++)
+	if (map[i / 32] & (1U << (i % 32)))
+	  {
+	    int from = base + i;
+
+	    /* Mark a run of characters at once.  */
+	    while (i + 1 < FC_CHARSET_MAP_SIZE * 32
+		   && (map[(i + 1) / 32] & (1U << ((i + 1) % 32))))
+	      i++;
+	    if (coverage_add_range (coverage, from, base + i) < 0)
+	      goto err;
+	  }
+  }
+#else  /* not HAVE_FONTCONFIG */
+  for (i = 0; i < ft_info->coverage_len; i += 2)
+    if (coverage_add_range (coverage, ft_info->coverage[i],
+			    ft_info->coverage[i + 1]) < 0)
+      goto err;
+#endif	/* not HAVE_FONTCONFIG */
+  ft_info->coverage_bitmap = coverage;
+  return coverage;
+
+ err:
+  free (coverage->index);
+  free (coverage->pages);
+  free (coverage);
+  return NULL;
+}
+
+#ifdef HAVE_PTHREAD
+
+typedef struct
+{
+  MFontFT **fonts;
+  int nfonts;
+  /* This job handles FONTS[OFFSET], FONTS[OFFSET + STEP], ...  */
+  int offset, step;
+} FTCoverageJob;
+
+static void *
+ft_coverage_job (void *arg)
+{
+  FTCoverageJob *job = arg;
+  int i;
+
+  for (i = job->offset; i < job->nfonts; i += job->step)
+    ft_coverage (job->fonts[i]);
+  return NULL;
+}
+
+#endif	/* HAVE_PTHREAD */
+
+/* Build the coverage bitmaps of NFONTS fonts at FONTS in at most
+   NTHREADS threads.  Each of FONTS must be a FreeType font object.
+   Building a bitmap touches only the font itself and fontconfig, so
+   the fonts can be handled concurrently.  */
+
+void
+mfont__ft_prepare_coverage (MFont **fonts, int nfonts, int nthreads)
+{
+#ifdef HAVE_PTHREAD
+  MFontFT **ft_fonts = alloca (sizeof (MFontFT *) * nfonts);
+  int n, i;
+
+  for (i = n = 0; i < nfonts; i++)
+    if (! ((MFontFT *) fonts[i])->coverage_bitmap)
+      {
+	int j;
+
+	/* A font may appear more than once in a font list.  */
+	for (j = 0; j < n && ft_fonts[j] != (MFontFT *) fonts[i]; j++);
+	if (j == n)
+	  ft_fonts[n++] = (MFontFT *) fonts[i];
+      }
+  if (nthreads > n)
+    nthreads = n;
+  if (nthreads > 1)
+    {
+      pthread_t *threads = alloca (sizeof (pthread_t) * nthreads);
+      FTCoverageJob *jobs = alloca (sizeof (FTCoverageJob) * nthreads);
+
+      MDEBUG_PRINT2 (" [FONT-FT] probing %d fonts in %d threads\n",
+		     n, nthreads);
+      for (i = 0; i < nthreads; i++)
+	{
+	  jobs[i].fonts = ft_fonts;
+	  jobs[i].nfonts = n;
+	  jobs[i].offset = i;
+	  jobs[i].step = nthreads;
+	}
+      for (n = 1; n < nthreads; n++)
+	if (pthread_create (threads + n, NULL, ft_coverage_job, jobs + n)
+	    != 0)
+	  break;
+      /* This thread handles the first share, and also the shares of
+	 threads that could not be created.  */
+      for (i = 0; i < nthreads; i = (i == 0 ? n : i + 1))
+	ft_coverage_job (jobs + i);
+      for (i = 1; i < n; i++)
+	pthread_join (threads[i], NULL);
+    }
+#endif	/* HAVE_PTHREAD */
+}
+
 static int
 ft_check_language (MFontFT *ft_info, MSymbol language, FT_Face ft_face)
 {
@@ -1137,19 +1905,25 @@ static int
 ft_check_script (MFontFT *ft_info, MSymbol script, FT_Face ft_face)
 {
   MPlist *char_list = mscript__char_list (script);
+  MFontCoverageFT *coverage;
 
   if (! char_list)
     return -1;
+  if (
 #ifdef HAVE_FONTCONFIG
-  if (ft_info->charset)
+      ft_info->charset &&
+#endif	/* HAVE_FONTCONFIG */
+      (coverage = ft_coverage (ft_info)))
     {
       MPLIST_DO (char_list, char_list)
-	if (FcCharSetHasChar (ft_info->charset,
-			      (FcChar32) MPLIST_INTEGER (char_list)) == FcFalse)
-	  break;
+	{
+	  int c = MPLIST_INTEGER (char_list);
+
+	  if (! COVERAGE_HAS_CHAR_P (coverage, c))
+	    break;
+	}
     }
   else
-#endif	/* HAVE_FONTCONFIG */
     {
       int ft_face_allocaed = 0;
 
@@ -1578,11 +2352,65 @@ ft_open (MFrame *frame, MFont *font, MFont *spec, MRealizedFont *rfont)
 
 /* The FreeType font driver function FIND_METRIC.  */
 
+/* Return the slot for the metrics of glyph CODE in the cache of
+   FT_RFONT.  The slot is not yet measured if the glyph has never been
+   measured.  Return NULL on memory shortage.  */
+
+static MGlyphMetricFT *
+ft_metric_slot (MRealizedFontFT *ft_rfont, unsigned code)
+{
+  MGlyphMetricFT *slot;
+  int i;
+
+  if (code < METRIC_DENSE_SIZE)
+    {
+      if (! ft_rfont->metric_dense)
+	{
+	  ft_rfont->metric_dense = calloc (METRIC_DENSE_SIZE,
+					   sizeof (MGlyphMetricFT));
+	  if (! ft_rfont->metric_dense)
+	    return NULL;
+	}
+      return ft_rfont->metric_dense + code;
+    }
+
+  if ((ft_rfont->metric_hash_used + 1) * 2 > ft_rfont->metric_hash_size)
+    {
+      /* Double the hash table and rehash the measured slots.  */
+      int size = ft_rfont->metric_hash_size ? ft_rfont->metric_hash_size * 2
+		  : 256;
+      MGlyphMetricFT *table = calloc (size, sizeof (MGlyphMetricFT));
+
+      if (! table)
+	return NULL;
+      for (i = 0; i < ft_rfont->metric_hash_size; i++)
+	if (ft_rfont->metric_hash[i].measured)
+	  {
+	    int j = ft_rfont->metric_hash[i].code & (size - 1);
+
+	    while (table[j].measured)
+	      j = (j + 1) & (size - 1);
+	    table[j] = ft_rfont->metric_hash[i];
+	  }
+      free (ft_rfont->metric_hash);
+      ft_rfont->metric_hash = table;
+      ft_rfont->metric_hash_size = size;
+    }
+  for (i = code & (ft_rfont->metric_hash_size - 1);
+       (slot = ft_rfont->metric_hash + i)->measured;
+       i = (i + 1) & (ft_rfont->metric_hash_size - 1))
+    if (slot->code == code)
+      return slot;
+  slot->code = code;
+  return slot;
+}
+
 static void
 ft_find_metric (MRealizedFont *rfont, MGlyphString *gstring,
 		int from, int to)
 {
   FT_Face ft_face = rfont->fontp;
+  MRealizedFontFT *ft_rfont = rfont->info;
   MGlyph *g = MGLYPH (from), *gend = MGLYPH (to);
 
   for (; g != gend; g++)
@@ -1630,15 +2458,39 @@ ft_find_metric (MRealizedFont *rfont, MGlyphString *gstring,
 	}
       else
 	{
-	  FT_Glyph_Metrics *metrics;
+	  MGlyphMetricFT *slot = ft_metric_slot (ft_rfont, g->g.code);
 
-	  FT_Load_Glyph (ft_face, (FT_UInt) g->g.code, FT_LOAD_DEFAULT);
-	  metrics = &ft_face->glyph->metrics;
-	  g->g.lbearing = metrics->horiBearingX;
-	  g->g.rbearing = metrics->horiBearingX + metrics->width;
-	  g->g.xadv = metrics->horiAdvance;
-	  g->g.ascent = metrics->horiBearingY;
-	  g->g.descent = metrics->height - metrics->horiBearingY;
+	  if (! slot || ! slot->measured)
+	    {
+	      FT_Glyph_Metrics *metrics;
+
+	      FT_Load_Glyph (ft_face, (FT_UInt) g->g.code, FT_LOAD_DEFAULT);
+	      metrics = &ft_face->glyph->metrics;
+	      g->g.lbearing = metrics->horiBearingX;
+	      g->g.rbearing = metrics->horiBearingX + metrics->width;
+	      g->g.xadv = metrics->horiAdvance;
+	      g->g.ascent = metrics->horiBearingY;
+	      g->g.descent = metrics->height - metrics->horiBearingY;
+	      if (slot)
+		{
+		  slot->lbearing = g->g.lbearing;
+		  slot->rbearing = g->g.rbearing;
+		  slot->xadv = g->g.xadv;
+		  slot->ascent = g->g.ascent;
+		  slot->descent = g->g.descent;
+		  slot->measured = 1;
+		  if (g->g.code >= METRIC_DENSE_SIZE)
+		    ft_rfont->metric_hash_used++;
+		}
+	    }
+	  else
+	    {
+	      g->g.lbearing = slot->lbearing;
+	      g->g.rbearing = slot->rbearing;
+	      g->g.xadv = slot->xadv;
+	      g->g.ascent = slot->ascent;
+	      g->g.descent = slot->descent;
+	    }
 	}
       g->g.yadv = 0;
       g->g.ascent += rfont->baseline_offset;
@@ -1658,6 +2510,12 @@ ft_has_char (MFrame *frame, MFont *font, MFont *spec, int c, unsigned code)
     rfont = (MRealizedFont *) font;
   else if (font->type == MFONT_TYPE_OBJECT)
     {
+      MFontCoverageFT *coverage = ft_coverage ((MFontFT *) font);
+
+      /* For a Unicode font, the bitmap answers without looking up or
+	 opening the face.  */
+      if (coverage && code == c)
+	return COVERAGE_HAS_CHAR_P (coverage, c);
       for (rfont = MPLIST_VAL (frame->realized_font_list); rfont;
 	   rfont = rfont->next)
 	if (rfont->font == font && rfont->driver == &mfont__ft_driver)
@@ -1665,27 +2523,8 @@ ft_has_char (MFrame *frame, MFont *font, MFont *spec, int c, unsigned code)
       if (! rfont)
 	{
 #ifdef HAVE_FONTCONFIG
-	  MFontFT *ft_info = (MFontFT *) font;
-
-	  if (! ft_info->charset)
-	    {
-	      FcPattern *pat = FcPatternBuild (NULL, FC_FILE, FcTypeString,
-					       MSYMBOL_NAME (font->file),
-					       NULL);
-	      FcObjectSet *os = FcObjectSetBuild (FC_CHARSET, NULL);
-	      FcFontSet *fs = FcFontList (fc_config, pat, os);
-
-	      if (fs->nfont > 0
-		  && FcPatternGetCharSet (fs->fonts[0], FC_CHARSET, 0,
-					  &ft_info->charset) == FcResultMatch)
-		ft_info->charset = FcCharSetCopy (ft_info->charset);
-	      else
-		ft_info->charset = FcCharSetCreate ();
-	      FcFontSetDestroy (fs);
-	      FcObjectSetDestroy (os);
-	      FcPatternDestroy (pat);
-	    }
-	  return (FcCharSetHasChar (ft_info->charset, (FcChar32) c) == FcTrue);
+	  return (FcCharSetHasChar (fc_get_charset ((MFontFT *) font),
+				    (FcChar32) c) == FcTrue);
 #else  /* not HAVE_FONTCONFIG */
 	  rfont = ft_open (frame, font, spec, NULL);
 #endif	/* not HAVE_FONTCONFIG */
@@ -1733,6 +2572,75 @@ ft_encode_char (MFrame *frame, MFont *font, MFont *spec, unsigned code)
   return (idx ? (unsigned) idx : MCHAR_INVALID_CODE);
 }
 
+/* Cache of rendered glyph bitmaps.
+
+   A bitmap is identified by a FreeType face, its pixel size, a glyph
+   ID, and whether it is anti-aliased or not.  Entries are chained in
+   buckets of bitmap_cache_table, and also in the LRU list from
+   bitmap_cache_head (the most recently used) to bitmap_cache_tail.
+   When the total size of the entries exceeds mfont_bitmap_cache_size,
+   the least recently used ones are discarded.  */
+
+typedef struct BitmapCacheEntry BitmapCacheEntry;
+
+struct BitmapCacheEntry
+{
+  FT_Face ft_face;
+  int x_ppem, y_ppem;
+  unsigned code;
+  int anti_alias;
+  unsigned hash;
+  BitmapCacheEntry *next_in_bucket;
+  BitmapCacheEntry *prev, *next;
+  int size;
+  MGlyphBitmap bitmap;
+};
+
+#define BITMAP_CACHE_TABLE_SIZE 1024
+
+static BitmapCacheEntry **bitmap_cache_table;
+static BitmapCacheEntry *bitmap_cache_head, *bitmap_cache_tail;
+static int bitmap_cache_used;
+static int bitmap_cache_hits, bitmap_cache_misses;
+
+static void
+unlink_bitmap_cache (BitmapCacheEntry *entry)
+{
+  BitmapCacheEntry **p;
+
+  for (p = bitmap_cache_table + entry->hash % BITMAP_CACHE_TABLE_SIZE;
+       *p != entry; p = &(*p)->next_in_bucket);
+  *p = entry->next_in_bucket;
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    bitmap_cache_head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    bitmap_cache_tail = entry->prev;
+  bitmap_cache_used -= entry->size;
+}
+
+/* Discard the cached bitmaps of FT_FACE, or all of them if FT_FACE is
+   NULL.  */
+
+static void
+flush_bitmap_cache (FT_Face ft_face)
+{
+  BitmapCacheEntry *entry, *next;
+
+  for (entry = bitmap_cache_head; entry; entry = next)
+    {
+      next = entry->next;
+      if (! ft_face || entry->ft_face == ft_face)
+	{
+	  unlink_bitmap_cache (entry);
+	  free (entry);
+	}
+    }
+}
+
 /* The FreeType font driver function RENDER.  */
 
 #define NUM_POINTS 0x1000
@@ -1747,10 +2655,8 @@ ft_render (MDrawWindow win, int x, int y,
 	   MGlyphString *gstring, MGlyph *from, MGlyph *to,
 	   int reverse, MDrawRegion region)
 {
-  FT_Face ft_face;
   MRealizedFace *rface = from->rface;
   MFrame *frame = rface->frame;
-  FT_Int32 load_flags = FT_LOAD_RENDER;
   MGlyph *g;
   int i, j;
   MPointTable point_table[8];
@@ -1762,42 +2668,35 @@ ft_render (MDrawWindow win, int x, int y,
 
   /* It is assured that the all glyphs in the current range use the
      same realized face.  */
-  ft_face = rface->rfont->fontp;
   baseline_offset = rface->rfont->baseline_offset >> 6;
 
-  if (! gstring->anti_alias)
-    {
-#ifdef FT_LOAD_TARGET_MONO
-      load_flags |= FT_LOAD_TARGET_MONO;
-#else
-      load_flags |= FT_LOAD_MONOCHROME;
-#endif
-    }
-
   for (i = 0; i < 8; i++)
     point_table[i].p = point_table[i].points;
 
   for (g = from; g < to; x += g++->g.xadv)
     {
+      MGlyphBitmap *bitmap;
       unsigned char *bmp;
       int intensity;
       MPointTable *ptable;
       int xoff, yoff;
       int width, pitch;
 
-      FT_Load_Glyph (ft_face, (FT_UInt) g->g.code, load_flags);
+      bitmap = mfont__ft_glyph_bitmap (rface->rfont, g->g.code,
+				       gstring->anti_alias);
+      if (! bitmap)
+	continue;
       if (pixel_mode < 0)
-	pixel_mode = ft_face->glyph->bitmap.pixel_mode;
-      yoff = y - ft_face->glyph->bitmap_top + g->g.yoff;
-      bmp = ft_face->glyph->bitmap.buffer;
-      width = ft_face->glyph->bitmap.width;
-      pitch = ft_face->glyph->bitmap.pitch;
+	pixel_mode = bitmap->pixel_mode;
+      yoff = y - bitmap->top + g->g.yoff;
+      bmp = bitmap->buffer;
+      width = bitmap->width;
+      pitch = bitmap->pitch;
 
       if (pixel_mode != FT_PIXEL_MODE_MONO)
-	for (i = 0; i < ft_face->glyph->bitmap.rows;
-	     i++, bmp += ft_face->glyph->bitmap.pitch, yoff++)
+	for (i = 0; i < bitmap->rows; i++, bmp += pitch, yoff++)
 	  {
-	    xoff = x + ft_face->glyph->bitmap_left + g->g.xoff;
+	    xoff = x + bitmap->left + g->g.xoff;
 	    for (j = 0; j < width; j++, xoff++)
 	      {
 		intensity = bmp[j] >> 5;
@@ -1819,10 +2718,9 @@ ft_render (MDrawWindow win, int x, int y,
 	      }
 	  }
       else
-	for (i = 0; i < ft_face->glyph->bitmap.rows;
-	     i++, bmp += ft_face->glyph->bitmap.pitch, yoff++)
+	for (i = 0; i < bitmap->rows; i++, bmp += pitch, yoff++)
 	  {
-	    xoff = x + ft_face->glyph->bitmap_left + g->g.xoff;
+	    xoff = x + bitmap->left + g->g.xoff;
 	    for (j = 0; j < width; j++, xoff++)
 	      {
 		intensity = bmp[j / 8] & (1 << (7 - (j % 8)));
@@ -1905,13 +2803,41 @@ ft_list (MFrame *frame, MPlist *plist, MFont *font, int maxnum)
 
   if (! file_list && ! family_list && ! capability_list)
     {
-      /* No restriction.  Get all fonts.  */
+      MPlist *prop_list = NULL;
+
+      if (font)
+	{
+	  int len = 0, i;
+
+	  /* Get the smallest set of fonts matching with one of weight,
+	     style, and stretch.  */
+	  for (i = MFONT_WEIGHT; i <= MFONT_STRETCH; i++)
+	    if (font->property[i])
+	      {
+		MPlist *plist = ft_list_property (i, FONT_PROPERTY (font, i));
+		int n = plist ? mplist_length (plist) : 0;
+
+		if (! prop_list || n < len)
+		  prop_list = plist, len = n;
+		if (! plist)
+		  goto done;
+	      }
+	}
       pl = mplist ();
-      MPLIST_DO (family_list, ft_list_family (Mnil, 0, 1))
+      if (prop_list)
 	{
-	  MPLIST_DO (p, MPLIST_PLIST (family_list))
-	    mplist_push (pl, MPLIST_KEY (p), MPLIST_VAL (p));
+	  /* PROP_LIST is already in the reverse order.  */
+	  p = pl;
+	  MPLIST_DO (prop_list, prop_list)
+	    p = mplist_add (p, MPLIST_KEY (prop_list), MPLIST_VAL (prop_list));
 	}
+      else
+	/* No restriction.  Get all fonts.  */
+	MPLIST_DO (family_list, ft_list_family (Mnil, 0, 1))
+	  {
+	    MPLIST_DO (p, MPLIST_PLIST (family_list))
+	      mplist_push (pl, MPLIST_KEY (p), MPLIST_VAL (p));
+	  }
     }
   else
     {
@@ -2265,6 +3191,155 @@ adjust_anchor (OTF_Anchor *anchor, FT_Face ft_face,
 	*y += DEVICE_DELTA (anchor->f.f2.YDeviceTable, y_ppem);
     }
 }
+
+/* Cache of the results of driving OTF.
+
+   Each font has a direct-mapped table of OTF_CACHE_SIZE entries.  An
+   entry records, for an OTF spec and a sequence of characters and
+   glyph IDs, the glyphs after GDEF and GSUB and those after GPOS.
+   They don't depend on the font size because ft_drive_otf scales the
+   values of GPOS by itself.  A new entry replaces the old one of the
+   same slot, which keeps the size of the cache bounded.  */
+
+#define OTF_CACHE_SIZE 256
+
+struct OTFCacheEntry
+{
+  MSymbol spec;
+  unsigned hash;
+  /* Number of the input glyphs.  */
+  int len;
+  /* Character code and glyph ID of each input glyph.  */
+  int *codes;
+  /* Results of OTF_drive_gsub_with_log and OTF_drive_gpos_with_log,
+     or 0 if they are not called.  */
+  int gsub_result, gpos_result;
+  /* Glyphs after GSUB, and those after GPOS.  */
+  int gsub_used, gpos_used;
+  OTF_Glyph *gsub_glyphs, *gpos_glyphs;
+};
+
+static void
+free_otf_cache (MFontFT *ft_info)
+{
+  int i;
+
+  MDEBUG_PRINT3 (" [FONT-FT] OTF cache of %s: %d hits, %d misses\n",
+		 MSYMBOL_NAME (ft_info->font.file),
+		 ft_info->otf_cache_hits, ft_info->otf_cache_misses);
+  for (i = 0; i < OTF_CACHE_SIZE; i++)
+    free (ft_info->otf_cache[i]);
+  free (ft_info->otf_cache);
+  ft_info->otf_cache = NULL;
+}
+
+/* Drive OTF for the glyphs in OTF_GSTRING by GSUB_FEATURES and
+   GPOS_FEATURES of SPEC, or find the cached result.  Return the
+   cache entry holding the result, or NULL on memory shortage.  The
+   returned entry is valid until the next call for the same font.  */
+
+static OTFCacheEntry *
+drive_otf_cached (MFontFT *ft_info, OTF *otf, MFLTOtfSpec *spec,
+		  OTF_GlyphString *otf_gstring, char *script, char *langsys,
+		  char *gsub_features, char *gpos_features)
+{
+  OTFCacheEntry *entry;
+  int len = otf_gstring->used;
+  unsigned hash = (unsigned) (unsigned long) spec->sym;
+  int gsub_result = 0, gpos_result = 0;
+  int gsub_used = 0;
+  OTF_Glyph *gsub_glyphs = NULL;
+  int *codes = alloca (sizeof (int) * len * 2);
+  int i;
+
+  for (i = 0; i < len; i++)
+    {
+      codes[i * 2] = otf_gstring->glyphs[i].c;
+      codes[i * 2 + 1] = otf_gstring->glyphs[i].glyph_id;
+      hash = ((hash ^ codes[i * 2]) * 16777619 ^ codes[i * 2 + 1]) * 16777619;
+    }
+  if (! ft_info->otf_cache)
+    MTABLE_CALLOC (ft_info->otf_cache, OTF_CACHE_SIZE, MERROR_FONT_FT);
+  entry = ft_info->otf_cache[hash % OTF_CACHE_SIZE];
+  if (entry && entry->hash == hash && entry->spec == spec->sym
+      && entry->len == len)
+    {
+      if (memcmp (entry->codes, codes, sizeof (int) * len * 2) == 0)
+	{
+	  ft_info->otf_cache_hits++;
+	  return entry;
+	}
+    }
+  ft_info->otf_cache_misses++;
+
+  OTF_drive_gdef (otf, otf_gstring);
+  if (gsub_features)
+    {
+      gsub_result = OTF_drive_gsub_with_log (otf, otf_gstring, script,
+					     langsys, gsub_features);
+      if (gsub_result < 0)
+	gsub_result = -1;
+      else
+	{
+	  gsub_used = otf_gstring->used;
+	  gsub_glyphs = alloca (sizeof (OTF_Glyph) * gsub_used);
+	  memcpy (gsub_glyphs, otf_gstring->glyphs,
+		  sizeof (OTF_Glyph) * gsub_used);
+	}
+    }
+  if (gsub_result >= 0 && gpos_features)
+    {
+      gpos_result = OTF_drive_gpos_with_log (otf, otf_gstring, script,
+					     langsys, gpos_features);
+      if (gpos_result < 0)
+	gpos_result = -1;
+    }
+
+  free (ft_info->otf_cache[hash % OTF_CACHE_SIZE]);
+  entry = malloc (sizeof (OTFCacheEntry)
+		  + sizeof (OTF_Glyph) * (gsub_used + otf_gstring->used)
+		  + sizeof (int) * len * 2);
+  ft_info->otf_cache[hash % OTF_CACHE_SIZE] = entry;
+  if (! entry)
+    MERROR (MERROR_FONT_FT, NULL);
+  entry->spec = spec->sym;
+  entry->hash = hash;
+  entry->len = len;
+  entry->gsub_result = gsub_result;
+  entry->gpos_result = gpos_result;
+  entry->gsub_used = gsub_used;
+  entry->gpos_used = otf_gstring->used;
+  entry->gsub_glyphs = (OTF_Glyph *) (entry + 1);
+  entry->gpos_glyphs = entry->gsub_glyphs + gsub_used;
+  entry->codes = (int *) (entry->gpos_glyphs + entry->gpos_used);
+  if (gsub_used)
+    memcpy (entry->gsub_glyphs, gsub_glyphs, sizeof (OTF_Glyph) * gsub_used);
+  memcpy (entry->gpos_glyphs, otf_gstring->glyphs,
+	  sizeof (OTF_Glyph) * entry->gpos_used);
+  memcpy (entry->codes, codes, sizeof (int) * len * 2);
+  return entry;
+}
+
+/* Set the glyphs of OTF_GSTRING to USED glyphs in GLYPHS.  Return 0
+   on success, and -1 on memory shortage.  */
+
+static int
+load_otf_glyphs (OTF_GlyphString *otf_gstring, OTF_Glyph *glyphs, int used)
+{
+  if (otf_gstring->size < used)
+    {
+      OTF_Glyph *new = realloc (otf_gstring->glyphs,
+				sizeof (OTF_Glyph) * used);
+
+      if (! new)
+	return -1;
+      otf_gstring->glyphs = new;
+      otf_gstring->size = used;
+    }
+  memcpy (otf_gstring->glyphs, glyphs, sizeof (OTF_Glyph) * used);
+  otf_gstring->used = used;
+  return 0;
+}
 #endif	/* HAVE_OTF */
 
 static int 
@@ -2284,6 +3359,8 @@ ft_drive_otf (MFLTFont *font, MFLTOtfSpec *spec,
   char script[5], *langsys = NULL;
   char *gsub_features = NULL, *gpos_features = NULL;
   unsigned int tag;
+  MFontFT *ft_info;
+  OTFCacheEntry *entry;
 
   if (len == 0)
     return from;
@@ -2331,7 +3408,11 @@ ft_drive_otf (MFLTFont *font, MFLTOtfSpec *spec,
       otf_gstring.glyphs[i].glyph_id = ((MGlyph *)in->glyphs)[from + i].g.code;
     }
 
-  OTF_drive_gdef (otf, &otf_gstring);
+  ft_info = (MFontFT *) ((MFLTFontForRealized *) font)->rfont->font;
+  entry = drive_otf_cached (ft_info, otf, spec, &otf_gstring, script, langsys,
+			    gsub_features, gpos_features);
+  if (! entry)
+    goto simple_copy;
   gidx = out ? out->used : from;
 
   if (gsub_features)
@@ -2339,8 +3420,9 @@ ft_drive_otf (MFLTFont *font, MFLTOtfSpec *spec,
       OTF_Feature *features;
       MGlyph *g;
 
-      if (OTF_drive_gsub_with_log (otf, &otf_gstring, script, langsys,
-				   gsub_features) < 0)
+      if (entry->gsub_result < 0
+	  || load_otf_glyphs (&otf_gstring, entry->gsub_glyphs,
+			      entry->gsub_used) < 0)
 	goto simple_copy;
       features = otf->gsub->FeatureList.Feature;
       if (out)
@@ -2417,9 +3499,13 @@ ft_drive_otf (MFLTFont *font, MFLTOtfSpec *spec,
       OTF_Feature *features;
       MGlyph *g;
 
-      if (OTF_drive_gpos_with_log (otf, &otf_gstring, script, langsys,
-				   gpos_features) < 0)
-	return to;
+      if (entry->gpos_result < 0
+	  || load_otf_glyphs (&otf_gstring, entry->gpos_glyphs,
+			      entry->gpos_used) < 0)
+	{
+	  free (otf_gstring.glyphs);
+	  return to;
+	}
       features = otf->gpos->FeatureList.Feature;
       if (out)
 	{
@@ -2690,6 +3776,142 @@ MFontDriver mfont__ft_driver =
 #endif	/* HAVE_OTF */
   };
 
+/* Return the bitmap of glyph CODE of RFONT rendered with
+   anti-aliasing if ANTI_ALIAS is nonzero.  The bitmap is valid until
+   the next call of this function.  Return NULL if the glyph can't be
+   rendered.  */
+
+MGlyphBitmap *
+mfont__ft_glyph_bitmap (MRealizedFont *rfont, unsigned code, int anti_alias)
+{
+  static MGlyphBitmap uncached;
+  FT_Face ft_face = ((MRealizedFontFT *) rfont->info)->ft_face;
+  int x_ppem = ft_face->size->metrics.x_ppem;
+  int y_ppem = ft_face->size->metrics.y_ppem;
+  FT_Int32 load_flags = FT_LOAD_RENDER;
+  FT_Bitmap *ft_bitmap;
+  BitmapCacheEntry *entry;
+  unsigned hash;
+  int pitch, size;
+
+  anti_alias = anti_alias != 0;
+  hash = (((((unsigned) (unsigned long) ft_face >> 4) * 31 + x_ppem) * 31
+	   + y_ppem) * 31 + code) * 2 + anti_alias;
+  if (bitmap_cache_table)
+    for (entry = bitmap_cache_table[hash % BITMAP_CACHE_TABLE_SIZE]; entry;
+	 entry = entry->next_in_bucket)
+      if (entry->hash == hash && entry->ft_face == ft_face
+	  && entry->code == code && entry->anti_alias == anti_alias
+	  && entry->x_ppem == x_ppem && entry->y_ppem == y_ppem)
+	{
+	  bitmap_cache_hits++;
+	  if (entry->prev)
+	    {
+	      /* Move ENTRY to the head of the LRU list.  */
+	      entry->prev->next = entry->next;
+	      if (entry->next)
+		entry->next->prev = entry->prev;
+	      else
+		bitmap_cache_tail = entry->prev;
+	      entry->prev = NULL;
+	      entry->next = bitmap_cache_head;
+	      bitmap_cache_head->prev = entry;
+	      bitmap_cache_head = entry;
+	    }
+	  return &entry->bitmap;
+	}
+  bitmap_cache_misses++;
+
+  if (! anti_alias)
+    {
+#ifdef FT_LOAD_TARGET_MONO
+      load_flags |= FT_LOAD_TARGET_MONO;
+#else
+      load_flags |= FT_LOAD_MONOCHROME;
+#endif
+    }
+  if (FT_Load_Glyph (ft_face, (FT_UInt) code, load_flags))
+    return NULL;
+  ft_bitmap = &ft_face->glyph->bitmap;
+  pitch = ft_bitmap->pitch < 0 ? - ft_bitmap->pitch : ft_bitmap->pitch;
+  size = sizeof (BitmapCacheEntry) + pitch * ft_bitmap->rows;
+
+  if (size > mfont_bitmap_cache_size
+      || (! bitmap_cache_table
+	  && ! MTABLE_CALLOC_SAFE (bitmap_cache_table,
+				   BITMAP_CACHE_TABLE_SIZE))
+      || ! (entry = malloc (size)))
+    {
+      uncached.left = ft_face->glyph->bitmap_left;
+      uncached.top = ft_face->glyph->bitmap_top;
+      uncached.width = ft_bitmap->width;
+      uncached.rows = ft_bitmap->rows;
+      uncached.pitch = ft_bitmap->pitch;
+      uncached.pixel_mode = ft_bitmap->pixel_mode;
+      uncached.buffer = ft_bitmap->buffer;
+      return &uncached;
+    }
+  while (bitmap_cache_tail
+	 && bitmap_cache_used + size > mfont_bitmap_cache_size)
+    {
+      BitmapCacheEntry *tail = bitmap_cache_tail;
+
+      unlink_bitmap_cache (tail);
+      free (tail);
+    }
+
+  entry->ft_face = ft_face;
+  entry->x_ppem = x_ppem;
+  entry->y_ppem = y_ppem;
+  entry->code = code;
+  entry->anti_alias = anti_alias;
+  entry->hash = hash;
+  entry->size = size;
+  entry->bitmap.left = ft_face->glyph->bitmap_left;
+  entry->bitmap.top = ft_face->glyph->bitmap_top;
+  entry->bitmap.width = ft_bitmap->width;
+  entry->bitmap.rows = ft_bitmap->rows;
+  entry->bitmap.pitch = pitch;
+  entry->bitmap.pixel_mode = ft_bitmap->pixel_mode;
+  entry->bitmap.buffer = (unsigned char *) (entry + 1);
+  if (ft_bitmap->pitch >= 0)
+    memcpy (entry->bitmap.buffer, ft_bitmap->buffer, pitch * ft_bitmap->rows);
+  else
+    {
+      /* Store the rows from top to bottom.  */
+      int i;
+
+      for (i = 0; i < ft_bitmap->rows; i++)
+	memcpy (entry->bitmap.buffer + pitch * i,
+		ft_bitmap->buffer + ft_bitmap->pitch * i, pitch);
+    }
+  entry->next_in_bucket = bitmap_cache_table[hash % BITMAP_CACHE_TABLE_SIZE];
+  bitmap_cache_table[hash % BITMAP_CACHE_TABLE_SIZE] = entry;
+  entry->prev = NULL;
+  entry->next = bitmap_cache_head;
+  if (bitmap_cache_head)
+    bitmap_cache_head->prev = entry;
+  else
+    bitmap_cache_tail = entry;
+  bitmap_cache_head = entry;
+  bitmap_cache_used += size;
+  return &entry->bitmap;
+}
+
+/* Store the statistics of the bitmap cache in *HITS and *MISSES
+   unless they are NULL, and return the number of bytes used by the
+   cache.  */
+
+int
+mfont__ft_bitmap_cache_statistics (int *hits, int *misses)
+{
+  if (hits)
+    *hits = bitmap_cache_hits;
+  if (misses)
+    *misses = bitmap_cache_misses;
+  return bitmap_cache_used;
+}
+
 int
 mfont__ft_init ()
 {
@@ -2790,6 +4012,7 @@ mfont__ft_fini ()
 	}
       M17N_OBJECT_UNREF (ft_font_list);
       ft_font_list = NULL;
+      free_ft_property_list ();
 
       if (ft_language_list)
 	{
@@ -2823,6 +4046,10 @@ mfont__ft_fini ()
 	  ft_file_list = NULL;
 	}
     }
+  flush_bitmap_cache (NULL);
+  free (bitmap_cache_table);
+  bitmap_cache_table = NULL;
+  bitmap_cache_hits = bitmap_cache_misses = 0;
   FT_Done_FreeType (ft_library);
 #ifdef HAVE_FONTCONFIG
   FcConfigDestroy (fc_config);
@@ -1173,6 +1173,7 @@ mfont__init ()
       }
     SAFE_FREE (buf);
   }
+  mfont_bitmap_cache_size = 1048576;
 
 #ifdef HAVE_FREETYPE
   if (mfont__ft_init () < 0)
@@ -1439,6 +1440,61 @@ compare_font_score (const void *e1, const void *e2)
 	  : s1->font->for_full_width);
 }
 
+/* Return 1 iff S1 must be placed after S2 in a font list.  */
+#define FONT_SCORE_WORSE_P(s1, s2) compare_font_score ((s1), (s2))
+
+/* Move the best NUM elements of FONTS (N elements) to the head of
+   FONTS in the order of goodness.  The order of the remaining
+   elements is not preserved.  */
+
+static void
+select_font_scores (MFontScore *fonts, int n, int num)
+{
+  MFontScore tmp;
+  int i, j, k;
+
+  if (num == 1)
+    {
+      for (i = 1, j = 0; i < n; i++)
+	if (FONT_SCORE_WORSE_P (fonts + j, fonts + i))
+	  j = i;
+      tmp = fonts[0], fonts[0] = fonts[j], fonts[j] = tmp;
+      return;
+    }
+
+  /* Keep the best NUM elements in a heap at the head of FONTS, where
+     the worst one is at the top.  */
+  for (i = 0; i < n; i++)
+    {
+      if (i < num)
+	j = i;
+      else if (FONT_SCORE_WORSE_P (fonts, fonts + i))
+	{
+	  tmp = fonts[0], fonts[0] = fonts[i], fonts[i] = tmp;
+	  /* Sift down.  */
+	  for (j = 0; (k = j * 2 + 1) < num; j = k)
+	    {
+	      if (k + 1 < num && FONT_SCORE_WORSE_P (fonts + k + 1, fonts + k))
+		k++;
+	      if (! FONT_SCORE_WORSE_P (fonts + k, fonts + j))
+		break;
+	      tmp = fonts[j], fonts[j] = fonts[k], fonts[k] = tmp;
+	    }
+	  continue;
+	}
+      else
+	continue;
+      /* Sift up.  */
+      for (; j > 0 && FONT_SCORE_WORSE_P (fonts + j, fonts + (j - 1) / 2);
+	   j = (j - 1) / 2)
+	{
+	  k = (j - 1) / 2;
+	  tmp = fonts[j], fonts[j] = fonts[k], fonts[k] = tmp;
+	}
+    }
+  qsort (fonts, num, sizeof (MFontScore), compare_font_score);
+}
+
 void
 mdebug_dump_font_list (MFontList *font_list)
 {
@@ -1466,21 +1522,26 @@ mfont__free_realized (MRealizedFont *rfont)
     }
 }
 
+/* Return a list of fonts matching with SPEC, sorted by how well they
+   match with REQUEST.  If NUM is positive, only the best NUM fonts
+   are returned.  */
+
 MFontList *
-mfont__list (MFrame *frame, MFont *spec, MFont *request, int max_size)
+mfont__list (MFrame *frame, MFont *spec, MFont *request, int max_size,
+	     int num)
 {
   MFontList *list;
   MSymbol id = mfont__id (spec);
   MPlist *pl, *p;
-  int num, i;
+  int len, i;
 
   pl = msymbol_get (id, M_font_list);
   if (pl)
-    num = (int) msymbol_get (id, M_font_list_len);
+    len = (int) msymbol_get (id, M_font_list_len);
   else
     {
       pl = mplist ();
-      num = 0;
+      len = 0;
       MPLIST_DO (p, frame->font_driver_list)
 	{
 	  if (spec->source == MFONT_SOURCE_X ? MPLIST_KEY (p) == Mx
@@ -1488,20 +1549,20 @@ mfont__list (MFrame *frame, MFont *spec, MFont *request, int max_size)
 	      : 1)
 	    {
 	      MFontDriver *driver = MPLIST_VAL (p);
-	      num += (driver->list) (frame, pl, spec, 0);
+	      len += (driver->list) (frame, pl, spec, 0);
 	    }
 	}
       msymbol_put (id, M_font_list, pl);
       M17N_OBJECT_UNREF (pl);
-      msymbol_put (id, M_font_list_len, (void *) num);
+      msymbol_put (id, M_font_list_len, (void *) len);
     }
   
-  if (num == 0)
+  if (len == 0)
     return NULL;
 
   MSTRUCT_MALLOC (list, MERROR_FONT);
-  MTABLE_MALLOC (list->fonts, num, MERROR_FONT);
-  for (i = 0; num > 0; num--, pl = MPLIST_NEXT (pl))
+  MTABLE_MALLOC (list->fonts, len, MERROR_FONT);
+  for (i = 0; len > 0; len--, pl = MPLIST_NEXT (pl))
     {
       MFont *font = MPLIST_VAL (pl), *adjusted = font;
 
@@ -1535,9 +1596,16 @@ mfont__list (MFrame *frame, MFont *spec, MFont *request, int max_size)
       free (list);
       return NULL;
     }
-  list->nfonts = i;
+  if (num <= 0 || num > i)
+    num = i;
   if (spec != request)
-    qsort (list->fonts, i, sizeof (MFontScore), compare_font_score);
+    {
+      if (num < i)
+	select_font_scores (list->fonts, i, num);
+      else
+	qsort (list->fonts, i, sizeof (MFontScore), compare_font_score);
+    }
+  list->nfonts = num;
   list->object = *spec;
   mfont__merge (&list->object, request, 0);
   list->object.type = MFONT_TYPE_OBJECT;
@@ -1607,6 +1675,87 @@ mfont__has_char (MFrame *frame, MFont *font, MFont *spec, int c)
   return (driver->has_char) (frame, font, spec, c, code);
 }
 
+/* Return the number of leading glyphs among N glyphs at G that FONT
+   can display.  A glyph other than GLYPH_CHAR is checked as a space.
+   This is the same as calling mfont__has_char () for each glyph but
+   finds the encoding and the driver only once.  */
+
+int
+mfont__has_chars (MFrame *frame, MFont *font, MFont *spec, MGlyph *g, int n)
+{
+  MFontEncoding *encoding;
+  MFontDriver *driver;
+  int i;
+
+  if (font->source == MFONT_SOURCE_UNDECIDED)
+    MFATAL (MERROR_FONT);
+  encoding = (font->encoding ? font->encoding : find_encoding (font));
+  if (! encoding->encoding_charset)
+    return 0;
+  if (encoding->repertory_charset)
+    driver = NULL;
+  else if (font->type == MFONT_TYPE_REALIZED)
+    driver = ((MRealizedFont *) font)->driver;
+  else
+    {
+      driver = mplist_get (frame->font_driver_list,
+			   font->source == MFONT_SOURCE_X ? Mx : Mfreetype);
+      if (! driver)
+	MFATAL (MERROR_FONT);
+    }
+  for (i = 0; i < n; i++)
+    {
+      int c = g[i].type == GLYPH_CHAR ? g[i].g.c : ' ';
+      unsigned code;
+
+      if (! driver)
+	{
+	  if (ENCODE_CHAR (encoding->repertory_charset, c)
+	      == MCHAR_INVALID_CODE)
+	    break;
+	  continue;
+	}
+      code = ENCODE_CHAR (encoding->encoding_charset, c);
+      if (code == MCHAR_INVALID_CODE
+	  || ! (driver->has_char) (frame, font, spec, c, code))
+	break;
+    }
+  return i;
+}
+
+/* Probe up to mfont_probe_threads fonts of FONT_LIST from the FROMth
+   concurrently so that the following calls of mfont__has_char () and
+   mfont__has_chars () for them do not have to open them.  Return the
+   index of the first font not probed.  */
+
+int
+mfont__probe_fonts (MFontList *font_list, int from)
+{
+  int to = from + mfont_probe_threads;
+
+  if (mfont_probe_threads <= 1 || to > font_list->nfonts)
+    to = font_list->nfonts;
+#ifdef HAVE_FREETYPE
+  if (mfont_probe_threads > 1)
+    {
+      MFont **fonts = alloca (sizeof (MFont *) * (to - from));
+      int i, n;
+
+      for (i = from, n = 0; i < to; i++)
+	{
+	  MFont *font = font_list->fonts[i].font;
+
+	  if (font->type == MFONT_TYPE_OBJECT
+	      && font->source == MFONT_SOURCE_FT)
+	    fonts[n++] = font;
+	}
+      if (n > 1)
+	mfont__ft_prepare_coverage (fonts, n, mfont_probe_threads);
+    }
+#endif	/* HAVE_FREETYPE */
+  return to;
+}
+
 unsigned
 mfont__encode_char (MFrame *frame, MFont *font, MFont *spec, int c)
 {
@@ -2241,6 +2390,56 @@ MPlist *mfont_freetype_path;
 
 /*=*/
 
+/***en
+    @brief Maximum number of bytes used for cached glyph bitmaps.
+
+    The variable mfont_bitmap_cache_size limits the memory used by the
+    cache of glyph bitmaps rendered by FreeType.  The cache is shared
+    by all frames that draw glyphs with FreeType, and the least
+    recently used bitmaps are discarded when the limit is exceeded.
+    If the value is zero, bitmaps are not cached.
+
+    The macro M17N_INIT () sets this variable to 1048576.  See also
+    mfont_bitmap_cache_statistics ().  */
+
+int mfont_bitmap_cache_size;
+
+/*=*/
+
+/***en
+    @brief Flag to control the font catalog.
+
+    If the variable mfont_use_font_catalog is nonzero, the properties
+    and the character coverage of the fonts found in
+    #mfont_freetype_path are saved in the file "font-catalog" of the
+    user's m17n directory (i.e. the directory specified by the
+    environment variable M17NDIR, or "~/.m17n.d"), and are read from
+    there by the next process instead of opening each font file again,
+    as long as the file is not modified.  The default value is 0.
+
+    If the m17n library is configured to use the fontconfig library,
+    this variable is not used because fontconfig keeps its own cache
+    of fonts.  */
+
+int mfont_use_font_catalog;
+
+/*=*/
+
+/***en
+    @brief Number of threads used to probe fonts.
+
+    If the variable mfont_probe_threads is greater than 1, when no
+    font in a font group of a fontset is known to support a
+    character, the character coverages of that many candidate fonts
+    are examined concurrently by threads, instead of opening the
+    candidates one by one.  The font finally selected is the same.
+    It is effective only if the library is built with the thread
+    support.  The default value is 0.  */
+
+int mfont_probe_threads;
+
+/*=*/
+
 /***en
     @brief Create a new font.
 
@@ -2748,7 +2947,7 @@ mfont_find (MFrame *frame, MFont *spec, int *score, int max_size)
   spec_copy.capability = spec->capability;
   spec_copy.file = spec->file;
 
-  list = mfont__list (frame, &spec_copy, spec, max_size);
+  list = mfont__list (frame, &spec_copy, spec, max_size, 1);
   if (! list)
     return NULL;
 
@@ -2987,7 +3186,7 @@ mfont_list (MFrame *frame, MFont *font, MSymbol language, int maxnum)
     spec.capability = merge_capability (spec.capability, Mlanguage, language,
 					0);
 
-  font_list = mfont__list (frame, &spec, &spec, 0);
+  font_list = mfont__list (frame, &spec, &spec, 0, maxnum);
   if (! font_list)
     return NULL;
   if (font_list->nfonts == 0)
@@ -3175,6 +3374,32 @@ mfont_close (MFont *font)
   return 0;
 }
 
+/*=*/
+/***en
+    @brief Get statistics of the cache of glyph bitmaps.
+
+    The mfont_bitmap_cache_statistics () function stores the number of
+    successful and unsuccessful searches of the cache of glyph bitmaps
+    in the places pointed to by $HITS and $MISSES respectively unless
+    they are @c NULL.  See #mfont_bitmap_cache_size for the cache.
+
+    @return
+    This function returns the number of bytes used by the cache.  */
+
+int
+mfont_bitmap_cache_statistics (int *hits, int *misses)
+{
+#ifdef HAVE_FREETYPE
+  return mfont__ft_bitmap_cache_statistics (hits, misses);
+#else  /* not HAVE_FREETYPE */
+  if (hits)
+    *hits = 0;
+  if (misses)
+    *misses = 0;
+  return 0;
+#endif /* not HAVE_FREETYPE */
+}
+
 /*** @} */
 
 /*** @addtogroup m17nDebug */
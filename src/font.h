@@ -303,6 +303,26 @@ typedef struct
 #ifdef HAVE_FREETYPE
 extern MFontDriver mfont__ft_driver;
 
+/** Bitmap of a rendered glyph.  */
+
+typedef struct
+{
+  /* Offsets from the origin of the glyph to the top-left corner.  */
+  int left, top;
+  int width, rows, pitch;
+  /* One of FT_PIXEL_MODE_XXX.  */
+  int pixel_mode;
+  unsigned char *buffer;
+} MGlyphBitmap;
+
+extern MGlyphBitmap *mfont__ft_glyph_bitmap (MRealizedFont *rfont,
+					     unsigned code, int anti_alias);
+
+extern int mfont__ft_bitmap_cache_statistics (int *hits, int *misses);
+
+extern void mfont__ft_prepare_coverage (MFont **fonts, int nfonts,
+					int nthreads);
+
 extern int mfont__ft_init ();
 
 extern void mfont__ft_fini ();
@@ -334,6 +354,11 @@ extern MSymbol mfont__set_spec_from_plist (MFont *spec, MPlist *plist);
 
 extern int mfont__has_char (MFrame *frame, MFont *font, MFont *spec, int c);
 
+extern int mfont__has_chars (MFrame *frame, MFont *font, MFont *spec,
+			     MGlyph *g, int n);
+
+extern int mfont__probe_fonts (MFontList *font_list, int from);
+
 extern unsigned mfont__encode_char (MFrame *frame, MFont *font, MFont *spec,
 				    int c);
 
@@ -343,7 +368,7 @@ extern int mfont__get_glyph_id (MFLTFont *font, MFLTGlyphString *gstring,
 extern MFont *mfont__select (MFrame *frame, MFont *font, int max_size);
 
 extern MFontList *mfont__list (MFrame *frame, MFont *spec, MFont *request,
-			       int limited_size);
+			       int limited_size, int num);
 
 extern MRealizedFont *mfont__open (MFrame *frame, MFont *font, MFont *spec);
 
@@ -107,6 +107,31 @@ static MFontset *default_fontset;
 
 static MPlist *fontset_list;
 
+/* Result of mfont__lookup_fontset () memorized in a realized
+   fontset.  */
+
+typedef struct
+{
+  unsigned hash;
+
+  /* Arguments of mfont__lookup_fontset ().  */
+  MSymbol script, language, charset;
+  int size, ignore_fallback;
+  int len;
+  int *chars;
+
+  /* Result.  */
+  MRealizedFont *rfont;
+  MSymbol layouter;
+  int num;
+} MFontsetCacheEntry;
+
+/* Size of the direct-mapped table of MFontsetCacheEntry.  */
+#define FONTSET_CACHE_SIZE 256
+
+/* Runs of glyphs longer than this are not memorized.  */
+#define FONTSET_CACHE_MAX_LEN 64
+
 struct MRealizedFontset
 {
   /* Fontset from which the realized fontset is realized.  */
@@ -129,6 +154,10 @@ struct MRealizedFontset
   MPlist *per_charset;
 
   MPlist *fallback;
+
+  /* Table of memorized results of mfont__lookup_fontset (), or NULL.
+     Freed when the fontset is modified.  */
+  MFontsetCacheEntry **cache;
 };
 
 
@@ -452,6 +481,15 @@ free_realized_fontset_elements (MRealizedFontset *realized)
 	}
       M17N_OBJECT_UNREF (realized->fallback);
     }
+  if (realized->cache)
+    {
+      int i;
+
+      for (i = 0; i < FONTSET_CACHE_SIZE; i++)
+	free (realized->cache[i]);
+      free (realized->cache);
+      realized->cache = NULL;
+    }
 }
 
 static void
@@ -459,6 +497,7 @@ update_fontset_elements (MRealizedFontset *realized)
 {
   free_realized_fontset_elements (realized);
   realize_fontset_elements (realized->frame, realized);
+  realized->tick = realized->fontset->tick;
 }
 
 
@@ -556,11 +595,38 @@ mfont__free_realized_fontset (MRealizedFontset *realized)
 }
 
 
+/* Set glyph codes of NUM glyphs at G for RFONT.  If LAYOUTER is not
+   Mnil, get them from the coverage of the FLT.  */
+
+static void
+encode_glyphs (MFrame *frame, MRealizedFont *rfont, MFont *spec,
+	       MSymbol layouter, MGlyph *g, int num)
+{
+  MCharTable *coverage = NULL;
+  int j;
+
+  if (layouter != Mnil)
+    {
+      MFLT *flt = mflt_get (layouter);
+
+      if (flt)
+	coverage = mflt_coverage (flt);
+    }
+  for (j = 0; j < num; j++)
+    {
+      int c = g[j].type == GLYPH_CHAR ? g[j].g.c : ' ';
+
+      g[j].g.code = (coverage
+		     ? (unsigned ) mchartable_lookup (coverage, c)
+		     : mfont__encode_char (frame, (MFont *) rfont, spec, c));
+    }
+}
+
 static MRealizedFont *
 try_font_list (MFrame *frame, MFontList *font_list, MFont *request,
 	       MSymbol layouter, MGlyph *g, int *num, int all, int exact)
 {
-  int i, j;
+  int i, j, probed = 0;
   MFont *font;
   MRealizedFont *rfont;
 
@@ -582,26 +648,31 @@ try_font_list (MFrame *frame, MFontList *font_list, MFont *request,
       if (font->type == MFONT_TYPE_FAILURE)
 	continue;
       /* Check if this font can display all glyphs.  */
-      for (j = 0; j < *num; j++)
+      if (layouter == Mt)
 	{
-	  int c = g[j].type == GLYPH_CHAR ? g[j].g.c : ' ';
-	  MFLT *flt;
-	  MCharTable *coverage;
-
-	  if (layouter != Mt
-	      ? ((flt = mflt_get (layouter))
-		 ? (coverage = mflt_coverage (flt),
-		    ! mchartable_lookup (coverage, c))
-		 : 0)
-	      : ! mfont__has_char (frame, font, &font_list->object, c))
-	    break;
+	  if (i >= probed)
+	    probed = mfont__probe_fonts (font_list, i);
+	  j = mfont__has_chars (frame, font, &font_list->object, g, *num);
+	}
+      else
+	{
+	  MFLT *flt = mflt_get (layouter);
+	  MCharTable *coverage = flt ? mflt_coverage (flt) : NULL;
+
+	  for (j = 0; coverage && j < *num; j++)
+	    {
+	      int c = g[j].type == GLYPH_CHAR ? g[j].g.c : ' ';
+
+	      if (! mchartable_lookup (coverage, c))
+		break;
+	    }
+	  if (! coverage)
+	    j = *num;
 	}
       if (j == 0 && *num > 0)
 	continue;
       if (j == *num || !all)
 	{
-	  MCharTable *coverage = NULL;
-
 	  /* We found a font that can display the requested range of
 	     glyphs.  */
 	  if (font->type == MFONT_TYPE_REALIZED)
@@ -614,23 +685,9 @@ try_font_list (MFrame *frame, MFontList *font_list, MFont *request,
 	      font_list->fonts[i].font = (MFont *) rfont;
 	    }
 	  rfont->layouter = layouter == Mt ? Mnil : layouter;
-	  if (rfont->layouter)
-	    {
-	      MFLT *flt = mflt_get (rfont->layouter);
-
-	      if (flt)
-		coverage = mflt_coverage (flt);
-	    }
 	  *num = j;
-	  for (j = 0; j < *num; j++)
-	    {
-	      int c = g[j].type == GLYPH_CHAR ? g[j].g.c : ' ';
-
-	      g[j].g.code = (coverage
-			     ? (unsigned ) mchartable_lookup (coverage, c)
-			     : mfont__encode_char (frame, (MFont *) rfont,
-						   &font_list->object, c));
-	    }
+	  encode_glyphs (frame, rfont, &font_list->object, rfont->layouter,
+			 g, *num);
 	  return rfont;
 	}
     }
@@ -668,10 +725,10 @@ try_font_group (MRealizedFontset *realized, MFont *request,
 		  mplist_pop (plist);
 		  continue;
 		}
-	      font_list = mfont__list (frame, &this, &this, size);
+	      font_list = mfont__list (frame, &this, &this, size, 0);
 	    }
 	  else
-	    font_list = mfont__list (frame, font, request, size);
+	    font_list = mfont__list (frame, font, request, size, 0);
 	  if (! font_list)
 	    {
 	      /* As there's no font matching this spec, remove this
@@ -753,6 +810,9 @@ mfont__lookup_fontset (MRealizedFontset *realized, MGlyph *g, int *num,
   MPlist *per_charset, *per_script, *per_lang;
   MPlist *plist;
   MRealizedFont *rfont = NULL;
+  MFontsetCacheEntry key, *entry;
+
+  key.chars = NULL;
 
   if (MDEBUG_FLAG ())
     {
@@ -768,6 +828,52 @@ mfont__lookup_fontset (MRealizedFontset *realized, MGlyph *g, int *num,
   if (realized->tick != realized->fontset->tick)
     update_fontset_elements (realized);
 
+  if (*num <= FONTSET_CACHE_MAX_LEN)
+    {
+      int i;
+
+      /* Look up the memorized result.  */
+      key.script = script;
+      key.language = language;
+      key.charset = charset;
+      key.size = size;
+      key.ignore_fallback = ignore_fallback;
+      key.len = *num;
+      key.chars = alloca (sizeof (int) * (key.len + 1));
+      key.hash = ((size_t) script ^ ((size_t) language << 1)
+		  ^ ((size_t) charset << 2) ^ (size << 3) ^ ignore_fallback);
+      for (i = 0; i < key.len; i++)
+	{
+	  key.chars[i] = g[i].type == GLYPH_CHAR ? g[i].g.c : ' ';
+	  key.hash = (key.hash << 5) + (key.hash >> 27) + key.chars[i];
+	}
+      if (! realized->cache)
+	MTABLE_CALLOC (realized->cache, FONTSET_CACHE_SIZE, MERROR_FONTSET);
+      entry = realized->cache[key.hash % FONTSET_CACHE_SIZE];
+      if (entry
+	  && entry->hash == key.hash
+	  && entry->script == script
+	  && entry->language == language
+	  && entry->charset == charset
+	  && entry->size == size
+	  && entry->ignore_fallback == ignore_fallback
+	  && entry->len == key.len
+	  && ! memcmp (entry->chars, key.chars, sizeof (int) * key.len))
+	{
+	  rfont = entry->rfont;
+	  *num = entry->num;
+	  if (rfont)
+	    {
+	      rfont->layouter = entry->layouter;
+	      encode_glyphs (realized->frame, rfont, NULL, rfont->layouter,
+			     g, *num);
+	    }
+	  /* Don't memorize it again.  */
+	  key.chars = NULL;
+	  goto done;
+	}
+    }
+
   if (preferred_charset
       && (per_charset = mplist_get (realized->per_charset, charset)) != NULL
       && (rfont = try_font_group (realized, &realized->request, per_charset,
@@ -858,6 +964,19 @@ mfont__lookup_fontset (MRealizedFontset *realized, MGlyph *g, int *num,
   rfont = try_font_group (realized, &realized->request,
 			  realized->fallback, g, num, size);
  done:
+  if (key.chars
+      && (entry = realloc (realized->cache[key.hash % FONTSET_CACHE_SIZE],
+			   sizeof (MFontsetCacheEntry)
+			   + sizeof (int) * key.len)))
+    {
+      *entry = key;
+      entry->chars = (int *) (entry + 1);
+      memcpy (entry->chars, key.chars, sizeof (int) * key.len);
+      entry->rfont = rfont;
+      entry->layouter = rfont ? rfont->layouter : Mnil;
+      entry->num = *num;
+      realized->cache[key.hash % FONTSET_CACHE_SIZE] = entry;
+    }
   if (MDEBUG_FLAG ())
     {
       if (rfont)
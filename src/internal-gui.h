@@ -32,6 +32,11 @@ enum MDeviceType
 typedef struct MRealizedFont MRealizedFont;
 typedef struct MRealizedFace MRealizedFace;
 typedef struct MRealizedFontset MRealizedFontset;
+typedef struct MFaceCacheEntry MFaceCacheEntry;
+typedef struct MTextExtentsEntry MTextExtentsEntry;
+typedef struct MLineCache MLineCache;
+typedef struct MBidiLevelsEntry MBidiLevelsEntry;
+typedef struct MGlyphStringPool MGlyphStringPool;
 typedef struct MDeviceDriver MDeviceDriver;
 
 /** Information about a frame.  */
@@ -91,6 +96,23 @@ struct MFrame
 
   /** List of realized fontsets.  */
   MPlist *realized_fontset_list;
+
+  /** Table of realized faces looked up by mface__realize (), or
+      NULL.  */
+  MFaceCacheEntry **face_cache;
+
+  /** Table of text extents looked up by mdraw_text_extents () if the
+      frame has no output device, or NULL.  */
+  MTextExtentsEntry **extents_cache;
+
+  /** Lines of paragraphs laid out on the frame, or NULL.  */
+  MLineCache *line_cache;
+
+  /** Table of bidi levels of paragraphs, or NULL.  */
+  MBidiLevelsEntry **bidi_levels_cache;
+
+  /** Pool of glyph strings for reuse, or NULL.  */
+  MGlyphStringPool *gstring_pool;
 };
 
 #define M_CHECK_WRITABLE(frame, err, ret)			\
@@ -149,6 +171,11 @@ struct MGlyphString
   short text_ascent, text_descent, line_ascent, line_descent;
   int indent, width_limit;
 
+  /* Set by truncate_gstring () to the position of the first character
+     that didn't fit in <width_limit>, and the position before which
+     the characters determined where the line was broken.  */
+  int overflow, context_to;
+
   /* Copied for <control>.anti_alias but never set if the frame's
      depth is less than 8.  */
   unsigned anti_alias : 1;
@@ -156,6 +183,9 @@ struct MGlyphString
   MDrawControl control;
 
   struct MGlyphString *next, *top;
+
+  /* The pool the glyph string is returned to when released.  */
+  MGlyphStringPool *pool;
 };
 
 #define MGLYPH(idx)	\
@@ -259,6 +289,7 @@ extern void mface__fini ();
 
 extern int mdraw__init ();
 extern void mdraw__fini ();
+extern void mdraw__free_cache (MFrame *frame);
 
 extern int mfont__fontset_init ();
 extern void mfont__fontset_fini ();
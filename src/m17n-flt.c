@@ -26,7 +26,17 @@
 
     This section defines the m17n FLT API concerning character
     layouting facility using FLT (Font Layout Table).  The format of
-    FLT is described in @ref mdbFLT.  */
+    FLT is described in @ref mdbFLT.
+
+    If the library is built with POSIX threads, mflt_get (),
+    mflt_find (), mflt_run () and the functions for the cache of
+    mflt_run () can be called from multiple threads at the same time
+    once m17n_init_flt () has been called.  FLTs are loaded and
+    configured for a font under a lock, and characters are laid out
+    without it.  The callback functions of #MFLTFont and
+    #mflt_font_id must then be reentrant, and the variables of this
+    API must be set before starting threads.  The other parts of the
+    m17n library are not thread-safe.  */
 
 /***ja
     @addtogroup m17nFLT
@@ -49,7 +59,14 @@
 #include <string.h>
 #include <ctype.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 #include <regex.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "m17n-core.h"
 #include "m17n-flt.h"
@@ -253,6 +270,42 @@ static MSymbol Mgenerator, Mend;
 static MPlist *flt_list;
 static int flt_min_coverage, flt_max_coverage;
 
+/* Lock for the data shared by threads; i.e. flt_list and the FLTs in
+   it, the dispatch table of mflt_find (), and the cache of mflt_run
+   ().  It is recursive because the external API functions call each
+   other.  */
+
+#ifdef HAVE_PTHREAD
+
+static pthread_once_t flt_lock_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t flt_lock;
+
+static void
+init_flt_lock (void)
+{
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init (&attr);
+  pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init (&flt_lock, &attr);
+  pthread_mutexattr_destroy (&attr);
+}
+
+#define FLT_LOCK()					\
+  do {							\
+    pthread_once (&flt_lock_once, init_flt_lock);	\
+    pthread_mutex_lock (&flt_lock);			\
+  } while (0)
+
+#define FLT_UNLOCK() pthread_mutex_unlock (&flt_lock)
+
+#else  /* not HAVE_PTHREAD */
+
+#define FLT_LOCK() do { } while (0)
+#define FLT_UNLOCK() do { } while (0)
+
+#endif /* not HAVE_PTHREAD */
+
 enum GlyphInfoMask
 {
   CategoryCodeMask = 0x7F,
@@ -318,7 +371,8 @@ enum GlyphInfoMask
   do {						\
     MFLTGlyphString *src = (ctx)->in;		\
     MFLTGlyphString *tgt = (ctx)->out;		\
-    if (tgt->allocated <= tgt->used)		\
+    if (tgt->allocated <= tgt->used		\
+	&& reserve_output ((ctx), 1) < 0)	\
       return -2;				\
     GCPY (src, (idx), 1, tgt, tgt->used);	\
     tgt->used++;				\
@@ -390,6 +444,701 @@ static MSymbol Mcond, Mrange, Mfont_facility, Mequal;
       ctx->cluster_end_pos = (g)->to;		\
   } while (0)
 
+/* Regular expression matcher for rule sources.
+
+   The source of a rule is a regular expression matched against the
+   string of category letters of glyphs.  As the alphabet is small
+   and most patterns are short, each pattern is compiled into a
+   deterministic automaton when the FLT is loaded, and matching
+   becomes a single table-driven scan without backtracking and
+   without modifying the string.  Positions of parenthesized
+   subexpressions, which are needed only by SRC_INDEX rules, are
+   found by a depth-first search of the nondeterministic program
+   pruned by a table of the positions from which the already found
+   end of the match is reachable.
+
+   Patterns using a syntax not handled here (back references,
+   character class names, etc.), patterns whose automaton is too
+   large, and searches for subexpressions that take too many steps
+   fall back on regexec ().  */
+
+/* Maximum number of states of an automaton.  */
+#define REGEX_MAX_STATES 512
+
+/* Maximum number of instructions of a program.  */
+#define REGEX_MAX_INSTS 4096
+
+/* Maximum number of steps of searching subexpressions.  */
+#define REGEX_MAX_STEPS 4096
+
+/* Maximum repetition count of "{M,N}".  */
+#define REGEX_MAX_REPEAT 255
+
+enum FontLayoutRegexOp
+  {
+    /* Match a character in the set X.  */
+    REGEX_CHAR,
+    /* Continue at X, and then at Y.  */
+    REGEX_SPLIT,
+    /* Continue at X.  */
+    REGEX_JUMP,
+    /* Record the current position in the slot X.  */
+    REGEX_SAVE,
+    /* Match the beginning of the string.  */
+    REGEX_BOL,
+    /* Match the end of the string.  */
+    REGEX_EOL,
+    /* Start the repetition LOOP.  */
+    REGEX_ENTER,
+    /* Finish an iteration of the repetition LOOP.  If Y is negative,
+       the iteration is mandatory.  Otherwise, continue at Y, or exit
+       the repetition to X if the iteration matched nothing.  */
+    REGEX_ITER,
+    /* Succeed.  */
+    REGEX_MATCH
+  };
+
+typedef struct
+{
+  enum FontLayoutRegexOp op;
+  int x, y, loop;
+} FontLayoutRegexInst;
+
+typedef struct
+{
+  unsigned bits[8];
+} FontLayoutRegexSet;
+
+#define REGEX_SET_ADD(set, c) ((set)->bits[(c) >> 5] |= 1U << ((c) & 31))
+#define REGEX_SET_HAS(set, c) ((set)->bits[(c) >> 5] & (1U << ((c) & 31)))
+
+/* Bits of FontLayoutRegex->accept.  */
+#define REGEX_ACCEPT 1
+#define REGEX_ACCEPT_AT_END 2
+
+typedef struct
+{
+  /* Nondeterministic program.  */
+  int ninsts;
+  FontLayoutRegexInst *insts;
+  int nsets;
+  FontLayoutRegexSet *sets;
+  int ngroups;
+  int nloops;
+
+  /* Deterministic automaton.  Characters that no set distinguishes
+     share the same class.  Class 0 is for those matched by no set.
+     TRANS[STATE * NCLASSES + CLASS] is the next state or -1.  */
+  unsigned char classes[256];
+  int nclasses;
+  int nstates;
+  short *trans;
+  unsigned char *accept;
+} FontLayoutRegex;
+
+enum FontLayoutRegexNodeType
+  {
+    REGEX_NODE_EMPTY,
+    REGEX_NODE_SET,
+    REGEX_NODE_CONCAT,
+    REGEX_NODE_ALTERNATIVE,
+    REGEX_NODE_REPEAT,
+    REGEX_NODE_GROUP,
+    REGEX_NODE_BOL,
+    REGEX_NODE_EOL
+  };
+
+typedef struct FontLayoutRegexNode FontLayoutRegexNode;
+
+struct FontLayoutRegexNode
+{
+  enum FontLayoutRegexNodeType type;
+  /* Index of the set for REGEX_NODE_SET, index of the group for
+     REGEX_NODE_GROUP.  */
+  int idx;
+  /* Repetition counts for REGEX_NODE_REPEAT.  Negative MAX means no
+     upper limit.  */
+  int min, max;
+  FontLayoutRegexNode *left, *right;
+};
+
+typedef struct
+{
+  const char *p;
+  int error;
+  FontLayoutRegex *re;
+  int sets_size;
+} FontLayoutRegexParser;
+
+static FontLayoutRegexNode *
+regex_node (FontLayoutRegexParser *parser, enum FontLayoutRegexNodeType type,
+	    FontLayoutRegexNode *left, FontLayoutRegexNode *right)
+{
+  FontLayoutRegexNode *node;
+
+  MSTRUCT_CALLOC (node, MERROR_FLT);
+  node->type = type;
+  node->left = left;
+  node->right = right;
+  return node;
+}
+
+static void
+free_regex_node (FontLayoutRegexNode *node)
+{
+  if (node)
+    {
+      free_regex_node (node->left);
+      free_regex_node (node->right);
+      free (node);
+    }
+}
+
+static FontLayoutRegexNode *
+regex_set_node (FontLayoutRegexParser *parser, FontLayoutRegexSet *set)
+{
+  FontLayoutRegex *re = parser->re;
+  FontLayoutRegexNode *node;
+  int i;
+
+  /* NUL terminates the string of category letters.  */
+  set->bits[0] &= ~1U;
+  for (i = 0; i < re->nsets; i++)
+    if (! memcmp (re->sets + i, set, sizeof *set))
+      break;
+  if (i == re->nsets)
+    {
+      if (re->nsets == parser->sets_size)
+	{
+	  parser->sets_size += 16;
+	  MTABLE_REALLOC (re->sets, parser->sets_size, MERROR_FLT);
+	}
+      re->sets[re->nsets++] = *set;
+    }
+  node = regex_node (parser, REGEX_NODE_SET, NULL, NULL);
+  node->idx = i;
+  return node;
+}
+
+static FontLayoutRegexNode *parse_regex_alternative (FontLayoutRegexParser *);
+
+static FontLayoutRegexNode *
+parse_regex_atom (FontLayoutRegexParser *parser)
+{
+  FontLayoutRegexSet set;
+  int c = (unsigned char) *parser->p;
+  int i;
+
+  memset (&set, 0, sizeof set);
+  if (c == '(')
+    {
+      FontLayoutRegexNode *node;
+      int group = ++parser->re->ngroups;
+
+      parser->p++;
+      node = regex_node (parser, REGEX_NODE_GROUP,
+			 parse_regex_alternative (parser), NULL);
+      node->idx = group;
+      if (*parser->p != ')')
+	parser->error = 1;
+      else
+	parser->p++;
+      return node;
+    }
+  if (c == '[')
+    {
+      int negate = 0;
+      const char *p = ++parser->p;
+
+      if (*p == '^')
+	negate = 1, p++;
+      /* "]" is an ordinary character at the head.  */
+      if (*p == ']')
+	REGEX_SET_ADD (&set, ']'), p++;
+      while (*p && *p != ']')
+	{
+	  int from = (unsigned char) *p++, to = from;
+
+	  if (from == '[' && (*p == ':' || *p == '.' || *p == '='))
+	    {
+	      parser->error = 1;
+	      return NULL;
+	    }
+	  if (p[0] == '-' && p[1] && p[1] != ']')
+	    to = (unsigned char) p[1], p += 2;
+	  for (i = from; i <= to; i++)
+	    REGEX_SET_ADD (&set, i);
+	}
+      if (*p != ']')
+	{
+	  parser->error = 1;
+	  return NULL;
+	}
+      parser->p = p + 1;
+      if (negate)
+	for (i = 0; i < 8; i++)
+	  set.bits[i] = ~set.bits[i];
+      return regex_set_node (parser, &set);
+    }
+  if (c == '.')
+    {
+      parser->p++;
+      memset (&set, 0xFF, sizeof set);
+      return regex_set_node (parser, &set);
+    }
+  if (c == '^')
+    {
+      parser->p++;
+      return regex_node (parser, REGEX_NODE_BOL, NULL, NULL);
+    }
+  if (c == '$')
+    {
+      parser->p++;
+      return regex_node (parser, REGEX_NODE_EOL, NULL, NULL);
+    }
+  if (c == '\\')
+    {
+      c = (unsigned char) *++parser->p;
+      /* Back references and GNU operators such as "\\w" are not
+	 supported.  */
+      if (! c || isalnum (c) || strchr ("<>`'", c))
+	{
+	  parser->error = 1;
+	  return NULL;
+	}
+    }
+  else if (! c || c == ')' || c == '|' || c == '*' || c == '+' || c == '?'
+	   || c == '{')
+    {
+      parser->error = 1;
+      return NULL;
+    }
+  parser->p++;
+  REGEX_SET_ADD (&set, c);
+  return regex_set_node (parser, &set);
+}
+
+static int
+parse_regex_count (FontLayoutRegexParser *parser)
+{
+  int n = -1;
+
+  while (*parser->p >= '0' && *parser->p <= '9' && n <= REGEX_MAX_REPEAT)
+    n = (n < 0 ? 0 : n * 10) + *parser->p++ - '0';
+  return n;
+}
+
+static FontLayoutRegexNode *
+parse_regex_piece (FontLayoutRegexParser *parser)
+{
+  FontLayoutRegexNode *node = parse_regex_atom (parser);
+
+  while (! parser->error)
+    {
+      FontLayoutRegexNode *repeat;
+      int min, max;
+
+      if (*parser->p == '*')
+	min = 0, max = -1;
+      else if (*parser->p == '+')
+	min = 1, max = -1;
+      else if (*parser->p == '?')
+	min = 0, max = 1;
+      else if (*parser->p == '{')
+	{
+	  parser->p++;
+	  min = parse_regex_count (parser);
+	  if (*parser->p == ',')
+	    {
+	      parser->p++;
+	      max = parse_regex_count (parser);
+	    }
+	  else
+	    max = min;
+	  if (min < 0 || *parser->p != '}'
+	      || min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT
+	      || (max >= 0 && max < min))
+	    {
+	      parser->error = 1;
+	      break;
+	    }
+	}
+      else
+	break;
+      parser->p++;
+      repeat = regex_node (parser, REGEX_NODE_REPEAT, node, NULL);
+      repeat->min = min, repeat->max = max;
+      node = repeat;
+    }
+  return node;
+}
+
+static FontLayoutRegexNode *
+parse_regex_alternative (FontLayoutRegexParser *parser)
+{
+  FontLayoutRegexNode *node = NULL;
+
+  while (1)
+    {
+      FontLayoutRegexNode *branch = NULL;
+
+      while (! parser->error && *parser->p && *parser->p != '|'
+	     && *parser->p != ')')
+	{
+	  FontLayoutRegexNode *piece = parse_regex_piece (parser);
+
+	  branch = (branch
+		    ? regex_node (parser, REGEX_NODE_CONCAT, branch, piece)
+		    : piece);
+	}
+      if (! branch)
+	branch = regex_node (parser, REGEX_NODE_EMPTY, NULL, NULL);
+      node = (node
+	      ? regex_node (parser, REGEX_NODE_ALTERNATIVE, node, branch)
+	      : branch);
+      if (parser->error || *parser->p != '|')
+	break;
+      parser->p++;
+    }
+  return node;
+}
+
+static int
+emit_regex_inst (FontLayoutRegex *re, int *size,
+		 enum FontLayoutRegexOp op, int x, int y)
+{
+  if (re->ninsts == *size)
+    {
+      if (*size >= REGEX_MAX_INSTS)
+	return -1;
+      *size += 64;
+      MTABLE_REALLOC (re->insts, *size, MERROR_FLT);
+    }
+  re->insts[re->ninsts].op = op;
+  re->insts[re->ninsts].x = x;
+  re->insts[re->ninsts].y = y;
+  re->insts[re->ninsts].loop = 0;
+  return re->ninsts++;
+}
+
+/* Generate instructions for NODE.  Return -1 if the program becomes
+   too large.  */
+
+static int
+generate_regex_insts (FontLayoutRegex *re, int *size,
+		      FontLayoutRegexNode *node)
+{
+  int i, split, jump;
+
+  switch (node->type)
+    {
+    case REGEX_NODE_EMPTY:
+      return 0;
+
+    case REGEX_NODE_SET:
+      return emit_regex_inst (re, size, REGEX_CHAR, node->idx, 0);
+
+    case REGEX_NODE_BOL:
+      return emit_regex_inst (re, size, REGEX_BOL, 0, 0);
+
+    case REGEX_NODE_EOL:
+      return emit_regex_inst (re, size, REGEX_EOL, 0, 0);
+
+    case REGEX_NODE_CONCAT:
+      if (generate_regex_insts (re, size, node->left) < 0)
+	return -1;
+      return generate_regex_insts (re, size, node->right);
+
+    case REGEX_NODE_GROUP:
+      if (emit_regex_inst (re, size, REGEX_SAVE, node->idx * 2, 0) < 0
+	  || generate_regex_insts (re, size, node->left) < 0)
+	return -1;
+      return emit_regex_inst (re, size, REGEX_SAVE, node->idx * 2 + 1, 0);
+
+    case REGEX_NODE_ALTERNATIVE:
+      if ((split = emit_regex_inst (re, size, REGEX_SPLIT, 0, 0)) < 0)
+	return -1;
+      re->insts[split].x = re->ninsts;
+      if (generate_regex_insts (re, size, node->left) < 0
+	  || (jump = emit_regex_inst (re, size, REGEX_JUMP, 0, 0)) < 0)
+	return -1;
+      re->insts[split].y = re->ninsts;
+      if (generate_regex_insts (re, size, node->right) < 0)
+	return -1;
+      re->insts[jump].x = re->ninsts;
+      return 0;
+
+    case REGEX_NODE_REPEAT:
+      {
+	int loop = re->nloops++;
+	int noptionals = node->max < 0 ? 1 : node->max - node->min;
+	int *optionals = alloca (sizeof (int) * 2 * noptionals);
+	int iter;
+
+	if ((i = emit_regex_inst (re, size, REGEX_ENTER, 0, 0)) < 0)
+	  return -1;
+	re->insts[i].loop = loop;
+	for (i = 0; i < node->min; i++)
+	  {
+	    if (generate_regex_insts (re, size, node->left) < 0
+		|| (iter = emit_regex_inst (re, size, REGEX_ITER, 0, -1)) < 0)
+	      return -1;
+	    re->insts[iter].loop = loop;
+	  }
+	for (i = 0; i < noptionals; i++)
+	  {
+	    if ((split = emit_regex_inst (re, size, REGEX_SPLIT, 0, 0)) < 0)
+	      return -1;
+	    re->insts[split].x = re->ninsts;
+	    if (generate_regex_insts (re, size, node->left) < 0
+		|| (iter = emit_regex_inst (re, size, REGEX_ITER, 0, 0)) < 0)
+	      return -1;
+	    re->insts[iter].loop = loop;
+	    re->insts[iter].y = node->max < 0 ? split : re->ninsts;
+	    optionals[i * 2] = split;
+	    optionals[i * 2 + 1] = iter;
+	  }
+	/* All optional iterations exit here.  */
+	for (i = 0; i < noptionals; i++)
+	  {
+	    re->insts[optionals[i * 2]].y = re->ninsts;
+	    re->insts[optionals[i * 2 + 1]].x = re->ninsts;
+	  }
+      }
+      return 0;
+    }
+  return -1;
+}
+
+/* Add the closure of the instruction PC by moves not consuming a
+   character to the sorted list of instructions waiting for a
+   character STATE of length *N.  */
+
+static void
+regex_closure (FontLayoutRegex *re, int pc, int at_bol, char *visited,
+	       int *state, int *n, int *accept)
+{
+  FontLayoutRegexInst *inst;
+
+  if (visited[pc])
+    return;
+  visited[pc] = 1;
+  inst = re->insts + pc;
+  switch (inst->op)
+    {
+    case REGEX_CHAR:
+      {
+	int i;
+
+	for (i = *n; i > 0 && state[i - 1] > pc; i--)
+	  state[i] = state[i - 1];
+	state[i] = pc;
+	(*n)++;
+      }
+      break;
+
+    case REGEX_MATCH:
+      *accept |= REGEX_ACCEPT;
+      break;
+
+    case REGEX_SPLIT:
+      regex_closure (re, inst->x, at_bol, visited, state, n, accept);
+      regex_closure (re, inst->y, at_bol, visited, state, n, accept);
+      break;
+
+    case REGEX_JUMP:
+      regex_closure (re, inst->x, at_bol, visited, state, n, accept);
+      break;
+
+    case REGEX_ITER:
+      if (inst->y >= 0)
+	{
+	  regex_closure (re, inst->x, at_bol, visited, state, n, accept);
+	  regex_closure (re, inst->y, at_bol, visited, state, n, accept);
+	  break;
+	}
+      /* Fall through.  */
+    case REGEX_SAVE: case REGEX_ENTER:
+      regex_closure (re, pc + 1, at_bol, visited, state, n, accept);
+      break;
+
+    case REGEX_BOL:
+      if (at_bol)
+	regex_closure (re, pc + 1, at_bol, visited, state, n, accept);
+      break;
+
+    case REGEX_EOL:
+      {
+	/* Nothing but the end of the string can follow.  */
+	char *visited_eol = alloca (re->ninsts);
+	int *state_eol = alloca (sizeof (int) * re->ninsts);
+	int n_eol = 0, accept_eol = 0;
+
+	memcpy (visited_eol, visited, re->ninsts);
+	regex_closure (re, pc + 1, at_bol, visited_eol, state_eol, &n_eol,
+		       &accept_eol);
+	if (accept_eol)
+	  *accept |= REGEX_ACCEPT_AT_END;
+      }
+      break;
+    }
+}
+
+/* Build the deterministic automaton of RE by the subset construction.
+   Return -1 if it has too many states.  */
+
+static int
+build_regex_automaton (FontLayoutRegex *re)
+{
+  int **states, *lengths;
+  int *state, n, accept;
+  char *visited;
+  unsigned char representative[256];
+  int c, i, s, result = -1;
+
+  /* Two characters belong to the same class iff every set has both
+     or neither of them.  */
+  re->nclasses = 1;
+  for (c = 0; c < 256; c++)
+    {
+      int d;
+
+      for (i = 0; i < re->nsets && ! REGEX_SET_HAS (re->sets + i, c); i++);
+      if (i == re->nsets)
+	{
+	  re->classes[c] = 0;
+	  continue;
+	}
+      for (d = 1; d < re->nclasses; d++)
+	{
+	  int r = representative[d];
+
+	  for (i = 0; i < re->nsets; i++)
+	    if (! REGEX_SET_HAS (re->sets + i, c)
+		!= ! REGEX_SET_HAS (re->sets + i, r))
+	      break;
+	  if (i == re->nsets)
+	    break;
+	}
+      if (d == re->nclasses)
+	representative[re->nclasses++] = c;
+      re->classes[c] = d;
+    }
+
+  MTABLE_MALLOC (states, REGEX_MAX_STATES, MERROR_FLT);
+  MTABLE_MALLOC (lengths, REGEX_MAX_STATES, MERROR_FLT);
+  MTABLE_MALLOC (re->trans, REGEX_MAX_STATES * re->nclasses, MERROR_FLT);
+  MTABLE_MALLOC (re->accept, REGEX_MAX_STATES, MERROR_FLT);
+  state = alloca (sizeof (int) * re->ninsts);
+  visited = alloca (re->ninsts);
+
+  memset (visited, 0, re->ninsts);
+  n = accept = 0;
+  regex_closure (re, 0, 1, visited, state, &n, &accept);
+  MTABLE_MALLOC (states[0], n + 1, MERROR_FLT);
+  memcpy (states[0], state, sizeof (int) * n);
+  lengths[0] = n;
+  re->accept[0] = accept;
+  re->nstates = 1;
+
+  for (s = 0; s < re->nstates; s++)
+    {
+      int k;
+
+      re->trans[s * re->nclasses] = -1;
+      for (k = 1; k < re->nclasses; k++)
+	{
+	  int t;
+
+	  memset (visited, 0, re->ninsts);
+	  n = accept = 0;
+	  for (i = 0; i < lengths[s]; i++)
+	    {
+	      FontLayoutRegexInst *inst = re->insts + states[s][i];
+
+	      if (REGEX_SET_HAS (re->sets + inst->x, representative[k]))
+		regex_closure (re, states[s][i] + 1, 0, visited, state,
+			       &n, &accept);
+	    }
+	  if (n == 0 && ! accept)
+	    {
+	      re->trans[s * re->nclasses + k] = -1;
+	      continue;
+	    }
+	  for (t = 0; t < re->nstates; t++)
+	    if (lengths[t] == n && re->accept[t] == accept
+		&& ! memcmp (states[t], state, sizeof (int) * n))
+	      break;
+	  if (t == re->nstates)
+	    {
+	      if (t == REGEX_MAX_STATES)
+		goto finish;
+	      MTABLE_MALLOC (states[t], n + 1, MERROR_FLT);
+	      memcpy (states[t], state, sizeof (int) * n);
+	      lengths[t] = n;
+	      re->accept[t] = accept;
+	      re->nstates++;
+	    }
+	  re->trans[s * re->nclasses + k] = t;
+	}
+    }
+  /* Give back the rows allocated for the states not built.  */
+  MTABLE_REALLOC (re->trans, re->nstates * re->nclasses, MERROR_FLT);
+  MTABLE_REALLOC (re->accept, re->nstates, MERROR_FLT);
+  result = 0;
+
+ finish:
+  for (s = 0; s < re->nstates; s++)
+    free (states[s]);
+  free (states);
+  free (lengths);
+  return result;
+}
+
+static void
+free_regex (FontLayoutRegex *re)
+{
+  free (re->insts);
+  free (re->sets);
+  free (re->trans);
+  free (re->accept);
+  free (re);
+}
+
+/* Compile PATTERN.  Return NULL if PATTERN can't be handled by
+   match_regex ().  */
+
+static FontLayoutRegex *
+compile_regex (const char *pattern)
+{
+  FontLayoutRegexParser parser;
+  FontLayoutRegexNode *node;
+  FontLayoutRegex *re;
+  int size = 0;
+
+  MSTRUCT_CALLOC (re, MERROR_FLT);
+  parser.p = pattern;
+  parser.error = 0;
+  parser.re = re;
+  parser.sets_size = 0;
+  node = parse_regex_alternative (&parser);
+  if (parser.error || *parser.p
+      || generate_regex_insts (re, &size, node) < 0
+      || emit_regex_inst (re, &size, REGEX_MATCH, 0, 0) < 0
+      || build_regex_automaton (re) < 0)
+    {
+      free_regex_node (node);
+      free_regex (re);
+      return NULL;
+    }
+  free_regex_node (node);
+  return re;
+}
+
+/* Maximum number of subexpressions (including the whole match) a
+   SRC_INDEX rule can refer to.  */
+#define NMATCH 20
+
 enum FontLayoutCmdRuleSrcType
   {
     SRC_REGEX,
@@ -407,6 +1156,13 @@ typedef struct
     struct {
       char *pattern;
       regex_t preg;
+      /* Compiled form of PATTERN, or NULL if PATTERN is matched only
+	 by regexec ().  */
+      FontLayoutRegex *compiled;
+      /* 1 if PREG is compiled, -1 if regcomp () rejected PATTERN, and
+	 0 if PATTERN is not yet given to regcomp ().  As COMPILED
+	 rarely fails to match, PREG is compiled on demand.  */
+      int preg_state;
     } re;
     int match_idx;
     struct {
@@ -447,6 +1203,19 @@ enum FontLayoutCmdType
     FontLayoutCmdTypeMAX
   };
 
+/* Profile of a command recorded while mflt_enable_profile is
+   nonzero.  */
+
+typedef struct
+{
+  /* How many times the command was run, and how many times it
+     matched.  A rule whose source is a match index always matches.  */
+  unsigned long calls, matches;
+  /* Total time spent in the command including the nested commands,
+     in microseconds.  */
+  double time;
+} FontLayoutProfile;
+
 typedef struct
 {
   enum FontLayoutCmdType type;
@@ -455,6 +1224,7 @@ typedef struct
     FontLayoutCmdCond cond;
     MFLTOtfSpec otf;
   } body;
+  FontLayoutProfile profile;
 } FontLayoutCmd;
 
 typedef struct
@@ -1079,8 +1849,14 @@ load_command (FontLayoutStage *stage, MPlist *plist,
 		  mtext_ins_char (mt, 0, '^', 1);
 		  str = (char *) MTEXT_DATA (mt);
 		}
-	      if (regcomp (&cmd->body.rule.src.re.preg, str, REG_EXTENDED))
-		MERROR (MERROR_FONT, INVALID_CMD_ID);
+	      cmd->body.rule.src.re.compiled = compile_regex (str);
+	      cmd->body.rule.src.re.preg_state = 0;
+	      if (! cmd->body.rule.src.re.compiled)
+		{
+		  if (regcomp (&cmd->body.rule.src.re.preg, str, REG_EXTENDED))
+		    MERROR (MERROR_FONT, INVALID_CMD_ID);
+		  cmd->body.rule.src.re.preg_state = 1;
+		}
 	      cmd->body.rule.src_type = SRC_REGEX;
 	      cmd->body.rule.src.re.pattern = strdup (str);
 	    }
@@ -1269,7 +2045,10 @@ free_flt_command (FontLayoutCmd *cmd)
       if (rule->src_type == SRC_REGEX)
 	{
 	  free (rule->src.re.pattern);
-	  regfree (&rule->src.re.preg);
+	  if (rule->src.re.preg_state > 0)
+	    regfree (&rule->src.re.preg);
+	  if (rule->src.re.compiled)
+	    free_regex (rule->src.re.compiled);
 	}
       else if (rule->src_type == SRC_SEQ)
 	free (rule->src.seq.codes);
@@ -1298,7 +2077,7 @@ load_generator (MPlist *plist)
   FontLayoutStage *stage;
   MPlist *elt, *pl;
   FontLayoutCmd dummy;
-  int result;
+  int result, i;
 
   MSTRUCT_CALLOC (stage, MERROR_DRAW);
   MLIST_INIT1 (stage, cmds, 32);
@@ -1325,32 +2104,777 @@ load_generator (MPlist *plist)
       free (stage);
       return NULL;
     }
+  for (i = 0; i < stage->used; i++)
+    memset (&stage->cmds[i].profile, 0, sizeof (FontLayoutProfile));
 
   return stage;
 }
 
 
-/* Load stages of the font layout table FLT.  */
+/* Compiled FLT cache.
 
-static int
-load_flt (MFLT *flt, MPlist *key_list)
+   If mflt_use_compiled_cache is nonzero, load_flt () saves the
+   categories and the stages of an FLT in a binary form into the file
+   "flt-cache/NAME" of the user's m17n directory, and loads them from
+   that file instead of the FLT file as long as the FLT file keeps the
+   same modification time and size.  Compiled regular expressions are
+   saved too, so that neither the Lisp-like syntax of the FLT nor the
+   patterns have to be parsed again.  The file is specific to the
+   machine and to the value of mflt_enable_new_feature.  An FLT whose
+   category table must be configured for each font is not cached.  */
+
+#define FLT_CACHE_MAGIC "M17NFLTC"
+#define FLT_CACHE_VERSION 1
+#define FLT_CACHE_DIR "flt-cache"
+
+typedef struct
+{
+  unsigned char *buf;
+  int size, pos;
+  /* Nonzero if BUF can't be extended, or it is too short or broken
+     to read from.  */
+  int error;
+} FontLayoutFile;
+
+static void
+flt_file_put (FontLayoutFile *file, const void *data, int len)
+{
+  if (file->error)
+    return;
+  if (file->pos + len > file->size)
+    {
+      int size = file->size * 2;
+      unsigned char *buf;
+
+      if (size < file->pos + len)
+	size = file->pos + len + 1024;
+      buf = realloc (file->buf, size);
+      if (! buf)
+	{
+	  file->error = 1;
+	  return;
+	}
+      file->buf = buf;
+      file->size = size;
+    }
+  memcpy (file->buf + file->pos, data, len);
+  file->pos += len;
+}
+
+static void
+flt_file_put_int (FontLayoutFile *file, int n)
+{
+  flt_file_put (file, &n, sizeof (int));
+}
+
+static void
+flt_file_put_string (FontLayoutFile *file, char *str)
+{
+  int len = strlen (str);
+
+  flt_file_put_int (file, len);
+  flt_file_put (file, str, len);
+}
+
+static int
+flt_file_get (FontLayoutFile *file, void *data, int len)
+{
+  if (file->error || len < 0 || len > file->size - file->pos)
+    {
+      file->error = 1;
+      return -1;
+    }
+  memcpy (data, file->buf + file->pos, len);
+  file->pos += len;
+  return 0;
+}
+
+static int
+flt_file_get_int (FontLayoutFile *file)
+{
+  int n = 0;
+
+  flt_file_get (file, &n, sizeof (int));
+  return n;
+}
+
+/* Read N elements of SIZE bytes into a newly allocated array, and
+   return it.  */
+
+static void *
+flt_file_get_array (FontLayoutFile *file, int n, int size)
+{
+  void *data;
+
+  if (file->error || n < 0 || n > (file->size - file->pos) / size)
+    {
+      file->error = 1;
+      return NULL;
+    }
+  data = malloc (n > 0 ? n * size : 1);
+  if (! data)
+    {
+      file->error = 1;
+      return NULL;
+    }
+  flt_file_get (file, data, n * size);
+  return data;
+}
+
+static char *
+flt_file_get_string (FontLayoutFile *file)
+{
+  int len = flt_file_get_int (file);
+  char *str;
+
+  if (file->error || len < 0 || len > file->size - file->pos
+      || ! (str = malloc (len + 1)))
+    {
+      file->error = 1;
+      return NULL;
+    }
+  flt_file_get (file, str, len);
+  str[len] = '\0';
+  return str;
+}
+
+static void
+put_category_range (int from, int to, void *val, void *arg)
+{
+  FontLayoutFile *file = arg;
+
+  flt_file_put_int (file, from);
+  flt_file_put_int (file, to);
+  flt_file_put_int (file, (int) val);
+}
+
+static void
+put_flt_category (FontLayoutFile *file, FontLayoutCategory *category)
+{
+  int size = category->feature_table.size;
+
+  mchartable_map (category->table, (void *) 0, put_category_range, file);
+  flt_file_put_int (file, -1);
+  flt_file_put_int (file, size);
+  if (size > 0)
+    {
+      flt_file_put (file, category->feature_table.tag,
+		    sizeof (unsigned int) * size);
+      flt_file_put (file, category->feature_table.code, size);
+    }
+}
+
+static FontLayoutCategory *
+get_flt_category (FontLayoutFile *file)
+{
+  FontLayoutCategory *category;
+  int from, to, code, size;
+
+  if (! MSTRUCT_CALLOC_SAFE (category))
+    {
+      file->error = 1;
+      return NULL;
+    }
+  category->table = mchartable (Minteger, (void *) 0);
+  while ((from = flt_file_get_int (file)) >= 0 && ! file->error)
+    {
+      to = flt_file_get_int (file);
+      code = flt_file_get_int (file);
+      if (file->error || to < from || ! isalnum (code))
+	{
+	  file->error = 1;
+	  break;
+	}
+      if (from == to)
+	mchartable_set (category->table, from, (void *) code);
+      else
+	mchartable_set_range (category->table, from, to, (void *) code);
+    }
+  size = flt_file_get_int (file);
+  if (size > 0)
+    {
+      unsigned int *tag = flt_file_get_array (file, size,
+					      sizeof (unsigned int));
+      char *code_table = flt_file_get_array (file, size, 1);
+
+      if (tag && code_table)
+	{
+	  category->feature_table.size = size;
+	  category->feature_table.tag = tag;
+	  category->feature_table.code = code_table;
+	}
+      else
+	{
+	  free (tag);
+	  free (code_table);
+	}
+    }
+  if (file->error)
+    {
+      unref_category_table (category);
+      return NULL;
+    }
+  return category;
+}
+
+static void
+put_flt_regex (FontLayoutFile *file, FontLayoutRegex *re)
+{
+  flt_file_put_int (file, re->ninsts);
+  flt_file_put (file, re->insts, sizeof (FontLayoutRegexInst) * re->ninsts);
+  flt_file_put_int (file, re->nsets);
+  flt_file_put (file, re->sets, sizeof (FontLayoutRegexSet) * re->nsets);
+  flt_file_put_int (file, re->ngroups);
+  flt_file_put_int (file, re->nloops);
+  flt_file_put (file, re->classes, 256);
+  flt_file_put_int (file, re->nclasses);
+  flt_file_put_int (file, re->nstates);
+  flt_file_put (file, re->trans, sizeof (short) * re->nstates * re->nclasses);
+  flt_file_put (file, re->accept, re->nstates);
+}
+
+/* Read a compiled regular expression, and check that match_regex ()
+   can run it safely.  */
+
+static FontLayoutRegex *
+get_flt_regex (FontLayoutFile *file)
+{
+  FontLayoutRegex *re;
+  int nslots, i;
+
+  if (! MSTRUCT_CALLOC_SAFE (re))
+    {
+      file->error = 1;
+      return NULL;
+    }
+  re->ninsts = flt_file_get_int (file);
+  if (re->ninsts <= 0 || re->ninsts > REGEX_MAX_INSTS)
+    goto err;
+  re->insts = flt_file_get_array (file, re->ninsts,
+				  sizeof (FontLayoutRegexInst));
+  re->nsets = flt_file_get_int (file);
+  re->sets = flt_file_get_array (file, re->nsets, sizeof (FontLayoutRegexSet));
+  re->ngroups = flt_file_get_int (file);
+  re->nloops = flt_file_get_int (file);
+  flt_file_get (file, re->classes, 256);
+  re->nclasses = flt_file_get_int (file);
+  re->nstates = flt_file_get_int (file);
+  if (file->error
+      || re->ngroups < 0 || re->ngroups > REGEX_MAX_INSTS
+      || re->nloops < 0 || re->nloops > REGEX_MAX_INSTS
+      || re->nclasses <= 0 || re->nclasses > 256
+      || re->nstates <= 0 || re->nstates > REGEX_MAX_STATES)
+    goto err;
+  re->trans = flt_file_get_array (file, re->nstates * re->nclasses,
+				  sizeof (short));
+  re->accept = flt_file_get_array (file, re->nstates, 1);
+  if (file->error)
+    goto err;
+
+  nslots = (re->ngroups + 1) * 2;
+  if (re->insts[re->ninsts - 1].op != REGEX_MATCH)
+    goto err;
+  for (i = 0; i < re->ninsts; i++)
+    {
+      FontLayoutRegexInst *inst = re->insts + i;
+
+      switch (inst->op)
+	{
+	case REGEX_CHAR:
+	  if (inst->x < 0 || inst->x >= re->nsets)
+	    goto err;
+	  break;
+	case REGEX_SAVE:
+	  if (inst->x < 0 || inst->x >= nslots)
+	    goto err;
+	  break;
+	case REGEX_SPLIT: case REGEX_JUMP:
+	  if (inst->x < 0 || inst->x >= re->ninsts
+	      || inst->y < 0 || inst->y >= re->ninsts)
+	    goto err;
+	  break;
+	case REGEX_ITER:
+	  if (inst->x < 0 || inst->x >= re->ninsts
+	      || inst->y < -1 || inst->y >= re->ninsts)
+	    goto err;
+	  /* fall through */
+	case REGEX_ENTER:
+	  if (inst->loop < 0 || inst->loop >= re->nloops)
+	    goto err;
+	  break;
+	case REGEX_BOL: case REGEX_EOL: case REGEX_MATCH:
+	  break;
+	default:
+	  goto err;
+	}
+    }
+  for (i = 0; i < 256; i++)
+    if (re->classes[i] >= re->nclasses)
+      goto err;
+  for (i = re->nstates * re->nclasses - 1; i >= 0; i--)
+    if (re->trans[i] < -1 || re->trans[i] >= re->nstates)
+      goto err;
+  return re;
+
+ err:
+  file->error = 1;
+  free_regex (re);
+  return NULL;
+}
+
+static void
+put_flt_command (FontLayoutFile *file, FontLayoutCmd *cmd)
+{
+  int *cmd_ids = NULL;
+  int n_cmds = 0;
+
+  flt_file_put_int (file, cmd->type);
+  if (cmd->type == FontLayoutCmdTypeRule)
+    {
+      FontLayoutCmdRule *rule = &cmd->body.rule;
+      MPlist *p;
+
+      flt_file_put_int (file, rule->src_type);
+      switch (rule->src_type)
+	{
+	case SRC_REGEX:
+	  flt_file_put_string (file, rule->src.re.pattern);
+	  flt_file_put_int (file, rule->src.re.compiled != NULL);
+	  if (rule->src.re.compiled)
+	    put_flt_regex (file, rule->src.re.compiled);
+	  break;
+	case SRC_INDEX:
+	  flt_file_put_int (file, rule->src.match_idx);
+	  break;
+	case SRC_SEQ:
+	  flt_file_put_int (file, rule->src.seq.n_codes);
+	  flt_file_put (file, rule->src.seq.codes,
+			sizeof (int) * rule->src.seq.n_codes);
+	  break;
+	case SRC_RANGE:
+	  flt_file_put_int (file, rule->src.range.from);
+	  flt_file_put_int (file, rule->src.range.to);
+	  break;
+	default:
+	  if (rule->src_type == SRC_OTF_SPEC)
+	    flt_file_put_string (file,
+				 MSYMBOL_NAME (rule->src.facility.otf_spec.sym));
+	  flt_file_put_int (file, rule->src.facility.len);
+	  MPLIST_DO (p, rule->src.facility.codes)
+	    {
+	      /* An element is an integer or the symbol "=".  */
+	      flt_file_put_int (file, MPLIST_INTEGER_P (p));
+	      flt_file_put_int (file, (MPLIST_INTEGER_P (p)
+				       ? MPLIST_INTEGER (p) : 0));
+	    }
+	}
+      n_cmds = rule->n_cmds;
+      cmd_ids = rule->cmd_ids;
+    }
+  else if (cmd->type == FontLayoutCmdTypeCond)
+    {
+      FontLayoutCmdCond *cond = &cmd->body.cond;
+
+      flt_file_put_int (file, cond->seq_beg);
+      flt_file_put_int (file, cond->seq_end);
+      flt_file_put_int (file, cond->seq_from);
+      flt_file_put_int (file, cond->seq_to);
+      n_cmds = cond->n_cmds;
+      cmd_ids = cond->cmd_ids;
+    }
+  else if (cmd->type == FontLayoutCmdTypeOTF
+	   || cmd->type == FontLayoutCmdTypeOTFCategory)
+    {
+      flt_file_put_string (file, MSYMBOL_NAME (cmd->body.otf.sym));
+      return;
+    }
+  else
+    return;
+  flt_file_put_int (file, n_cmds);
+  flt_file_put (file, cmd_ids, sizeof (int) * n_cmds);
+}
+
+static MSymbol
+get_flt_symbol (FontLayoutFile *file)
+{
+  char *name = flt_file_get_string (file);
+  MSymbol sym;
+
+  if (! name)
+    return Mnil;
+  sym = msymbol (name);
+  free (name);
+  return sym;
+}
+
+/* Read a command into CMD of STAGE.  CMD must be zero-cleared.  */
+
+static void
+get_flt_command (FontLayoutFile *file, FontLayoutStage *stage,
+		 FontLayoutCmd *cmd)
+{
+  int **cmd_ids, *n_cmds;
+  int i;
+
+  cmd->type = flt_file_get_int (file);
+  if (file->error)
+    return;
+  if (cmd->type == FontLayoutCmdTypeRule)
+    {
+      FontLayoutCmdRule *rule = &cmd->body.rule;
+
+      rule->src_type = flt_file_get_int (file);
+      switch (rule->src_type)
+	{
+	case SRC_REGEX:
+	  rule->src.re.pattern = flt_file_get_string (file);
+	  if (! rule->src.re.pattern)
+	    return;
+	  if (flt_file_get_int (file))
+	    rule->src.re.compiled = get_flt_regex (file);
+	  else if (! file->error)
+	    {
+	      if (regcomp (&rule->src.re.preg, rule->src.re.pattern,
+			   REG_EXTENDED))
+		file->error = 1;
+	      else
+		rule->src.re.preg_state = 1;
+	    }
+	  break;
+	case SRC_INDEX:
+	  rule->src.match_idx = flt_file_get_int (file);
+	  if (rule->src.match_idx < 0 || rule->src.match_idx >= NMATCH)
+	    file->error = 1;
+	  break;
+	case SRC_SEQ:
+	  rule->src.seq.n_codes = flt_file_get_int (file);
+	  rule->src.seq.codes = flt_file_get_array (file, rule->src.seq.n_codes,
+						    sizeof (int));
+	  if (rule->src.seq.n_codes <= 0)
+	    file->error = 1;
+	  break;
+	case SRC_RANGE:
+	  rule->src.range.from = flt_file_get_int (file);
+	  rule->src.range.to = flt_file_get_int (file);
+	  break;
+	case SRC_HAS_GLYPH:
+	case SRC_OTF_SPEC:
+	  if (rule->src_type == SRC_OTF_SPEC
+	      && parse_otf_command (get_flt_symbol (file),
+				    &rule->src.facility.otf_spec) == -2)
+	    file->error = 1;
+	  rule->src.facility.len = flt_file_get_int (file);
+	  if (rule->src.facility.len < 0)
+	    file->error = 1;
+	  rule->src.facility.codes = mplist ();
+	  for (i = 0; i < rule->src.facility.len && ! file->error; i++)
+	    {
+	      int integerp = flt_file_get_int (file);
+	      int code = flt_file_get_int (file);
+
+	      if (integerp)
+		mplist_add (rule->src.facility.codes, Minteger, (void *) code);
+	      else
+		mplist_add (rule->src.facility.codes, Msymbol, Mequal);
+	    }
+	  break;
+	default:
+	  file->error = 1;
+	  return;
+	}
+      n_cmds = &rule->n_cmds;
+      cmd_ids = &rule->cmd_ids;
+    }
+  else if (cmd->type == FontLayoutCmdTypeCond)
+    {
+      FontLayoutCmdCond *cond = &cmd->body.cond;
+
+      cond->seq_beg = flt_file_get_int (file);
+      cond->seq_end = flt_file_get_int (file);
+      cond->seq_from = flt_file_get_int (file);
+      cond->seq_to = flt_file_get_int (file);
+      n_cmds = &cond->n_cmds;
+      cmd_ids = &cond->cmd_ids;
+    }
+  else if (cmd->type == FontLayoutCmdTypeOTF
+	   || cmd->type == FontLayoutCmdTypeOTFCategory)
+    {
+      if (parse_otf_command (get_flt_symbol (file), &cmd->body.otf) == -2)
+	file->error = 1;
+      return;
+    }
+  else
+    {
+      /* An unused slot for a macro.  */
+      if (cmd->type != FontLayoutCmdTypeMAX)
+	file->error = 1;
+      return;
+    }
+
+  *n_cmds = flt_file_get_int (file);
+  *cmd_ids = flt_file_get_array (file, *n_cmds, sizeof (int));
+  if (! *cmd_ids)
+    {
+      *n_cmds = 0;
+      return;
+    }
+  for (i = 0; i < *n_cmds; i++)
+    if ((*cmd_ids)[i] <= CMD_ID_OFFSET_INDEX
+	&& CMD_ID_TO_INDEX ((*cmd_ids)[i]) >= stage->used)
+      file->error = 1;
+}
+
+static void free_flt_stage (MFLT *flt, FontLayoutStage *stage);
+
+/* Return the name of the cache file of FLT in a newly allocated
+   memory, or NULL if the user's m17n directory is unknown.  */
+
+static char *
+flt_cache_file (MFLT *flt)
+{
+  MDatabaseInfo *dir_info;
+  char *filename;
+
+  if (! mdatabase__dir_list)
+    return NULL;
+  dir_info = MPLIST_VAL (mdatabase__dir_list);
+  if (! dir_info->filename)
+    return NULL;
+  filename = malloc (dir_info->len + sizeof FLT_CACHE_DIR
+		     + MSYMBOL_NAMELEN (flt->name) + 1);
+  if (filename)
+    sprintf (filename, "%s%s%c%s", dir_info->filename, FLT_CACHE_DIR,
+	     PATH_SEPARATOR, MSYMBOL_NAME (flt->name));
+  return filename;
+}
+
+static void
+put_flt_cache_header (FontLayoutFile *file, char *source, struct stat *buf)
+{
+  flt_file_put (file, FLT_CACHE_MAGIC, 8);
+  flt_file_put_int (file, FLT_CACHE_VERSION);
+  flt_file_put_int (file, sizeof (int));
+  flt_file_put_int (file, sizeof (FontLayoutRegexInst));
+  flt_file_put_int (file, mflt_enable_new_feature);
+  flt_file_put_string (file, source);
+  flt_file_put (file, &buf->st_mtime, sizeof buf->st_mtime);
+  flt_file_put (file, &buf->st_size, sizeof buf->st_size);
+}
+
+/* Save the categories and the stages of FLT into its cache file.  */
+
+static void
+save_flt_cache (MFLT *flt)
+{
+  FontLayoutFile file;
+  FontLayoutCategory **categories;
+  int ncategories, i;
+  MPlist *plist;
+  char *source, *filename, *tmp;
+  struct stat buf;
+  FILE *fp = NULL;
+
+  if (flt->need_config || ! flt->coverage || ! flt->stages
+      || ! (source = mdatabase__file (flt->mdb))
+      || stat (source, &buf) < 0
+      || ! (filename = flt_cache_file (flt)))
+    return;
+
+  /* The first category is always the coverage.  */
+  categories = alloca (sizeof (FontLayoutCategory *)
+		       * (MPLIST_LENGTH (flt->stages) + 1));
+  categories[0] = flt->coverage;
+  ncategories = 1;
+  MPLIST_DO (plist, flt->stages)
+    {
+      FontLayoutStage *stage = MPLIST_VAL (plist);
+
+      for (i = 0; i < ncategories && categories[i] != stage->category; i++);
+      if (i == ncategories)
+	categories[ncategories++] = stage->category;
+    }
+
+  memset (&file, 0, sizeof file);
+  put_flt_cache_header (&file, source, &buf);
+  flt_file_put_int (&file, ncategories);
+  for (i = 0; i < ncategories; i++)
+    put_flt_category (&file, categories[i]);
+  flt_file_put_int (&file, MPLIST_LENGTH (flt->stages));
+  MPLIST_DO (plist, flt->stages)
+    {
+      FontLayoutStage *stage = MPLIST_VAL (plist);
+
+      for (i = 0; categories[i] != stage->category; i++);
+      flt_file_put_int (&file, i);
+      flt_file_put_int (&file, stage->used);
+      for (i = 0; i < stage->used; i++)
+	put_flt_command (&file, stage->cmds + i);
+    }
+
+  /* Write into a temporary file first so that a process reading the
+     cache file never sees an incomplete one.  */
+  tmp = alloca (strlen (filename) + 10);
+  sprintf (tmp, "%s.%X", filename, (unsigned) getpid ());
+  if (! file.error
+      && ! (fp = fopen (tmp, "w")))
+    {
+      char *dir = alloca (strlen (filename) + 1);
+
+      strcpy (dir, filename);
+      *strrchr (dir, PATH_SEPARATOR) = '\0';
+      if (stat (dir, &buf) == 0
+	  || mkdir (dir, 0777) < 0
+	  || ! (fp = fopen (tmp, "w")))
+	file.error = 1;
+    }
+  if (! file.error)
+    {
+      if (fwrite (file.buf, 1, file.pos, fp) != file.pos)
+	file.error = 1;
+      if (fclose (fp) != 0)
+	file.error = 1;
+      if (file.error || rename (tmp, filename) < 0)
+	unlink (tmp);
+      else
+	MDEBUG_PRINT2 (" [FLT] saved %s into %s\n",
+		       MSYMBOL_NAME (flt->name), filename);
+    }
+  free (file.buf);
+  free (filename);
+}
+
+/* Load the categories and the stages of FLT from its cache file.  If
+   COVERAGE_ONLY is nonzero, load only the coverage.  Return 0 on
+   success, and -1 if the cache file doesn't exist or is not for the
+   current FLT file.  */
+
+static int
+load_flt_cache (MFLT *flt, int coverage_only)
+{
+  FontLayoutFile file, header;
+  FontLayoutCategory **categories = NULL;
+  MPlist *stages = NULL;
+  int ncategories = 0, nstages, i, j;
+  char *source, *filename;
+  struct stat buf;
+  FILE *fp;
+
+  if (coverage_only ? flt->coverage != NULL : flt->stages != NULL)
+    return 0;
+  if (! (source = mdatabase__file (flt->mdb))
+      || stat (source, &buf) < 0
+      || ! (filename = flt_cache_file (flt)))
+    return -1;
+  fp = fopen (filename, "r");
+  free (filename);
+  if (! fp)
+    return -1;
+
+  memset (&file, 0, sizeof file);
+  if (fseek (fp, 0, SEEK_END) == 0
+      && (file.size = ftell (fp)) > 0
+      && fseek (fp, 0, SEEK_SET) == 0
+      && (file.buf = malloc (file.size))
+      && fread (file.buf, 1, file.size, fp) == file.size)
+    {
+      memset (&header, 0, sizeof header);
+      put_flt_cache_header (&header, source, &buf);
+      if (header.error || header.pos > file.size
+	  || memcmp (header.buf, file.buf, header.pos))
+	file.error = 1;
+      file.pos = header.pos;
+      free (header.buf);
+    }
+  else
+    file.error = 1;
+  fclose (fp);
+
+  ncategories = flt_file_get_int (&file);
+  if (! file.error
+      && (ncategories <= 0 || ncategories > file.size
+	  || ! MTABLE_CALLOC_SAFE (categories, ncategories)))
+    file.error = 1;
+  for (i = 0; i < ncategories && ! file.error; i++)
+    {
+      categories[i] = get_flt_category (&file);
+      if (i == 0 && categories[0] && flt->coverage)
+	{
+	  /* Share the coverage already loaded by list_flt ().  */
+	  unref_category_table (categories[0]);
+	  categories[0] = flt->coverage;
+	  ref_category_table (categories[0]);
+	}
+      if (coverage_only)
+	break;
+    }
+  nstages = coverage_only ? 0 : flt_file_get_int (&file);
+  if (nstages > 0 && ! file.error)
+    stages = mplist ();
+  for (i = 0; i < nstages && ! file.error; i++)
+    {
+      FontLayoutStage *stage;
+      int idx = flt_file_get_int (&file);
+      int used = flt_file_get_int (&file);
+
+      if (file.error || idx < 0 || idx >= ncategories
+	  || used <= 0 || used > file.size
+	  || ! MSTRUCT_CALLOC_SAFE (stage))
+	{
+	  file.error = 1;
+	  break;
+	}
+      if (! MTABLE_CALLOC_SAFE (stage->cmds, used))
+	{
+	  free (stage);
+	  file.error = 1;
+	  break;
+	}
+      stage->size = stage->used = used;
+      stage->inc = 32;
+      stage->category = categories[idx];
+      ref_category_table (stage->category);
+      mplist_add (stages, Mt, stage);
+      for (j = 0; j < used && ! file.error; j++)
+	get_flt_command (&file, stage, stage->cmds + j);
+    }
+  free (file.buf);
+
+  if (! file.error)
+    {
+      if (! flt->coverage)
+	{
+	  flt->coverage = categories[0];
+	  ref_category_table (flt->coverage);
+	}
+      flt->stages = stages;
+      MDEBUG_PRINT1 (" [FLT] loaded %s from the cache\n",
+		     MSYMBOL_NAME (flt->name));
+    }
+  else if (stages)
+    {
+      MPlist *plist;
+
+      MPLIST_DO (plist, stages)
+	free_flt_stage (flt, MPLIST_VAL (plist));
+      M17N_OBJECT_UNREF (stages);
+    }
+  for (i = 0; i < ncategories && categories; i++)
+    if (categories[i])
+      unref_category_table (categories[i]);
+  free (categories);
+  return (file.error ? -1 : 0);
+}
+
+
+/* Load stages of the font layout table FLT.  */
+
+static int
+load_flt (MFLT *flt, MPlist *key_list)
 {
   MPlist *top, *plist, *pl, *p;
   FontLayoutCategory *category = NULL;
   MSymbol sym;
 
-  if (key_list)
-    top = (MPlist *) mdatabase__load_for_keys (flt->mdb, key_list);
-  else
-    top = (MPlist *) mdatabase_load (flt->mdb);
-  if (! top)
-    return -1;
-  if (! MPLIST_PLIST_P (top))
-    {
-      M17N_OBJECT_UNREF (top);
-      MERROR (MERROR_FLT, -1);
-    }
-
   if (key_list)
     {
       plist = mdatabase__props (flt->mdb);
@@ -1393,6 +2917,22 @@ load_flt (MFLT *flt, MPlist *key_list)
 	    break;
 	  }
     }
+  if (mflt_use_compiled_cache
+      && load_flt_cache (flt, key_list != NULL) == 0)
+    return 0;
+
+  if (key_list)
+    top = (MPlist *) mdatabase__load_for_keys (flt->mdb, key_list);
+  else
+    top = (MPlist *) mdatabase_load (flt->mdb);
+  if (! top)
+    return -1;
+  if (! MPLIST_PLIST_P (top))
+    {
+      M17N_OBJECT_UNREF (top);
+      MERROR (MERROR_FLT, -1);
+    }
+
   MPLIST_DO (plist, top)
     {
       if (MPLIST_SYMBOL_P (plist)
@@ -1457,6 +2997,8 @@ load_flt (MFLT *flt, MPlist *key_list)
       MERROR (MERROR_FLT, -1);
     }
   M17N_OBJECT_UNREF (top);
+  if (! key_list && mflt_use_compiled_cache)
+    save_flt_cache (flt);
   return 0;
 }
 
@@ -1476,9 +3018,12 @@ free_flt_stage (MFLT *flt, FontLayoutStage *stage)
   free (stage);
 }
 
+static void free_flt_dispatch_table (void);
+
 static void
 free_flt_list ()
 {
+  free_flt_dispatch_table ();
   if (flt_list)
     {
       MPlist *plist, *pl;
@@ -1563,8 +3108,223 @@ list_flt ()
   return result;
 }
 
+
+static void setup_combining_flt (MFLT *flt);
+
+/* Dispatch table of mflt_find ().
+
+   For each character, flt_dispatch_table holds the list of FLTs
+   whose registry is unicode-bmp or unicode-full and whose coverage
+   contains the character, in the order of flt_list.  The table is
+   built once from the coverage of listed FLTs.  Results of checking
+   OTF specs of those FLTs are remembered for each font ID.  */
+
+typedef struct
+{
+  /* Number of FLTs.  */
+  int used;
+  /* Indices to flt_unicode_list.  */
+  int *indices;
+} FontLayoutCandidates;
+
+/* FLTs whose registry is unicode-bmp or unicode-full.  */
+static MFLT **flt_unicode_list;
+static int flt_unicode_used;
+
+/* Char-table whose values are pointers to FontLayoutCandidates.  */
+static MCharTable *flt_dispatch_table;
+
+/* Distinct lists of candidates.  The first one holds all FLTs in
+   flt_unicode_list.  */
+static FontLayoutCandidates *flt_candidates;
+static int flt_candidates_used;
+
+/* Plist of font IDs vs arrays of results of checking OTF specs of
+   FLTs in flt_unicode_list.  An element of an array is 1 if the font
+   satisfies the spec, 2 if not, 0 if not yet checked.  */
+static MPlist *flt_otf_memo;
+static int flt_otf_memo_used;
+
+/* Maximum number of fonts remembered in flt_otf_memo.  */
+#define FLT_OTF_MEMO_MAX 64
+
+typedef struct
+{
+  int used, size;
+  int *chars;
+} FontLayoutBoundaries;
+
+static void
+add_coverage_boundary (int from, int to, void *val, void *arg)
+{
+  FontLayoutBoundaries *boundaries = arg;
+
+  if (boundaries->used + 2 > boundaries->size)
+    {
+      boundaries->size = boundaries->size * 2 + 256;
+      MTABLE_REALLOC (boundaries->chars, boundaries->size, MERROR_FLT);
+    }
+  boundaries->chars[boundaries->used++] = from;
+  boundaries->chars[boundaries->used++] = to + 1;
+}
+
+static int
+compare_int (const void *p1, const void *p2)
+{
+  return *(int *) p1 - *(int *) p2;
+}
+
+static void
+free_flt_otf_memo (void)
+{
+  if (flt_otf_memo)
+    {
+      MPlist *plist;
+
+      MPLIST_DO (plist, flt_otf_memo)
+	free (MPLIST_VAL (plist));
+      M17N_OBJECT_UNREF (flt_otf_memo);
+    }
+  flt_otf_memo_used = 0;
+}
+
+static void
+free_flt_dispatch_table (void)
+{
+  int i;
+
+  if (! flt_dispatch_table)
+    return;
+  M17N_OBJECT_UNREF (flt_dispatch_table);
+  for (i = 0; i < flt_candidates_used; i++)
+    free (flt_candidates[i].indices);
+  free (flt_candidates);
+  flt_candidates = NULL;
+  flt_candidates_used = 0;
+  free (flt_unicode_list);
+  flt_unicode_list = NULL;
+  flt_unicode_used = 0;
+  free_flt_otf_memo ();
+}
+
+/* Return the candidates equal to those in INDICES, registering them
+   if not yet registered.  */
+
+static FontLayoutCandidates *
+intern_flt_candidates (int *indices, int used)
+{
+  int i;
+
+  for (i = 0; i < flt_candidates_used; i++)
+    if (flt_candidates[i].used == used
+	&& ! memcmp (flt_candidates[i].indices, indices, sizeof (int) * used))
+      return flt_candidates + i;
+  if (flt_candidates_used % 64 == 0)
+    MTABLE_REALLOC (flt_candidates, flt_candidates_used + 64, MERROR_FLT);
+  MTABLE_MALLOC (flt_candidates[i].indices, used + 1, MERROR_FLT);
+  memcpy (flt_candidates[i].indices, indices, sizeof (int) * used);
+  flt_candidates[i].used = used;
+  flt_candidates_used++;
+  return flt_candidates + i;
+}
+
+static int
+setup_flt_dispatch_table (void)
+{
+  MSymbol unicode_bmp = msymbol ("unicode-bmp");
+  MSymbol unicode_full = msymbol ("unicode-full");
+  FontLayoutBoundaries boundaries;
+  MPlist *plist;
+  int *indices;
+  int i, j;
+
+  MTABLE_MALLOC (flt_unicode_list, MPLIST_LENGTH (flt_list) + 1, MERROR_FLT);
+  MPLIST_DO (plist, flt_list)
+    {
+      MFLT *flt = MPLIST_VAL (plist);
+
+      if (flt->font_id != Mnil)
+	continue;
+      if (flt->registry != unicode_bmp && flt->registry != unicode_full)
+	continue;
+      if (flt->name == Mcombining
+	  && ! mchartable_lookup (flt->coverage->table, 0))
+	setup_combining_flt (flt);
+      flt_unicode_list[flt_unicode_used++] = flt;
+    }
+
+  indices = alloca (sizeof (int) * (flt_unicode_used + 1));
+  for (i = 0; i < flt_unicode_used; i++)
+    indices[i] = i;
+  /* This must be flt_candidates[0].  */
+  intern_flt_candidates (indices, flt_unicode_used);
+
+  boundaries.used = boundaries.size = 0;
+  boundaries.chars = NULL;
+  for (i = 0; i < flt_unicode_used; i++)
+    mchartable_map (flt_unicode_list[i]->coverage->table, (void *) 0,
+		    add_coverage_boundary, &boundaries);
+  if (boundaries.used > 0)
+    qsort (boundaries.chars, boundaries.used, sizeof (int), compare_int);
+
+  flt_dispatch_table = mchartable (Mnil, NULL);
+  /* No FLT changes its coverage between two adjacent boundaries.  */
+  for (i = 0; i + 1 < boundaries.used; i++)
+    {
+      int from = boundaries.chars[i], to = boundaries.chars[i + 1] - 1;
+      int used = 0;
+
+      if (from > to || from > MCHAR_MAX)
+	continue;
+      for (j = 0; j < flt_unicode_used; j++)
+	if (mchartable_lookup (flt_unicode_list[j]->coverage->table, from))
+	  indices[used++] = j;
+      if (used > 0)
+	mchartable_set_range (flt_dispatch_table, from, to,
+			      intern_flt_candidates (indices, used));
+    }
+  free (boundaries.chars);
+  return 0;
+}
+
+/* Return the array of results of checking OTF specs of FLTs in
+   flt_unicode_list for FONT_ID.  */
+
+static char *
+flt_otf_memo_for (MSymbol font_id)
+{
+  char *memo;
+
+  if (! flt_otf_memo)
+    flt_otf_memo = mplist ();
+  else if ((memo = mplist_get (flt_otf_memo, font_id)))
+    return memo;
+  if (flt_otf_memo_used >= FLT_OTF_MEMO_MAX)
+    {
+      free_flt_otf_memo ();
+      flt_otf_memo = mplist ();
+    }
+  if (! MTABLE_CALLOC_SAFE (memo, flt_unicode_used + 1))
+    return NULL;
+  mplist_push (flt_otf_memo, font_id, memo);
+  flt_otf_memo_used++;
+  return memo;
+}
+
 /* FLS (Font Layout Service) */
 
+/* Buffers reused by mflt_run_with_workspace ().  */
+
+struct _MFLTWorkspace
+{
+  /* Outputs of stages.  Stages use them alternately.  */
+  MFLTGlyphString gstrings[2];
+
+  /* Category codes of the input of a stage.  */
+  char *encoded;
+  int encoded_size;
+};
+
 /* Structure to hold information about a context of FLS.  */
 
 typedef struct
@@ -1594,13 +3354,317 @@ typedef struct
   int combining_code;
   int left_padding;
   int check_mask;
+
+  /* Workspace owning IN (except for the first stage) and OUT, or NULL
+     if they are allocated on the stack.  */
+  MFLTWorkspace *workspace;
 } FontLayoutContext;
 
+/* Make GSTRING of a workspace have room for N glyphs.  Return 0 on
+   success, and -1 on memory shortage.  */
+
+static int
+reserve_workspace_glyphs (MFLTGlyphString *gstring, int n)
+{
+  void *glyphs;
+  int size = gstring->allocated > 0 ? gstring->allocated : 64;
+
+  if (n <= gstring->allocated)
+    return 0;
+  while (size < n)
+    size *= 2;
+  glyphs = realloc (gstring->glyphs, gstring->glyph_size * size);
+  if (! glyphs)
+    return -1;
+  gstring->glyphs = glyphs;
+  gstring->allocated = size;
+  return 0;
+}
+
+/* Make sure that CTX->out has room for N more glyphs.  Return 0 if it
+   has, and -1 if it can't be extended.  */
+
+static int
+reserve_output (FontLayoutContext *ctx, int n)
+{
+  if (ctx->out->used + n <= ctx->out->allocated)
+    return 0;
+  if (! ctx->workspace)
+    return -1;
+  return reserve_workspace_glyphs (ctx->out, ctx->out->used + n);
+}
+
 static int run_command (int, int, int, int, FontLayoutContext *);
 static int run_otf (int, MFLTOtfSpec *, int, int, FontLayoutContext *);
 static int try_otf (int, MFLTOtfSpec *, int, int, FontLayoutContext *);
 
-#define NMATCH 20
+/* Return the length of the longest match of RE at the head of STR of
+   length LEN, or -1 if RE doesn't match.  */
+
+static int
+regex_match_length (FontLayoutRegex *re, unsigned char *str, int len)
+{
+  int state = 0, i, matched = -1;
+
+  for (i = 0; ; i++)
+    {
+      if (re->accept[state] & REGEX_ACCEPT)
+	matched = i;
+      if (i == len)
+	{
+	  if (re->accept[state] & REGEX_ACCEPT_AT_END)
+	    matched = i;
+	  break;
+	}
+      state = re->trans[state * re->nclasses + re->classes[str[i]]];
+      if (state < 0)
+	break;
+    }
+  return matched;
+}
+
+typedef struct
+{
+  FontLayoutRegex *re;
+  unsigned char *str;
+  int len, end;
+  /* LIVE[POS * ninsts + PC] is nonzero iff the instruction PC at the
+     position POS can lead to the match ending at END.  */
+  char *live;
+  int *slots;
+  int *iterations, *iteration_start;
+  int steps;
+} FontLayoutRegexSearch;
+
+#define REGEX_LIVE(search, pc, pos)	\
+  ((search)->live[(pos) * (search)->re->ninsts + (pc)])
+
+static void
+compute_regex_live (FontLayoutRegexSearch *search)
+{
+  FontLayoutRegex *re = search->re;
+  int pos, pc, changed;
+
+  memset (search->live, 0, re->ninsts * (search->end + 1));
+  for (pos = search->end; pos >= 0; pos--)
+    do {
+      changed = 0;
+      for (pc = re->ninsts - 1; pc >= 0; pc--)
+	{
+	  FontLayoutRegexInst *inst = re->insts + pc;
+	  int live = 0;
+
+	  if (REGEX_LIVE (search, pc, pos))
+	    continue;
+	  switch (inst->op)
+	    {
+	    case REGEX_CHAR:
+	      live = (pos < search->end
+		      && REGEX_SET_HAS (re->sets + inst->x, search->str[pos])
+		      && REGEX_LIVE (search, pc + 1, pos + 1));
+	      break;
+	    case REGEX_MATCH:
+	      live = pos == search->end;
+	      break;
+	    case REGEX_SPLIT:
+	      live = (REGEX_LIVE (search, inst->x, pos)
+		      || REGEX_LIVE (search, inst->y, pos));
+	      break;
+	    case REGEX_JUMP:
+	      live = REGEX_LIVE (search, inst->x, pos);
+	      break;
+	    case REGEX_ITER:
+	      if (inst->y >= 0)
+		{
+		  live = (REGEX_LIVE (search, inst->x, pos)
+			  || REGEX_LIVE (search, inst->y, pos));
+		  break;
+		}
+	      /* Fall through.  */
+	    case REGEX_SAVE: case REGEX_ENTER:
+	      live = REGEX_LIVE (search, pc + 1, pos);
+	      break;
+	    case REGEX_BOL:
+	      live = pos == 0 && REGEX_LIVE (search, pc + 1, pos);
+	      break;
+	    case REGEX_EOL:
+	      live = pos == search->len && REGEX_LIVE (search, pc + 1, pos);
+	      break;
+	    }
+	  if (live)
+	    REGEX_LIVE (search, pc, pos) = 1, changed = 1;
+	}
+    } while (changed);
+}
+
+/* Search for the path from the instruction PC at the position POS to
+   the match.  Alternatives are tried from the left, and repetitions
+   are greedy.  An optional iteration matching nothing is taken only
+   as the first one.  Return 1 if found, 0 if not found, and -1 if it
+   takes too many steps.  */
+
+static int
+search_regex_path (FontLayoutRegexSearch *search, int pc, int pos)
+{
+  FontLayoutRegexInst *inst;
+  int result;
+
+  if (! REGEX_LIVE (search, pc, pos))
+    return 0;
+  if (++search->steps > REGEX_MAX_STEPS)
+    return -1;
+  inst = search->re->insts + pc;
+  switch (inst->op)
+    {
+    case REGEX_CHAR:
+      return search_regex_path (search, pc + 1, pos + 1);
+
+    case REGEX_MATCH:
+      return 1;
+
+    case REGEX_SPLIT:
+      result = search_regex_path (search, inst->x, pos);
+      return (result ? result : search_regex_path (search, inst->y, pos));
+
+    case REGEX_JUMP:
+      return search_regex_path (search, inst->x, pos);
+
+    case REGEX_SAVE:
+      {
+	int saved = search->slots[inst->x];
+
+	search->slots[inst->x] = pos;
+	result = search_regex_path (search, pc + 1, pos);
+	if (result <= 0)
+	  search->slots[inst->x] = saved;
+	return result;
+      }
+
+    case REGEX_ENTER: case REGEX_ITER:
+      {
+	int loop = inst->loop, next;
+	int saved_iterations = search->iterations[loop];
+	int saved_start = search->iteration_start[loop];
+
+	if (inst->op == REGEX_ENTER)
+	  search->iterations[loop] = 0, next = pc + 1;
+	else if (inst->y < 0)
+	  search->iterations[loop]++, next = pc + 1;
+	else if (pos == search->iteration_start[loop])
+	  {
+	    if (search->iterations[loop] > 0)
+	      return 0;
+	    next = inst->x;
+	  }
+	else
+	  search->iterations[loop]++, next = inst->y;
+	search->iteration_start[loop] = pos;
+	result = search_regex_path (search, next, pos);
+	search->iterations[loop] = saved_iterations;
+	search->iteration_start[loop] = saved_start;
+	return result;
+      }
+
+    default:
+      /* REGEX_BOL and REGEX_EOL are already checked by LIVE.  */
+      return search_regex_path (search, pc + 1, pos);
+    }
+}
+
+/* Store the positions of the subexpressions of the match of RE
+   ending at END in STR of length LEN into MATCH_INDICES.  Return 0 on
+   success, -1 if the search is given up.  */
+
+static int
+regex_subexpressions (FontLayoutRegex *re, unsigned char *str, int len,
+		      int end, int *match_indices)
+{
+  FontLayoutRegexSearch search;
+  int nslots = (re->ngroups + 1) * 2;
+  int live_size = re->ninsts * (end + 1);
+  int i, result;
+
+  search.re = re;
+  search.str = str;
+  search.len = len;
+  search.end = end;
+  search.live = live_size <= 0x4000 ? alloca (live_size) : malloc (live_size);
+  if (! search.live)
+    return -1;
+  search.slots = alloca (sizeof (int) * nslots);
+  search.iterations = alloca (sizeof (int) * (re->nloops * 2 + 1));
+  search.iteration_start = search.iterations + re->nloops;
+  search.steps = 0;
+  for (i = 0; i < nslots; i++)
+    search.slots[i] = -1;
+  compute_regex_live (&search);
+  result = search_regex_path (&search, 0, 0);
+  if (live_size > 0x4000)
+    free (search.live);
+  if (result <= 0)
+    return -1;
+  for (i = 2; i < nslots && i < NMATCH * 2; i++)
+    match_indices[i] = search.slots[i];
+  return 0;
+}
+
+/* Match the regular expression of the rule RULE at the head
+   of the category letters STR of length LEN, and store the positions
+   of the match and its subexpressions relative to STR into
+   MATCH_INDICES.  Return the length of the match, or -1 if not
+   matched.  */
+
+static int
+match_regex (FontLayoutCmdRule *rule, char *str, int len, int *match_indices)
+{
+  FontLayoutRegex *re = rule->src.re.compiled;
+  regmatch_t pmatch[NMATCH];
+  char *nul = memchr (str, '\0', len);
+  char saved_code;
+  int i, result;
+
+  if (nul)
+    len = nul - str;
+  for (i = 0; i < NMATCH * 2; i++)
+    match_indices[i] = -1;
+  if (re)
+    {
+      int end = regex_match_length (re, (unsigned char *) str, len);
+
+      if (end < 0)
+	return -1;
+      match_indices[0] = 0;
+      match_indices[1] = end;
+      if (re->ngroups == 0
+	  || regex_subexpressions (re, (unsigned char *) str, len, end,
+				   match_indices) == 0)
+	return end;
+    }
+
+  /* RULE may be shared by threads.  */
+  FLT_LOCK ();
+  if (rule->src.re.preg_state == 0)
+    rule->src.re.preg_state = (regcomp (&rule->src.re.preg,
+					rule->src.re.pattern, REG_EXTENDED)
+			       ? -1 : 1);
+  result = rule->src.re.preg_state;
+  FLT_UNLOCK ();
+  if (result < 0)
+    return -1;
+  saved_code = str[len];
+  str[len] = '\0';
+  result = regexec (&rule->src.re.preg, str, NMATCH, pmatch, 0);
+  str[len] = saved_code;
+  if (result != 0 || pmatch[0].rm_so != 0)
+    return -1;
+  for (i = 0; i < NMATCH; i++)
+    if (pmatch[i].rm_so >= 0)
+      {
+	match_indices[i * 2] = pmatch[i].rm_so;
+	match_indices[i * 2 + 1] = pmatch[i].rm_eo;
+      }
+  return pmatch[0].rm_eo;
+}
 
 static int
 run_rule (int depth,
@@ -1615,43 +3679,29 @@ run_rule (int depth,
 
   if (rule->src_type == SRC_REGEX)
     {
-      regmatch_t pmatch[NMATCH];
-      char saved_code;
-      int result;
+      int len;
 
       if (from > to)
 	return 0;
-      saved_code = ctx->encoded[to - ctx->encoded_offset];
-      ctx->encoded[to - ctx->encoded_offset] = '\0';
-      result = regexec (&(rule->src.re.preg),
-			ctx->encoded + (from - ctx->encoded_offset),
-			NMATCH, pmatch, 0);
-      if (result == 0 && pmatch[0].rm_so == 0)
-	{
-	  if (MDEBUG_FLAG () > 2)
-	    MDEBUG_PRINT5 ("\n [FLT] %*s(REGEX \"%s\" \"%s\" %d", depth, "",
-			   rule->src.re.pattern,
-			   ctx->encoded + (from - ctx->encoded_offset),
-			   pmatch[0].rm_eo);
-	  ctx->encoded[to - ctx->encoded_offset] = saved_code;
-	  for (i = 0; i < NMATCH; i++)
-	    {
-	      if (pmatch[i].rm_so < 0)
-		match_indices[i * 2] = match_indices[i * 2 + 1] = -1;
-	      else
-		{
-		  match_indices[i * 2] = from + pmatch[i].rm_so;
-		  match_indices[i * 2 + 1] = from + pmatch[i].rm_eo;
-		}
-	    }
-	  ctx->match_indices = match_indices;
-	  to = match_indices[1];
-	}
-      else
+      len = match_regex (rule, ctx->encoded + (from - ctx->encoded_offset),
+			 to - from, match_indices);
+      if (len < 0)
+	return 0;
+      if (MDEBUG_FLAG () > 2)
 	{
+	  char saved_code = ctx->encoded[to - ctx->encoded_offset];
+
+	  ctx->encoded[to - ctx->encoded_offset] = '\0';
+	  MDEBUG_PRINT5 ("\n [FLT] %*s(REGEX \"%s\" \"%s\" %d", depth, "",
+			 rule->src.re.pattern,
+			 ctx->encoded + (from - ctx->encoded_offset), len);
 	  ctx->encoded[to - ctx->encoded_offset] = saved_code;
-	  return 0;
 	}
+      for (i = 0; i < NMATCH * 2; i++)
+	if (match_indices[i] >= 0)
+	  match_indices[i] += from;
+      ctx->match_indices = match_indices;
+      to = match_indices[1];
       need_cluster_update = 1;
     }
   else if (rule->src_type == SRC_SEQ)
@@ -1690,7 +3740,7 @@ run_rule (int depth,
     }
   else if (rule->src_type == SRC_INDEX)
     {
-      if (rule->src.match_idx >= NMATCH)
+      if (rule->src.match_idx < 0 || rule->src.match_idx >= NMATCH)
 	return 0;
       from = ctx->match_indices[rule->src.match_idx * 2];
       if (from < 0)
@@ -1704,28 +3754,20 @@ run_rule (int depth,
   else if (rule->src_type == SRC_HAS_GLYPH
 	   || rule->src_type == SRC_OTF_SPEC)
     {
-      static MFLTGlyphString gstring;
+      MFLTGlyphString gstring;
       MPlist *p;
       int idx;
 
+      memset (&gstring, 0, sizeof gstring);
+      gstring.glyph_size = ctx->in->glyph_size;
       if (rule->src.facility.len > 0)
 	{
-	  if (! gstring.glyph_size)
-	    {
-	      gstring.glyph_size = ctx->in->glyph_size;
-	      gstring.glyphs = calloc (rule->src.facility.len,
-				       gstring.glyph_size);
-	      gstring.allocated = rule->src.facility.len;
-	      gstring.used = rule->src.facility.len;
-	    }
-	  else if (rule->src.facility.len < gstring.allocated)
-	    {
-	      gstring.glyphs = realloc (gstring.glyphs,
-					gstring.glyph_size
-					* rule->src.facility.len);
-	      gstring.allocated = rule->src.facility.len;
-	      gstring.used = rule->src.facility.len;
-	    }
+	  gstring.glyphs = alloca (gstring.glyph_size
+				   * rule->src.facility.len);
+	  memset (gstring.glyphs, 0,
+		  gstring.glyph_size * rule->src.facility.len);
+	  gstring.allocated = rule->src.facility.len;
+	  gstring.used = rule->src.facility.len;
 
 	  for (i = 0, p = rule->src.facility.codes, idx = from;
 	       i < rule->src.facility.len; i++, p = MPLIST_NEXT (p))
@@ -1781,6 +3823,7 @@ run_rule (int depth,
 		  int prev_out_used = ctx->out->used, out_used;
 		  MFLTGlyphAdjustment *adjustment;
 
+		  reserve_output (ctx, rule->src.facility.len);
 		  adjustment = alloca ((sizeof *adjustment)
 				       * (ctx->out->allocated - ctx->out->used));
 		  if (! adjustment)
@@ -1924,7 +3967,7 @@ run_otf (int depth,
   font->get_glyph_id (font, ctx->in, from, to);
   if (! font->drive_otf)
     {
-      if (ctx->out->used + (to - from) > ctx->out->allocated)
+      if (reserve_output (ctx, to - from) < 0)
 	return -2;
       font->get_metrics (font, ctx->in, from, to);
       GCPY (ctx->in, from, to - from, ctx->out, ctx->out->used);
@@ -1934,18 +3977,29 @@ run_otf (int depth,
     {
       MFLTGlyphAdjustment *adjustment;
       int out_len;
-      int i;
+      int i, result;
 
-      adjustment = alloca ((sizeof *adjustment)
-			   * (ctx->out->allocated - ctx->out->used));
-      if (! adjustment)
-	MERROR (MERROR_FLT, -1);
-      memset (adjustment, 0,
-	      (sizeof *adjustment) * (ctx->out->allocated - ctx->out->used));
-      to = font->drive_otf (font, otf_spec, ctx->in, from, to, ctx->out,
-			    adjustment);
-      if (to < 0)
-	return to;
+      reserve_output (ctx, to - from);
+      while (1)
+	{
+	  adjustment = alloca ((sizeof *adjustment)
+			       * (ctx->out->allocated - ctx->out->used));
+	  if (! adjustment)
+	    MERROR (MERROR_FLT, -1);
+	  memset (adjustment, 0,
+		  (sizeof *adjustment) * (ctx->out->allocated - ctx->out->used));
+	  result = font->drive_otf (font, otf_spec, ctx->in, from, to,
+				    ctx->out, adjustment);
+	  /* If OUT is in a workspace, extend it and try again instead
+	     of making the caller restart the whole layout.  */
+	  if (result != -2
+	      || reserve_output (ctx, ctx->out->allocated) < 0)
+	    break;
+	  ctx->out->used = from_idx;
+	}
+      if (result < 0)
+	return result;
+      to = result;
       decode_packed_otf_tag (ctx, ctx->out, from_idx, ctx->out->used,
 			     ctx->category);
       out_len = ctx->out->used - from_idx;
@@ -2067,10 +4121,11 @@ try_otf (int depth, MFLTOtfSpec *otf_spec, int from, int to,
   return from;
 }
 
-static char work[16];
+/* Store the textual form of the combining code CODE in WORK, which
+   must have 16 bytes at least, and return it.  */
 
 static char *
-dump_combining_code (int code)
+dump_combining_code (int code, char *work)
 {
   char *vallign = "tcbB";
   char *hallign = "lcr";
@@ -2101,6 +4156,24 @@ dump_combining_code (int code)
   return work;
 }
 
+/* Return the current time in microseconds for profiling.  */
+
+static double
+profile_clock (void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+#else  /* not CLOCK_MONOTONIC */
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec * 1000000.0 + tv.tv_usec;
+#endif	/* not CLOCK_MONOTONIC */
+}
+
 static int
 run_command (int depth, int id, int from, int to, FontLayoutContext *ctx)
 {
@@ -2157,10 +4230,13 @@ run_command (int depth, int id, int from, int to, FontLayoutContext *ctx)
     {
       int idx = CMD_ID_TO_INDEX (id);
       FontLayoutCmd *cmd;
+      double start = 0;
 
       if (idx >= ctx->stage->used)
 	MERROR (MERROR_DRAW, -1);
       cmd = ctx->stage->cmds + idx;
+      if (mflt_enable_profile)
+	start = profile_clock ();
       if (cmd->type == FontLayoutCmdTypeRule)
 	to = run_rule (depth, &cmd->body.rule, from, to, ctx);
       else if (cmd->type == FontLayoutCmdTypeCond)
@@ -2169,15 +4245,26 @@ run_command (int depth, int id, int from, int to, FontLayoutContext *ctx)
 	to = run_otf (depth, &cmd->body.otf, from, to, ctx);
       else if (cmd->type == FontLayoutCmdTypeOTFCategory)
 	to = try_otf (depth, &cmd->body.otf, from, to, ctx);
+      if (mflt_enable_profile)
+	{
+	  cmd->profile.calls++;
+	  if (to > 0
+	      || (to == 0 && cmd->type == FontLayoutCmdTypeRule
+		  && cmd->body.rule.src_type == SRC_INDEX))
+	    cmd->profile.matches++;
+	  cmd->profile.time += profile_clock () - start;
+	}
       return to;
     }
 
   if (id <= CMD_ID_OFFSET_COMBINING)
     {
+      char work[16];
+
       ctx->combining_code = CMD_ID_TO_COMBINING_CODE (id);
       if (MDEBUG_FLAG () > 2)
 	MDEBUG_PRINT3 ("\n [FLT] %*s(CMB %s)", depth, "",
-		       dump_combining_code (ctx->combining_code));
+		       dump_combining_code (ctx->combining_code, work));
       return from;
     }
 
@@ -2291,10 +4378,15 @@ run_stages (MFLTGlyphString *gstring, int from, int to,
 
   buf = *(ctx->in);
   buf.glyphs = NULL;
-  GINIT (ctx->out, ctx->out->allocated);
-  ctx->encoded = alloca (ctx->out->allocated);
-  if (! ctx->out->glyphs || ! ctx->encoded)
-    return -1;
+  if (ctx->workspace)
+    ctx->out->used = 0;
+  else
+    {
+      GINIT (ctx->out, ctx->out->allocated);
+      ctx->encoded = alloca (ctx->out->allocated);
+      if (! ctx->out->glyphs || ! ctx->encoded)
+	return -1;
+    }
 
   for (stage_idx = 0; 1; stage_idx++)
     {
@@ -2310,6 +4402,26 @@ run_stages (MFLTGlyphString *gstring, int from, int to,
 	ctx->category = ((FontLayoutStage *) MPLIST_VAL (stages))->category;
       ctx->code_offset = ctx->combining_code = ctx->left_padding = 0;
       ctx->encoded_offset = from;
+      if (ctx->workspace)
+	{
+	  MFLTWorkspace *workspace = ctx->workspace;
+
+	  if (workspace->encoded_size < to - from + 1)
+	    {
+	      int size = (workspace->encoded_size > 0
+			  ? workspace->encoded_size : 64);
+	      char *encoded;
+
+	      while (size < to - from + 1)
+		size *= 2;
+	      encoded = realloc (workspace->encoded, size);
+	      if (! encoded)
+		return -1;
+	      workspace->encoded = encoded;
+	      workspace->encoded_size = size;
+	    }
+	  ctx->encoded = workspace->encoded;
+	}
       for (i = from; i < to; i++)
 	{
 	  MFLTGlyph *g = GREF (ctx->in, i);
@@ -2370,7 +4482,11 @@ run_stages (MFLTGlyphString *gstring, int from, int to,
       prev_category = ctx->stage->category;
       temp = ctx->in;
       ctx->in = ctx->out;
-      if (buf.glyphs)
+      if (ctx->workspace)
+	ctx->out = (ctx->in == ctx->workspace->gstrings
+		    ? ctx->workspace->gstrings + 1
+		    : ctx->workspace->gstrings);
+      else if (buf.glyphs)
 	ctx->out = temp;
       else
 	{
@@ -2623,22 +4739,691 @@ configure_flt (MFLT *flt, MFLTFont *font, MSymbol font_id)
   configured->stages = mplist_copy (flt->stages);
   MPLIST_DO (plist, configured->stages)
     {
-      FontLayoutStage *stage = MPLIST_VAL (plist);
-      if (stage->category->definition)
+      FontLayoutStage *stage = MPLIST_VAL (plist);
+      if (stage->category->definition)
+	{
+	  MSTRUCT_CALLOC (stage, MERROR_FLT);
+	  *stage = *((FontLayoutStage *) MPLIST_VAL (plist));
+	  stage->category = configure_category (stage->category, font);
+	  MPLIST_VAL (plist) = stage;
+	}
+      else
+	M17N_OBJECT_REF (stage->category->table);
+    }
+  configured->need_config = 0;
+  configured->font_id = font_id;
+  mplist_push (flt_list, flt->name, configured);
+  return configured;
+}
+
+/* Shaping result cache.
+
+   If mflt_cache_size is positive, mflt_run () records glyphs that an
+   FLT produced from a sequence of characters in a font, and reuses
+   them when the same sequence is given in the same font again.  The
+   number of entries is limited to mflt_cache_size by discarding the
+   least recently used one.  */
+
+typedef struct
+{
+  MFLT *flt;
+  MSymbol font_id;
+  int x_ppem, y_ppem;
+  /* Number of input glyphs.  */
+  int len;
+  /* Character code and glyph code (or -1 if not yet encoded) of each
+     input glyph.  */
+  int *codes;
+  /* Index of the first character of the input glyphs.  */
+  int base;
+  unsigned hash;
+} FontLayoutCacheKey;
+
+typedef struct FontLayoutCacheEntry FontLayoutCacheEntry;
+
+struct FontLayoutCacheEntry
+{
+  /* Next entry in the same bucket.  */
+  FontLayoutCacheEntry *next;
+
+  /* Neighbors in the list of all entries ordered by recent use.  */
+  FontLayoutCacheEntry *prev_used, *next_used;
+
+  MFLT *flt;
+  MSymbol font_id;
+  int x_ppem, y_ppem;
+  unsigned hash;
+  int len;
+  int *codes;
+
+  /* Produced glyphs.  Their members <from> and <to> are relative to
+     the first character of the input glyphs.  */
+  int used;
+  MFLTGlyph *glyphs;
+};
+
+static FontLayoutCacheEntry **flt_cache_table;
+static int flt_cache_table_size;
+static int flt_cache_used;
+static FontLayoutCacheEntry *flt_cache_head, *flt_cache_tail;
+static int flt_cache_hits, flt_cache_misses;
+
+static void
+make_flt_cache_key (FontLayoutCacheKey *key, MFLT *flt, MSymbol font_id,
+		    MFLTFont *font, MFLTGlyphString *gstring, int from, int to)
+{
+  unsigned hash;
+  int i;
+
+  key->flt = flt;
+  key->font_id = font_id;
+  key->x_ppem = font->x_ppem;
+  key->y_ppem = font->y_ppem;
+  key->len = to - from;
+  key->base = GREF (gstring, from)->from;
+  hash = ((unsigned) (unsigned long) flt
+	  ^ (unsigned) (unsigned long) font_id
+	  ^ (unsigned) (font->x_ppem << 16) ^ (unsigned) font->y_ppem);
+  for (i = 0; i < key->len; i++)
+    {
+      MFLTGlyph *g = GREF (gstring, from + i);
+
+      key->codes[i * 2] = g->c;
+      key->codes[i * 2 + 1] = g->encoded ? (int) g->code : -1;
+      hash = (hash ^ key->codes[i * 2]) * 16777619;
+      hash = (hash ^ key->codes[i * 2 + 1]) * 16777619;
+    }
+  key->hash = hash;
+}
+
+static void
+unlink_flt_cache_entry (FontLayoutCacheEntry *entry)
+{
+  if (entry->prev_used)
+    entry->prev_used->next_used = entry->next_used;
+  else
+    flt_cache_head = entry->next_used;
+  if (entry->next_used)
+    entry->next_used->prev_used = entry->prev_used;
+  else
+    flt_cache_tail = entry->prev_used;
+}
+
+static void
+link_flt_cache_entry (FontLayoutCacheEntry *entry)
+{
+  entry->prev_used = NULL;
+  entry->next_used = flt_cache_head;
+  if (flt_cache_head)
+    flt_cache_head->prev_used = entry;
+  else
+    flt_cache_tail = entry;
+  flt_cache_head = entry;
+}
+
+static void
+remove_flt_cache_entry (FontLayoutCacheEntry *entry)
+{
+  FontLayoutCacheEntry **p;
+
+  for (p = flt_cache_table + (entry->hash % flt_cache_table_size);
+       *p != entry; p = &(*p)->next);
+  *p = entry->next;
+  unlink_flt_cache_entry (entry);
+  free (entry);
+  flt_cache_used--;
+}
+
+static void
+free_flt_cache (void)
+{
+  while (flt_cache_head)
+    remove_flt_cache_entry (flt_cache_head);
+  free (flt_cache_table);
+  flt_cache_table = NULL;
+  flt_cache_table_size = 0;
+}
+
+static FontLayoutCacheEntry *
+lookup_flt_cache (FontLayoutCacheKey *key)
+{
+  FontLayoutCacheEntry *entry;
+
+  if (flt_cache_table)
+    for (entry = flt_cache_table[key->hash % flt_cache_table_size];
+	 entry; entry = entry->next)
+      if (entry->hash == key->hash
+	  && entry->flt == key->flt
+	  && entry->font_id == key->font_id
+	  && entry->x_ppem == key->x_ppem
+	  && entry->y_ppem == key->y_ppem
+	  && entry->len == key->len
+	  && ! memcmp (entry->codes, key->codes, sizeof (int) * key->len * 2))
+	{
+	  if (entry != flt_cache_head)
+	    {
+	      unlink_flt_cache_entry (entry);
+	      link_flt_cache_entry (entry);
+	    }
+	  flt_cache_hits++;
+	  return entry;
+	}
+  flt_cache_misses++;
+  return NULL;
+}
+
+/* Record glyphs between FROM and TO of GSTRING as the result for
+   KEY.  */
+
+static void
+store_flt_cache (FontLayoutCacheKey *key, MFLTGlyphString *gstring,
+		 int from, int to)
+{
+  FontLayoutCacheEntry *entry;
+  int used = to - from;
+  int i;
+
+  while (flt_cache_used >= mflt_cache_size && flt_cache_tail)
+    remove_flt_cache_entry (flt_cache_tail);
+  if (flt_cache_table_size < mflt_cache_size)
+    {
+      /* Rehash with the new size.  */
+      FontLayoutCacheEntry **table;
+
+      if (! MTABLE_CALLOC_SAFE (table, mflt_cache_size))
+	return;
+      for (entry = flt_cache_head; entry; entry = entry->next_used)
+	{
+	  entry->next = table[entry->hash % mflt_cache_size];
+	  table[entry->hash % mflt_cache_size] = entry;
+	}
+      free (flt_cache_table);
+      flt_cache_table = table;
+      flt_cache_table_size = mflt_cache_size;
+    }
+
+  entry = malloc (sizeof (FontLayoutCacheEntry)
+		  + sizeof (MFLTGlyph) * used + sizeof (int) * key->len * 2);
+  if (! entry)
+    return;
+  entry->flt = key->flt;
+  entry->font_id = key->font_id;
+  entry->x_ppem = key->x_ppem;
+  entry->y_ppem = key->y_ppem;
+  entry->hash = key->hash;
+  entry->len = key->len;
+  entry->used = used;
+  entry->glyphs = (MFLTGlyph *) (entry + 1);
+  entry->codes = (int *) (entry->glyphs + used);
+  memcpy (entry->codes, key->codes, sizeof (int) * key->len * 2);
+  for (i = 0; i < used; i++)
+    {
+      entry->glyphs[i] = *GREF (gstring, from + i);
+      entry->glyphs[i].from -= key->base;
+      entry->glyphs[i].to -= key->base;
+    }
+  entry->next = flt_cache_table[key->hash % flt_cache_table_size];
+  flt_cache_table[key->hash % flt_cache_table_size] = entry;
+  link_flt_cache_entry (entry);
+  flt_cache_used++;
+}
+
+/* Replace glyphs between FROM and TO of GSTRING with those recorded
+   in ENTRY.  Members of GSTRING's glyphs other than those of
+   MFLTGlyph are copied from the glyph of the first character of each
+   recorded glyph.  Return the index next to the last replaced glyph,
+   or -2 if GSTRING is too short.  */
+
+static int
+apply_flt_cache (FontLayoutCacheEntry *entry, FontLayoutCacheKey *key,
+		 MFLTGlyphString *gstring, int from, int to)
+{
+  MFLTGlyphString buf;
+  int i;
+
+  if (gstring->allocated < gstring->used + entry->used - (to - from))
+    return -2;
+  buf = *gstring;
+  GINIT (&buf, entry->used);
+  for (i = 0; i < entry->used; i++)
+    {
+      MFLTGlyph *g = GREF (&buf, i);
+      int idx = from + entry->glyphs[i].from;
+
+      if (idx >= to)
+	idx = to - 1;
+      memcpy (g, GREF (gstring, idx), gstring->glyph_size);
+      *g = entry->glyphs[i];
+      g->from += key->base;
+      g->to += key->base;
+    }
+  GREPLACE (&buf, 0, entry->used, gstring, from, to);
+  return from + entry->used;
+}
+
+/* Find an FLT for C and FONT.  The caller must hold flt_lock.  */
+
+static MFLT *
+find_flt (int c, MFLTFont *font)
+{
+  MPlist *plist, *pl;
+  MFLT *flt;
+
+  if (! flt_list && list_flt () < 0)
+    return NULL;
+  if (font)
+    {
+      MFLT *best = NULL;
+      FontLayoutCandidates *candidates;
+      char *otf_memo = NULL;
+      int i;
+
+      if (! flt_dispatch_table && setup_flt_dispatch_table () < 0)
+	return NULL;
+      candidates = (c >= 0 ? mchartable_lookup (flt_dispatch_table, c)
+		    : flt_candidates);
+      if (! candidates)
+	return NULL;
+      for (i = 0; i < candidates->used; i++)
+	{
+	  int idx = candidates->indices[i];
+
+	  flt = flt_unicode_list[idx];
+	  if (flt->family && flt->family != font->family)
+	    continue;
+	  if (flt->otf.sym)
+	    {
+	      MFLTOtfSpec *spec = &flt->otf;
+
+	      if (! font->check_otf)
+		{
+		  if ((spec->features[0] && spec->features[0][0] != 0xFFFFFFFF)
+		      || (spec->features[1] && spec->features[1][0] != 0xFFFFFFFF))
+		    continue;
+		}
+	      else
+		{
+		  if (! otf_memo && mflt_font_id)
+		    {
+		      MSymbol font_id = mflt_font_id (font);
+
+		      if (font_id != Mnil)
+			otf_memo = flt_otf_memo_for (font_id);
+		    }
+		  if (! otf_memo)
+		    {
+		      if (! font->check_otf (font, spec))
+			continue;
+		    }
+		  else
+		    {
+		      if (! otf_memo[idx])
+			otf_memo[idx] = font->check_otf (font, spec) ? 1 : 2;
+		      if (otf_memo[idx] != 1)
+			continue;
+		    }
+		}
+	      goto found;
+	    }
+	  best = flt;
+	}
+      if (best == NULL)
+	return NULL;
+      flt = best;
+      goto found;
+    }
+  if (c >= 0)
+    {
+      /* Skip configured FLTs.  */
+      MPLIST_DO (plist, flt_list)
+	if (((MFLT *) MPLIST_VAL (plist))->font_id == Mnil)
+	  break;
+      MPLIST_DO (pl, plist)
+	{
+	  flt = MPLIST_VAL (pl);
+	  if (mchartable_lookup (flt->coverage->table, c))
+	    goto found;
+	}
+    }
+  return NULL;
+
+ found:
+  if (! CHECK_FLT_STAGES (flt))
+    return NULL;
+  if (font && flt->need_config && mflt_font_id)
+    flt = configure_flt (flt, font, mflt_font_id (font));
+  return flt;
+}
+
+/* Incremental layout.
+
+   mflt_run_incremental () splits a run of characters into segments,
+   each of which ends at white spaces or at the end of the run, and
+   lays them out separately.  The produced glyphs of each segment are
+   kept in MFLTResult so that the next call for the edited text can
+   reuse them for the segments at the head and the tail that are not
+   changed.  As FLTs don't combine characters across a white space,
+   the result is the same as laying out the whole run at once.
+
+   The glyphs are reused only for the same font, which is identified
+   by mflt_font_id () as the cache of mflt_run () does, not by the
+   address of MFLTFont that may be on stack.  */
+
+typedef struct
+{
+  /* Index of the first character relative to the head of the run.  */
+  int start;
+  /* Number of characters.  */
+  int len;
+  /* Character code and glyph code (or -1 if not yet encoded) of each
+     character.  */
+  int *codes;
+  /* Produced glyphs.  Their members <from> and <to> are relative to
+     the first character of the segment.  */
+  int used;
+  void *glyphs;
+  /* Result of the layout; 0 on success, -1 on error.  */
+  int status;
+} FontLayoutSegment;
+
+struct _MFLTResult
+{
+  MFLT *flt;
+  MSymbol font_id;
+  int x_ppem, y_ppem;
+  int glyph_size;
+  int used;
+  FontLayoutSegment *segments;
+};
+
+/* Arguments for layout_segments.  */
+
+typedef struct
+{
+  MFLTGlyphString *gstring;
+  int from;
+  MFLTFont *font;
+  MFLT *flt;
+  FontLayoutSegment *segments;
+  int nsegments;
+  /* Lay out every STEPth segment from the OFFSETth one.  */
+  int offset, step;
+} FontLayoutSegmentJob;
+
+/* Return 1 if C is a white space that ends a segment.  Zero width
+   characters and NO-BREAK SPACE are not, as FLTs may combine them
+   with the neighbors.  */
+
+#define SEGMENT_BREAK_P(c)				\
+  ((c) == ' ' || ((c) >= '\t' && (c) <= '\r')		\
+   || (c) == 0x1680 || ((c) >= 0x2000 && (c) <= 0x200A)	\
+   || (c) == 0x2028 || (c) == 0x2029 || (c) == 0x205F	\
+   || (c) == 0x3000)
+
+static void
+free_segments (FontLayoutSegment *segments, int used)
+{
+  int i;
+
+  for (i = 0; i < used; i++)
+    {
+      free (segments[i].codes);
+      free (segments[i].glyphs);
+    }
+  free (segments);
+}
+
+/* Lay out SEGMENT of JOB->gstring by mflt_run () in a separate glyph
+   string, and record the produced glyphs in SEGMENT.  */
+
+static void
+layout_segment (FontLayoutSegmentJob *job, FontLayoutSegment *segment)
+{
+  MFLTGlyphString gstring;
+  int size = job->gstring->glyph_size;
+  int result = -2;
+  int i;
+
+  gstring = *job->gstring;
+  gstring.r2l = 0;
+  gstring.allocated = segment->len * 4;
+  gstring.glyphs = NULL;
+  for (i = 0; i < 3 && result == -2; i++, gstring.allocated *= 2)
+    {
+      void *glyphs = realloc (gstring.glyphs, size * gstring.allocated);
+
+      if (! glyphs)
+	break;
+      gstring.glyphs = glyphs;
+      memcpy (gstring.glyphs,
+	      (char *) job->gstring->glyphs
+	      + size * (job->from + segment->start),
+	      size * segment->len);
+      gstring.used = segment->len;
+      result = mflt_run (&gstring, 0, segment->len, job->font, job->flt);
+    }
+  if (result < 0)
+    {
+      free (gstring.glyphs);
+      segment->status = -1;
+      return;
+    }
+  segment->glyphs = gstring.glyphs;
+  segment->used = result;
+  segment->status = 0;
+}
+
+static void *
+layout_segments (void *arg)
+{
+  FontLayoutSegmentJob *job = arg;
+  int i;
+
+  for (i = job->offset; i < job->nsegments; i += job->step)
+    if (! job->segments[i].glyphs)
+      layout_segment (job, job->segments + i);
+  return NULL;
+}
+
+#ifdef HAVE_PTHREAD
+
+/* Threads laying out segments.  They are created on demand, wait for
+   a job while idle, and are kept until m17n_fini_flt () so that
+   mflt_run_incremental () doesn't create threads on each call.  The
+   pool serves one caller at a time; the others lay out segments by
+   themselves.  */
+
+typedef struct
+{
+  pthread_t thread;
+  /* Nonzero if the thread is given a share of the current job.  */
+  int assigned;
+} FontLayoutThread;
+
+static struct
+{
+  pthread_mutex_t mutex;
+  /* Signaled when a share is assigned or the pool is shut down.  */
+  pthread_cond_t posted;
+  /* Signaled when the last assigned thread finishes its share.  */
+  pthread_cond_t finished;
+  FontLayoutThread *threads;
+  int nthreads;
+  /* Number of assigned threads that have not yet finished.  */
+  int pending;
+  int busy, quit;
+  /* The current job.  The Nth thread lays out the (N + 1)th share of
+     it.  */
+  FontLayoutSegmentJob job;
+} layout_pool;
+
+static pthread_once_t layout_pool_once = PTHREAD_ONCE_INIT;
+
+static void
+init_layout_pool (void)
+{
+  pthread_mutex_init (&layout_pool.mutex, NULL);
+  pthread_cond_init (&layout_pool.posted, NULL);
+  pthread_cond_init (&layout_pool.finished, NULL);
+}
+
+static void *
+layout_pool_thread (void *arg)
+{
+  int index = (long) arg;
+
+  pthread_mutex_lock (&layout_pool.mutex);
+  while (1)
+    {
+      FontLayoutSegmentJob job;
+
+      while (! layout_pool.quit && ! layout_pool.threads[index].assigned)
+	pthread_cond_wait (&layout_pool.posted, &layout_pool.mutex);
+      if (layout_pool.quit)
+	break;
+      layout_pool.threads[index].assigned = 0;
+      job = layout_pool.job;
+      job.offset = index + 1;
+      pthread_mutex_unlock (&layout_pool.mutex);
+      layout_segments (&job);
+      pthread_mutex_lock (&layout_pool.mutex);
+      if (--layout_pool.pending == 0)
+	pthread_cond_signal (&layout_pool.finished);
+    }
+  pthread_mutex_unlock (&layout_pool.mutex);
+  return NULL;
+}
+
+/* Make the pool have at least N threads if possible, and return the
+   number of threads available up to N.  The caller must hold the lock
+   of the pool.  */
+
+static int
+reserve_layout_threads (int n)
+{
+  if (layout_pool.nthreads < n)
+    {
+      FontLayoutThread *threads = realloc (layout_pool.threads,
+					   sizeof (FontLayoutThread) * n);
+
+      if (! threads)
+	return layout_pool.nthreads;
+      layout_pool.threads = threads;
+      for (; layout_pool.nthreads < n; layout_pool.nthreads++)
+	{
+	  FontLayoutThread *thread = threads + layout_pool.nthreads;
+
+	  thread->assigned = 0;
+	  if (pthread_create (&thread->thread, NULL, layout_pool_thread,
+			      (void *) (long) layout_pool.nthreads) != 0)
+	    break;
+	}
+    }
+  return layout_pool.nthreads < n ? layout_pool.nthreads : n;
+}
+
+static void
+free_layout_pool (void)
+{
+  int i;
+
+  if (! layout_pool.threads)
+    return;
+  pthread_mutex_lock (&layout_pool.mutex);
+  layout_pool.quit = 1;
+  pthread_cond_broadcast (&layout_pool.posted);
+  pthread_mutex_unlock (&layout_pool.mutex);
+  for (i = 0; i < layout_pool.nthreads; i++)
+    pthread_join (layout_pool.threads[i].thread, NULL);
+  free (layout_pool.threads);
+  layout_pool.threads = NULL;
+  layout_pool.nthreads = 0;
+  layout_pool.quit = 0;
+}
+
+#endif	/* HAVE_PTHREAD */
+
+/* Lay out the segments of JOB that have no glyphs yet.  Use at most
+   mflt_layout_threads threads if possible.  */
+
+static void
+run_segment_jobs (FontLayoutSegmentJob *job, int nsegments)
+{
+#ifdef HAVE_PTHREAD
+  int nthreads = (mflt_layout_threads < nsegments
+		  ? mflt_layout_threads : nsegments);
+
+  if (nthreads > 1)
+    {
+      pthread_once (&layout_pool_once, init_layout_pool);
+      pthread_mutex_lock (&layout_pool.mutex);
+      if (! layout_pool.busy)
+	nthreads = reserve_layout_threads (nthreads - 1) + 1;
+      if (! layout_pool.busy && nthreads > 1)
 	{
-	  MSTRUCT_CALLOC (stage, MERROR_FLT);
-	  *stage = *((FontLayoutStage *) MPLIST_VAL (plist));
-	  stage->category = configure_category (stage->category, font);
-	  MPLIST_VAL (plist) = stage;
+	  int i;
+
+	  layout_pool.busy = 1;
+	  layout_pool.job = *job;
+	  layout_pool.job.step = nthreads;
+	  layout_pool.pending = nthreads - 1;
+	  for (i = 0; i < nthreads - 1; i++)
+	    layout_pool.threads[i].assigned = 1;
+	  pthread_cond_broadcast (&layout_pool.posted);
+	  pthread_mutex_unlock (&layout_pool.mutex);
+
+	  /* This thread handles the first share.  */
+	  job->offset = 0;
+	  job->step = nthreads;
+	  layout_segments (job);
+
+	  pthread_mutex_lock (&layout_pool.mutex);
+	  while (layout_pool.pending > 0)
+	    pthread_cond_wait (&layout_pool.finished, &layout_pool.mutex);
+	  layout_pool.busy = 0;
+	  pthread_mutex_unlock (&layout_pool.mutex);
+	  return;
 	}
-      else
-	M17N_OBJECT_REF (stage->category->table);
+      pthread_mutex_unlock (&layout_pool.mutex);
+    }
+#endif	/* HAVE_PTHREAD */
+  job->offset = 0;
+  job->step = 1;
+  layout_segments (job);
+}
+
+static int
+same_segment_p (FontLayoutSegment *seg1, FontLayoutSegment *seg2)
+{
+  return (seg1->len == seg2->len
+	  && ! memcmp (seg1->codes, seg2->codes, sizeof (int) * seg1->len * 2));
+}
+
+/* Reorder glyphs between FROM and TO of GSTRING for right-to-left
+   display.  */
+
+static void
+reverse_glyphs (MFLTGlyphString *gstring, int from, int to)
+{
+  MFLTGlyphString out;
+  int len = to - from;
+  int i, j, k;
+
+  out = *gstring;
+  GINIT (&out, len);
+  memcpy (((char *) out.glyphs),
+	  ((char *) gstring->glyphs) + gstring->glyph_size * from,
+	  gstring->glyph_size * len);
+  for (i = from, j = to; i < to;)
+    {
+      for (k = i + 1, j--; k < to && GREF (&out, k)->xadv == 0;
+	   k++, j--);
+      GCPY (&out, i, (k - i), gstring, j);
+      i = k;
     }
-  configured->need_config = 0;
-  configured->font_id = font_id;
-  mplist_push (flt_list, flt->name, configured);
-  return configured;
 }
+
+
 
 /* Internal API */
 
@@ -2678,6 +5463,10 @@ m17n_init_flt (void)
   Mend = msymbol ("end");
 
   mflt_enable_new_feature = 0;
+  mflt_cache_size = 0;
+  mflt_use_compiled_cache = 0;
+  mflt_enable_profile = 0;
+  mflt_layout_threads = 0;
   mflt_iterate_otf_feature = NULL;
   mflt_font_id = NULL;
   mflt_try_otf = NULL;
@@ -2696,6 +5485,10 @@ m17n_fini_flt (void)
     return;
 
   MDEBUG_PUSH_TIME ();
+#ifdef HAVE_PTHREAD
+  free_layout_pool ();
+#endif
+  free_flt_cache ();
   free_flt_list ();
   MDEBUG_PRINT_TIME ("FINI", (mdebug__output, " to finalize the flt modules."));
   MDEBUG_POP_TIME ();
@@ -2731,21 +5524,23 @@ m17n_fini_flt (void)
 MFLT *
 mflt_get (MSymbol name)
 {
-  MFLT *flt;
+  MFLT *flt = NULL;
   MPlist *plist;
 
-  if (! flt_list && list_flt () < 0)
-    return NULL;
-  for (plist = flt_list; plist; plist = plist->next)
-    if (((MFLT *) MPLIST_VAL (plist))->font_id == Mnil)
-      break;
-  flt = mplist_get (plist, name);
-  if (! flt || ! CHECK_FLT_STAGES (flt))
-    return NULL;
-  if (flt->name == Mcombining
-      && ! mchartable_lookup (flt->coverage->table, 0))
-    setup_combining_flt (flt);
-
+  FLT_LOCK ();
+  if (flt_list || list_flt () == 0)
+    {
+      for (plist = flt_list; plist; plist = plist->next)
+	if (((MFLT *) MPLIST_VAL (plist))->font_id == Mnil)
+	  break;
+      flt = mplist_get (plist, name);
+      if (flt && ! CHECK_FLT_STAGES (flt))
+	flt = NULL;
+      if (flt && flt->name == Mcombining
+	  && ! mchartable_lookup (flt->coverage->table, 0))
+	setup_combining_flt (flt);
+    }
+  FLT_UNLOCK ();
   return flt;
 }
 
@@ -2773,77 +5568,11 @@ mflt_get (MSymbol name)
 MFLT *
 mflt_find (int c, MFLTFont *font)
 {
-  MPlist *plist, *pl;
   MFLT *flt;
-  static MSymbol unicode_bmp = NULL, unicode_full = NULL;
-
-  if (! unicode_bmp)
-    {
-      unicode_bmp = msymbol ("unicode-bmp");
-      unicode_full = msymbol ("unicode-full");
-    }
-
-  if (! flt_list && list_flt () < 0)
-    return NULL;
-  /* Skip configured FLTs.  */
-  MPLIST_DO (plist, flt_list)
-    if (((MFLT *) MPLIST_VAL (plist))->font_id == Mnil)
-      break;
-  if (font)
-    {
-      MFLT *best = NULL;
-
-      MPLIST_DO (pl, plist)
-	{
-	  flt = MPLIST_VAL (pl);
-	  if (flt->registry != unicode_bmp
-	      && flt->registry != unicode_full)
-	    continue;
-	  if (flt->family && flt->family != font->family)
-	    continue;
-	  if (flt->name == Mcombining
-	      && ! mchartable_lookup (flt->coverage->table, 0))
-	    setup_combining_flt (flt);
-	  if (c >= 0
-	      && ! mchartable_lookup (flt->coverage->table, c))
-	    continue;
-	  if (flt->otf.sym)
-	    {
-	      MFLTOtfSpec *spec = &flt->otf;
-
-	      if (! font->check_otf)
-		{
-		  if ((spec->features[0] && spec->features[0][0] != 0xFFFFFFFF)
-		      || (spec->features[1] && spec->features[1][0] != 0xFFFFFFFF))
-		    continue;
-		}
-	      else if (! font->check_otf (font, spec))
-		continue;
-	      goto found;
-	    }
-	  best = flt;
-	}
-      if (best == NULL)
-	return NULL;
-      flt = best;
-      goto found;
-    }
-  if (c >= 0)
-    {
-      MPLIST_DO (pl, plist)
-	{
-	  flt = MPLIST_VAL (pl);
-	  if (mchartable_lookup (flt->coverage->table, c))
-	    goto found;
-	}
-    }
-  return NULL;
 
- found:
-  if (! CHECK_FLT_STAGES (flt))
-    return NULL;
-  if (font && flt->need_config && mflt_font_id)
-    flt = configure_flt (flt, font, mflt_font_id (font));
+  FLT_LOCK ();
+  flt = find_flt (c, font);
+  FLT_UNLOCK ();
   return flt;
 }
 
@@ -2926,15 +5655,84 @@ mflt_coverage (MFLT *flt)
 int
 mflt_run (MFLTGlyphString *gstring, int from, int to,
 	  MFLTFont *font, MFLT *flt)
+{
+  return mflt_run_with_workspace (gstring, from, to, font, flt, NULL);
+}
+
+/*=*/
+
+/***en
+    @brief Create a shaping workspace.
+
+    The mflt_create_workspace () function creates a workspace to be
+    given to mflt_run_with_workspace ().  The workspace keeps the
+    buffers used while shaping so that they are reused by the later
+    calls.
+
+    @return
+    This function returns a pointer to the created workspace, or NULL
+    on memory shortage.  */
+
+MFLTWorkspace *
+mflt_create_workspace (void)
+{
+  MFLTWorkspace *workspace = calloc (1, sizeof (MFLTWorkspace));
+
+  return workspace;
+}
+
+/*=*/
+
+/***en
+    @brief Destroy a shaping workspace.
+
+    The mflt_destroy_workspace () function frees WORKSPACE created by
+    mflt_create_workspace () and the buffers in it.  */
+
+void
+mflt_destroy_workspace (MFLTWorkspace *workspace)
+{
+  if (! workspace)
+    return;
+  free (workspace->gstrings[0].glyphs);
+  free (workspace->gstrings[1].glyphs);
+  free (workspace->encoded);
+  free (workspace);
+}
+
+/*=*/
+
+/***en
+    @brief Layout characters using a workspace.
+
+    The mflt_run_with_workspace () function is the same as mflt_run ()
+    except that it uses the buffers in WORKSPACE instead of allocating
+    them on each call.  The buffers are grown as necessary and kept
+    for the later calls, which avoids the reallocation and the restart
+    of the whole layout when the initial guess of the output size is
+    too small.
+
+    A workspace must not be used by more than one thread at a time.
+    If WORKSPACE is NULL, this function is the same as mflt_run ().
+
+    @return
+    The return value is the same as that of mflt_run ().  */
+
+int
+mflt_run_with_workspace (MFLTGlyphString *gstring, int from, int to,
+			 MFLTFont *font, MFLT *flt, MFLTWorkspace *workspace)
 {
   FontLayoutContext ctx;
   int match_indices[NMATCH];
   MFLTGlyph *g;
   MFLTGlyphString out;
   int auto_flt = ! flt;
-  int c, i, j, k;
+  int c, i, j;
   int this_from, this_to;
   MSymbol font_id = mflt_font_id ? mflt_font_id (font) : Mnil;
+  FontLayoutCacheKey key;
+  FontLayoutCacheEntry *entry;
+  int use_cache = mflt_cache_size > 0 && font_id != Mnil;
 
   out = *gstring;
   out.glyphs = NULL;
@@ -2943,6 +5741,23 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
      allocating size of ctx.encoded.  */
   out.allocated = (to - from) * 4;
 
+  if (workspace)
+    for (i = 0; i < 2; i++)
+      {
+	MFLTGlyphString *ws_out = workspace->gstrings + i;
+	void *glyphs = ws_out->glyphs;
+	int allocated = ws_out->allocated;
+
+	if (glyphs && ws_out->glyph_size != gstring->glyph_size)
+	  allocated = allocated * ws_out->glyph_size / gstring->glyph_size;
+	*ws_out = *gstring;
+	ws_out->glyphs = glyphs;
+	ws_out->allocated = glyphs ? allocated : 0;
+	ws_out->used = 0;
+	if (reserve_workspace_glyphs (ws_out, out.allocated) < 0)
+	  MERROR (MERROR_FLT, -1);
+      }
+
   for (i = from; i < to; i++)
     {
       g = GREF (gstring, i);
@@ -2966,8 +5781,10 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
 	}
       else
 	{
+	  FLT_LOCK ();
 	  if (! flt_list && list_flt () < 0)
 	    {
+	      FLT_UNLOCK ();
 	      font->get_glyph_id (font, gstring, this_from, to);
 	      font->get_metrics (font, gstring, this_from, to);
 	      this_from = to;
@@ -2988,7 +5805,7 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
 		  flt = font->internal;
 		  break;
 		}
-	      flt = mflt_find (c, font);
+	      flt = find_flt (c, font);
 	      if (flt)
 		{
 		  if (CHECK_FLT_STAGES (flt))
@@ -2998,6 +5815,7 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
 		    }
 		}
 	    }
+	  FLT_UNLOCK ();
 	}
 
       if (this_from < this_to)
@@ -3012,7 +5830,11 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
       MDEBUG_PRINT1 (" [FLT] (%s", MSYMBOL_NAME (flt->name));
 
       if (flt->need_config && font_id != Mnil)
-	flt = configure_flt (flt, font, font_id);
+	{
+	  FLT_LOCK ();
+	  flt = configure_flt (flt, font, font_id);
+	  FLT_UNLOCK ();
+	}
 
       for (; this_to < to; this_to++)
 	{
@@ -3038,19 +5860,54 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
 	  MDEBUG_PRINT (")");
 	}
 
-      for (i = 0; i < 3; i++)
+      entry = NULL;
+      FLT_LOCK ();
+      if (use_cache)
 	{
-	  /* Setup CTX.  */
-	  memset (&ctx, 0, sizeof ctx);
-	  ctx.match_indices = match_indices;
-	  ctx.font = font;
-	  ctx.cluster_begin_idx = -1;
-	  ctx.in = gstring;
-	  ctx.out = &out;
-	  j = run_stages (gstring, this_from, this_to, flt, &ctx);
-	  if (j != -2)
-	    break;
-	  out.allocated *= 2;
+	  key.codes = alloca (sizeof (int) * (this_to - this_from) * 2);
+	  make_flt_cache_key (&key, flt, font_id, font,
+			      gstring, this_from, this_to);
+	  entry = lookup_flt_cache (&key);
+	  if (entry)
+	    j = apply_flt_cache (entry, &key, gstring, this_from, this_to);
+	}
+      else if (flt_cache_table)
+	free_flt_cache ();
+      FLT_UNLOCK ();
+
+      if (! entry)
+	{
+	  for (i = 0; i < 3; i++)
+	    {
+	      /* Setup CTX.  */
+	      memset (&ctx, 0, sizeof ctx);
+	      ctx.match_indices = match_indices;
+	      ctx.font = font;
+	      ctx.cluster_begin_idx = -1;
+	      ctx.in = gstring;
+	      ctx.out = &out;
+	      if (workspace)
+		{
+		  ctx.workspace = workspace;
+		  ctx.out = workspace->gstrings;
+		}
+	      j = run_stages (gstring, this_from, this_to, flt, &ctx);
+	      if (j != -2)
+		break;
+	      out.allocated *= 2;
+	      if (workspace
+		  && (reserve_workspace_glyphs (workspace->gstrings,
+						out.allocated) < 0
+		      || reserve_workspace_glyphs (workspace->gstrings + 1,
+						   out.allocated) < 0))
+		MERROR (MERROR_FLT, -1);
+	    }
+	  if (j >= 0 && use_cache)
+	    {
+	      FLT_LOCK ();
+	      store_flt_cache (&key, gstring, this_from, j);
+	      FLT_UNLOCK ();
+	    }
 	}
 
       if (j < 0)
@@ -3090,25 +5947,269 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
     }
 
   if (gstring->r2l)
+    reverse_glyphs (gstring, from, to);
+
+  return to;
+}
+
+/*=*/
+
+/***en
+    @brief Create an object to hold a result of mflt_run_incremental ().
+
+    The mflt_create_result () function creates an object to be given
+    to mflt_run_incremental ().
+
+    @return
+    This function returns a pointer to the created object, or NULL on
+    memory shortage.  */
+
+MFLTResult *
+mflt_create_result (void)
+{
+  MFLTResult *result = calloc (1, sizeof (MFLTResult));
+
+  return result;
+}
+
+/*=*/
+
+/***en
+    @brief Destroy an object holding a result of mflt_run_incremental ().
+
+    The mflt_destroy_result () function frees RESULT created by
+    mflt_create_result ().  */
+
+void
+mflt_destroy_result (MFLTResult *result)
+{
+  if (! result)
+    return;
+  free_segments (result->segments, result->used);
+  free (result);
+}
+
+/*=*/
+
+/***en
+    @brief Layout characters incrementally.
+
+    The mflt_run_incremental () function is the same as mflt_run ()
+    except that it splits the characters into segments at white spaces
+    and lays out each segment separately.  The produced glyphs are kept in
+    $RESULT, and if the leading or trailing segments have the same
+    characters as those of the previous call with $RESULT, their
+    glyphs are reused instead of being laid out again.  So, when a
+    text is edited, only the segments touched by the edit are laid out
+    again by giving the same $RESULT.  $RESULT is reset if $FLT or the
+    size of $FONT differs from the previous call.  Fonts are told apart
+    by #mflt_font_id, not by the address of $FONT, so nothing is reused
+    if #mflt_font_id is NULL or returns #Mnil for $FONT.
+
+    If the variable #mflt_layout_threads is greater than 1 and the
+    library is built with the thread support, the segments are laid
+    out in that number of threads in parallel.  The threads are kept
+    for the later calls until the library is finalized.  In that case, the
+    callback functions of $FONT must be safe to be called from
+    multiple threads.
+
+    If $RESULT is NULL, this function is the same as mflt_run ().
+
+    @return
+    The return value is the same as that of mflt_run ().  */
+
+int
+mflt_run_incremental (MFLTGlyphString *gstring, int from, int to,
+		      MFLTFont *font, MFLT *flt, MFLTResult *result)
+{
+  FontLayoutSegment *segments;
+  FontLayoutSegmentJob job;
+  MFLTGlyphString buf;
+  MSymbol font_id;
+  int nsegments, head, tail, nglyphs;
+  int i, j;
+
+  if (! result)
+    return mflt_run (gstring, from, to, font, flt);
+  font_id = mflt_font_id ? mflt_font_id (font) : Mnil;
+  if (result->flt != flt || font_id == Mnil || result->font_id != font_id
+      || result->x_ppem != font->x_ppem || result->y_ppem != font->y_ppem
+      || result->glyph_size != gstring->glyph_size)
+    {
+      free_segments (result->segments, result->used);
+      result->segments = NULL;
+      result->used = 0;
+      result->flt = flt;
+      result->font_id = font_id;
+      result->x_ppem = font->x_ppem;
+      result->y_ppem = font->y_ppem;
+      result->glyph_size = gstring->glyph_size;
+    }
+
+  for (i = from, nsegments = 0; i < to; i++)
+    if (i + 1 == to
+	|| (SEGMENT_BREAK_P (GREF (gstring, i)->c)
+	    && ! SEGMENT_BREAK_P (GREF (gstring, i + 1)->c)))
+      nsegments++;
+  if (nsegments == 0)
+    return to;
+  if (! MTABLE_CALLOC_SAFE (segments, nsegments))
+    MERROR (MERROR_FLT, -1);
+  for (i = from, j = 0; j < nsegments; j++)
+    {
+      FontLayoutSegment *segment = segments + j;
+      int k;
+
+      segment->start = i - from;
+      for (; i + 1 < to; i++)
+	if (SEGMENT_BREAK_P (GREF (gstring, i)->c)
+	    && ! SEGMENT_BREAK_P (GREF (gstring, i + 1)->c))
+	  break;
+      i++;
+      segment->len = i - from - segment->start;
+      if (! MTABLE_CALLOC_SAFE (segment->codes, segment->len * 2))
+	{
+	  free_segments (segments, nsegments);
+	  MERROR (MERROR_FLT, -1);
+	}
+      for (k = 0; k < segment->len; k++)
+	{
+	  MFLTGlyph *g = GREF (gstring, from + segment->start + k);
+
+	  segment->codes[k * 2] = g->c;
+	  segment->codes[k * 2 + 1] = g->encoded ? (int) g->code : -1;
+	}
+    }
+
+  /* Take over the glyphs of unchanged segments at the head and the
+     tail.  */
+  for (head = 0; head < nsegments && head < result->used; head++)
+    {
+      if (! same_segment_p (segments + head, result->segments + head))
+	break;
+      segments[head].glyphs = result->segments[head].glyphs;
+      segments[head].used = result->segments[head].used;
+      result->segments[head].glyphs = NULL;
+    }
+  for (tail = 0; tail < nsegments - head && tail < result->used - head;
+       tail++)
     {
-      int len = to - from;
+      FontLayoutSegment *segment = segments + nsegments - 1 - tail;
+      FontLayoutSegment *prev = result->segments + result->used - 1 - tail;
 
-      GINIT (&out, len);
-      memcpy (((char *) out.glyphs),
-	      ((char *) gstring->glyphs) + gstring->glyph_size * from,
-	      gstring->glyph_size * len);
-      for (i = from, j = to; i < to;)
+      if (! same_segment_p (segment, prev))
+	break;
+      segment->glyphs = prev->glyphs;
+      segment->used = prev->used;
+      prev->glyphs = NULL;
+    }
+  free_segments (result->segments, result->used);
+  result->segments = NULL;
+  result->used = 0;
+
+  job.gstring = gstring;
+  job.from = from;
+  job.font = font;
+  job.flt = flt;
+  job.segments = segments;
+  job.nsegments = nsegments;
+  run_segment_jobs (&job, nsegments - head - tail);
+
+  for (i = nglyphs = 0; i < nsegments; i++)
+    {
+      if (segments[i].status < 0)
 	{
-	  for (k = i + 1, j--; k < to && GREF (&out, k)->xadv == 0;
-	       k++, j--);
-	  GCPY (&out, i, (k - i), gstring, j);
-	  i = k;
+	  free_segments (segments, nsegments);
+	  MERROR (MERROR_FLT, -1);
 	}
+      nglyphs += segments[i].used;
     }
+  result->segments = segments;
+  result->used = nsegments;
+  if (gstring->allocated < gstring->used + nglyphs - (to - from))
+    return -2;
 
+  buf = *gstring;
+  buf.glyphs = malloc (gstring->glyph_size * nglyphs);
+  if (! buf.glyphs)
+    MERROR (MERROR_FLT, -1);
+  for (i = j = 0; i < nsegments; i++)
+    {
+      FontLayoutSegment *segment = segments + i;
+      int base = from + segment->start;
+      int k;
+
+      /* Members other than those of MFLTGlyph are copied from the
+	 glyph of the first character of each produced glyph, as the
+	 reused glyphs may have stale ones.  */
+      for (k = 0; k < segment->used; k++, j++)
+	{
+	  MFLTGlyph *g = GREF (&buf, j);
+	  MFLTGlyph *src = (MFLTGlyph *) ((char *) segment->glyphs
+					  + gstring->glyph_size * k);
+	  int idx = base + src->from;
+
+	  if (idx >= to)
+	    idx = to - 1;
+	  memcpy (g, GREF (gstring, idx), gstring->glyph_size);
+	  *g = *src;
+	  g->from += base;
+	  g->to += base;
+	}
+    }
+  GREPLACE (&buf, 0, nglyphs, gstring, from, to);
+  free (buf.glyphs);
+  to = from + nglyphs;
+  if (gstring->r2l)
+    reverse_glyphs (gstring, from, to);
   return to;
 }
 
+/*=*/
+/***en
+    @brief Get statistics of the cache of mflt_run ().
+
+    The mflt_cache_statistics () function stores the number of
+    successful and unsuccessful searches of the cache of #mflt_run ()
+    in the places pointed to by $HITS and $MISSES respectively unless
+    they are @c NULL.  See #mflt_cache_size for the cache.
+
+    @return
+    This function returns the number of results in the cache.  */
+
+int
+mflt_cache_statistics (int *hits, int *misses)
+{
+  int used;
+
+  FLT_LOCK ();
+  if (hits)
+    *hits = flt_cache_hits;
+  if (misses)
+    *misses = flt_cache_misses;
+  used = flt_cache_used;
+  FLT_UNLOCK ();
+  return used;
+}
+
+/*=*/
+/***en
+    @brief Clear the cache of mflt_run ().
+
+    The mflt_clear_cache () function discards all results in the
+    cache of #mflt_run () and resets its statistics.  An application
+    must call it when glyphs of a font that is identified by the same
+    #mflt_font_id have been changed.  */
+
+void
+mflt_clear_cache (void)
+{
+  FLT_LOCK ();
+  free_flt_cache ();
+  flt_cache_hits = flt_cache_misses = 0;
+  FLT_UNLOCK ();
+}
+
 /***en
     @brief Flag to control several new OTF handling commands.
 
@@ -3118,6 +6219,51 @@ mflt_run (MFLTGlyphString *gstring, int from, int to,
     category table.  */
 int mflt_enable_new_feature;
 
+/***en
+    @brief Maximum number of cached results of mflt_run ().
+
+    If the variable mflt_cache_size is positive, the function #mflt_run
+    () caches glyphs produced by an FLT for a sequence of characters in
+    a font, and reuses them when the same sequence is laid out in the
+    same font again.  The cache holds at most mflt_cache_size results
+    and discards the least recently used one when it is full.  The
+    cache is used only if the font is identified by #mflt_font_id.
+    The default value is 0, which disables the cache.  */
+int mflt_cache_size;
+
+/***en
+    @brief Flag to control the cache of compiled Font Layout Tables.
+
+    If the variable mflt_use_compiled_cache is nonzero, a Font Layout
+    Table is saved in a compiled form under the subdirectory
+    "flt-cache" of the user's m17n directory (i.e. the directory
+    specified by the environment variable M17NDIR, or "~/.m17n.d")
+    when it is loaded, and is loaded from there next time as long as
+    the original file is not modified.  The default value is 0.  */
+int mflt_use_compiled_cache;
+
+/***en
+    @brief Flag to control the profiler of Font Layout Tables.
+
+    If the variable mflt_enable_profile is nonzero, the function
+    #mflt_run () records how many times each command of the Font
+    Layout Table was run, how many times it matched, and how much time
+    it took.  The records are printed by mdebug_dump_flt () and
+    cleared by mflt_reset_profile ().  As the records are not
+    protected from simultaneous updates, they may be inaccurate if
+    mflt_run () is called from multiple threads.  The default value is
+    0.  */
+int mflt_enable_profile;
+
+/***en
+    @brief Number of threads used by mflt_run_incremental ().
+
+    If the variable mflt_layout_threads is greater than 1, the function
+    mflt_run_incremental () lays out segments in at most that number
+    of threads in parallel.  It is effective only if the library is
+    built with the thread support.  The default value is 0.  */
+int mflt_layout_threads;
+
 int (*mflt_iterate_otf_feature) (struct _MFLTFont *font,
 				 MFLTOtfSpec *spec,
 				 int from, int to,
@@ -3146,6 +6292,10 @@ dump_flt_cmd (FontLayoutStage *stage, int id, int indent)
       int idx = CMD_ID_TO_INDEX (id);
       FontLayoutCmd *cmd = stage->cmds + idx;
 
+      if (cmd->profile.calls > 0)
+	fprintf (mdebug__output, "(profile %lu %lu %.0f)\n%s",
+		 cmd->profile.calls, cmd->profile.matches, cmd->profile.time,
+		 prefix);
       if (cmd->type == FontLayoutCmdTypeRule)
 	{
 	  FontLayoutCmdRule *rule = &cmd->body.rule;
@@ -3204,6 +6354,14 @@ dump_flt_cmd (FontLayoutStage *stage, int id, int indent)
     environment variable MDEBUG_OUTPUT_FILE.  $INDENT specifies how
     many columns to indent the lines but the first one.
 
+    If the commands of $FLT have been profiled (see
+    #mflt_enable_profile), each of them is preceded by "(profile CALLS
+    MATCHES TIME)", where CALLS is how many times the command was run,
+    MATCHES is how many times it matched, and TIME is the total time
+    spent in it and its nested commands in microseconds.  As the
+    first command of a stage runs the whole stage, its profile is that
+    of the stage.
+
     @return
     This function returns $FLT.  */
 
@@ -3235,6 +6393,28 @@ mdebug_dump_flt (MFLT *flt, int indent)
   return flt;
 }
 
+/***en
+    @brief Clear the profile of a Font Layout Table.
+
+    The mflt_reset_profile () function clears the records of the
+    profiler (see #mflt_enable_profile) for the Font Layout Table
+    $FLT.  */
+
+void
+mflt_reset_profile (MFLT *flt)
+{
+  MPlist *plist;
+
+  MPLIST_DO (plist, flt->stages)
+    {
+      FontLayoutStage *stage = (FontLayoutStage *) MPLIST_VAL (plist);
+      int i;
+
+      for (i = 0; i < stage->used; i++)
+	memset (&stage->cmds[i].profile, 0, sizeof (FontLayoutProfile));
+    }
+}
+
 /***en
     @brief Dump an MFLTGlyphString.
 
@@ -425,11 +425,61 @@ extern MCharTable *mflt_coverage (MFLT *flt);
 extern int mflt_run (MFLTGlyphString *gstring, int from, int to,
 		     MFLTFont *font, MFLT *flt);
 
+/***en
+    @brief Type of shaping workspaces.
+
+    The type #MFLTWorkspace is for a workspace that keeps the buffers
+    used by mflt_run_with_workspace () across calls.  Its internal
+    structure is concealed from application programs.  */
+
+typedef struct _MFLTWorkspace MFLTWorkspace;
+
+extern MFLTWorkspace *mflt_create_workspace (void);
+
+extern void mflt_destroy_workspace (MFLTWorkspace *workspace);
+
+extern int mflt_run_with_workspace (MFLTGlyphString *gstring,
+				    int from, int to,
+				    MFLTFont *font, MFLT *flt,
+				    MFLTWorkspace *workspace);
+
+/***en
+    @brief Type of objects holding a result of mflt_run_incremental ().
+
+    The type #MFLTResult is for an object that keeps the glyphs
+    produced by mflt_run_incremental () so that the next call can
+    reuse them.  Its internal structure is concealed from application
+    programs.  */
+
+typedef struct _MFLTResult MFLTResult;
+
+extern MFLTResult *mflt_create_result (void);
+
+extern void mflt_destroy_result (MFLTResult *result);
+
+extern int mflt_run_incremental (MFLTGlyphString *gstring, int from, int to,
+				 MFLTFont *font, MFLT *flt,
+				 MFLTResult *result);
+
+extern int mflt_cache_statistics (int *hits, int *misses);
+
+extern void mflt_clear_cache (void);
+
+extern void mflt_reset_profile (MFLT *flt);
+
 /*=*/
 /*** @} */
 
 extern int mflt_enable_new_feature;
 
+extern int mflt_cache_size;
+
+extern int mflt_use_compiled_cache;
+
+extern int mflt_enable_profile;
+
+extern int mflt_layout_threads;
+
 extern MSymbol (*mflt_font_id) (MFLTFont *font);
 
 extern int (*mflt_iterate_otf_feature) (MFLTFont *font,
@@ -301,9 +301,7 @@ gd_render (MDrawWindow win, int x, int y,
 	   int reverse, MDrawRegion region)
 {
   gdImagePtr img = (gdImagePtr) win;
-  FT_Face ft_face;
   MRealizedFace *rface = from->rface;
-  FT_Int32 load_flags = FT_LOAD_RENDER;
   int i, j;
   int color, pixel;
   int r, g, b;
@@ -313,42 +311,36 @@ gd_render (MDrawWindow win, int x, int y,
 
   /* It is assured that the all glyphs in the current range use the
      same realized face.  */
-  ft_face = rface->rfont->fontp;
   color = ((int *) rface->info)[reverse ? COLOR_INVERSE : COLOR_NORMAL];
   pixel = RESOLVE_COLOR (img, color);
 
   if (gstring->anti_alias)
     r = color >> 16, g = (color >> 8) & 0xFF, b = color & 0xFF;
-  else
-    {
-#ifdef FT_LOAD_TARGET_MONO
-      load_flags |= FT_LOAD_TARGET_MONO;
-#else
-      load_flags |= FT_LOAD_MONOCHROME;
-#endif
-    }
 
   for (; from < to; x += from++->g.xadv)
     {
+      MGlyphBitmap *bitmap;
       unsigned char *bmp;
       int xoff, yoff;
       int width, pitch;
 
-      FT_Load_Glyph (ft_face, (FT_UInt) from->g.code, load_flags);
-      yoff = y - ft_face->glyph->bitmap_top + from->g.yoff;
-      bmp = ft_face->glyph->bitmap.buffer;
-      width = ft_face->glyph->bitmap.width;
-      pitch = ft_face->glyph->bitmap.pitch;
+      bitmap = mfont__ft_glyph_bitmap (rface->rfont, from->g.code,
+				       gstring->anti_alias);
+      if (! bitmap)
+	continue;
+      yoff = y - bitmap->top + from->g.yoff;
+      bmp = bitmap->buffer;
+      width = bitmap->width;
+      pitch = bitmap->pitch;
       if (! gstring->anti_alias)
 	pitch *= 8;
       if (width > pitch)
 	width = pitch;
 
       if (gstring->anti_alias)
-	for (i = 0; i < ft_face->glyph->bitmap.rows;
-	     i++, bmp += ft_face->glyph->bitmap.pitch, yoff++)
+	for (i = 0; i < bitmap->rows; i++, bmp += bitmap->pitch, yoff++)
 	  {
-	    xoff = x + ft_face->glyph->bitmap_left + from->g.xoff;
+	    xoff = x + bitmap->left + from->g.xoff;
 	    for (j = 0; j < width; j++, xoff++)
 	      if (bmp[j] > 0)
 		{
@@ -379,10 +371,9 @@ gd_render (MDrawWindow win, int x, int y,
 		}
 	  }
       else
-	for (i = 0; i < ft_face->glyph->bitmap.rows;
-	     i++, bmp += ft_face->glyph->bitmap.pitch, yoff++)
+	for (i = 0; i < bitmap->rows; i++, bmp += bitmap->pitch, yoff++)
 	  {
-	    xoff = x + ft_face->glyph->bitmap_left + from->g.xoff;
+	    xoff = x + bitmap->left + from->g.xoff;
 	    for (j = 0; j < width; j++, xoff++)
 	      if (bmp[j / 8] & (1 << (7 - (j % 8))))
 		gdImageSetPixel (img, xoff, yoff, pixel);
@@ -111,6 +111,8 @@ free_frame (void *object)
   MFrame *frame = (MFrame *) object;
 
   (*frame->driver->close) (frame);
+  mface__free_cache (frame);
+  mdraw__free_cache (frame);
   M17N_OBJECT_UNREF (frame->face);
   M17N_OBJECT_UNREF (frame->font_driver_list);
   free (object);
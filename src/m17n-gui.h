@@ -148,6 +148,12 @@ extern MSymbol Mx, Mfreetype, Mxft;
 
 extern MPlist *mfont_freetype_path;
 
+extern int mfont_bitmap_cache_size;
+
+extern int mfont_use_font_catalog;
+
+extern int mfont_probe_threads;
+
 extern MFont *mfont ();
 
 extern MFont *mfont_copy (MFont *font);
@@ -238,6 +244,8 @@ extern MFont *mfont_encapsulate (MFrame *frame, MSymbol data_type, void *data);
 
 extern int mfont_close (MFont *font);
 
+extern int mfont_bitmap_cache_statistics (int *hits, int *misses);
+
 /* end of font module */
 /*=*/
 
@@ -968,6 +976,10 @@ extern int mdraw_text_extents (MFrame *frame,
 			       MDrawMetric *overall_logical_return,
 			       MDrawMetric *overall_line_return);
 
+extern int mdraw_text_extents_batch (MFrame *frame, MText **mts, int n,
+				     MDrawControl *control,
+				     MDrawMetric *metrics_return);
+
 extern int mdraw_text_per_char_extents (MFrame *frame,
 					MText *mt, int from, int to,
 					MDrawControl *control,
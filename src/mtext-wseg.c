@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "config.h"
 #include "m17n-core.h"
@@ -33,16 +34,26 @@
 #include "internal.h"
 #include "textprop.h"
 #include "character.h"
+#include "database.h"
 
 typedef struct _MWordseg_Function MWordseg_Function;
 
+typedef struct _MWordsegDict MWordsegDict;
+
 struct _MWordseg_Function
 {
   int initialized;
-  int (*init) (void);
-  void (*fini) (void);
+  int (*init) (MWordseg_Function *wordseg);
+  void (*fini) (MWordseg_Function *wordseg);
   int (*wseg) (MText *mt, int pos, int *from, int *to,
 	       MWordseg_Function *wordseg);
+
+  /* For a dictionary based segmenter, the script whose dictionary is
+     looked up in the m17n database, and the dictionary itself (NULL
+     if none is installed).  */
+  MSymbol script;
+  MWordsegDict *dict;
+
   MWordseg_Function *next;
 };
 
@@ -98,8 +109,8 @@ static MSymbol M_thai_wordseg;
 /* We have libthai, wordcut, or wordcut-old.  Each of them provides
    the following three functions.  */
 
-static int thai_wordseg_init (void);
-static void thai_wordseg_fini (void);
+static int thai_wordseg_init (MWordseg_Function *wordseg);
+static void thai_wordseg_fini (MWordseg_Function *wordseg);
 static MTextProperty *thai_wordseg_propertize (MText *mt, int pos,
 					       int from, int to,
 					       unsigned char *tis);
@@ -109,13 +120,13 @@ static MTextProperty *thai_wordseg_propertize (MText *mt, int pos,
 #include <thai/thbrk.h>
 
 static int
-thai_wordseg_init (void)
+thai_wordseg_init (MWordseg_Function *wordseg)
 {
   return 0;
 }
 
 static void
-thai_wordseg_fini (void)
+thai_wordseg_fini (MWordseg_Function *wordseg)
 {
   return;
 }
@@ -175,14 +186,14 @@ static WcWordcut wordcut;
 static WcWordVector *word_vector;
 
 static int
-thai_wordseg_init (void)
+thai_wordseg_init (MWordseg_Function *wordseg)
 {  
   wc_wordcut_init (&wordcut);
   return 0;
 }
 
 static void
-thai_wordseg_fini (void)
+thai_wordseg_fini (MWordseg_Function *wordseg)
 {
   if (word_vector)
     wc_word_vector_delete (word_vector);
@@ -241,13 +252,13 @@ static WordcutResult wordcut_result;
 static int wordcut_result_used;
 
 static int
-thai_wordseg_init (void)
+thai_wordseg_init (MWordseg_Function *wordseg)
 {  
   return (wordcut_init (&wordcut, WORDCUT_TDICT) == 0 ? 0 : -1);
 }
 
 static void
-thai_wordseg_fini (void)
+thai_wordseg_fini (MWordseg_Function *wordseg)
 {
   if (wordcut_result_used)
     {
@@ -337,6 +348,424 @@ thai_wordseg (MText *mt, int pos, int *from, int *to,
 
 #endif	/* HAVE_THAI_WORDSEG */
 
+
+/* Dictionary based word segmentation.
+
+   Scripts whose characters belong to the line breaking class SA
+   (Thai, Lao, Myanmar, Khmer, etc.) do not delimit words by spaces.
+   For each of them, a word dictionary can be installed in the m17n
+   database with the tags <wordseg, dictionary, SCRIPT>.  The file is
+   a plain list of words (UTF-8, one word per line, a line starting
+   with ';' is a comment), and it is compiled into a double-array trie
+   when the script is segmented first.
+
+   A character C in [MIN_CHAR, MAX_CHAR] is encoded as C - MIN_CHAR + 1,
+   code 0 terminates a word.  The transition from the node S by the
+   code X goes to the node T = BASE[S] + X if CHECK[T] is S.  The
+   root node is 0.  */
+
+struct _MWordsegDict
+{
+  int min_char, max_char;
+  int size;
+  int *base, *check;
+};
+
+static MSymbol M_dict_wordseg;
+
+/* Ranges of characters segmented by dictionaries.  Ranges of the same
+   script must be consecutive.  */
+
+static struct
+{
+  char *script;
+  int from, to;
+} wordseg_dict_ranges[] =
+  {
+#ifndef HAVE_THAI_WORDSEG
+    { "thai", 0x0E01, 0x0E7F },
+#endif
+    { "lao", 0x0E80, 0x0EFF },
+    { "myanmar", 0x1000, 0x109F },
+    { "myanmar", 0xA9E0, 0xA9FF },
+    { "myanmar", 0xAA60, 0xAA7F },
+    { "khmer", 0x1780, 0x17FF },
+    { "khmer", 0x19E0, 0x19FF },
+    { "tai_le", 0x1950, 0x197F },
+    { "new_tai_lue", 0x1980, 0x19DF },
+    { "tai_tham", 0x1A20, 0x1AAF },
+    { "tai_viet", 0xAA80, 0xAADF } };
+
+static void
+free_wordseg_dict (MWordsegDict *dict)
+{
+  free (dict->base);
+  free (dict->check);
+  free (dict);
+}
+
+#define WORDSEG_DICT_CODE(dict, c)				\
+  ((c) >= (dict)->min_char && (c) <= (dict)->max_char		\
+   ? (c) - (dict)->min_char + 1 : 0)
+
+/* Structure used while building a double-array trie from a word
+   list.  */
+
+typedef struct
+{
+  /* Words encoded by WORDSEG_DICT_CODE, sorted, each terminated by
+     0.  */
+  int **words;
+  int nwords;
+  MWordsegDict *dict;
+  /* All cells before this are in use.  */
+  int next_free;
+} MWordsegDictBuilder;
+
+static int
+compare_dict_words (const void *p1, const void *p2)
+{
+  const int *w1 = *(const int **) p1, *w2 = *(const int **) p2;
+
+  while (*w1 && *w1 == *w2)
+    w1++, w2++;
+  return *w1 - *w2;
+}
+
+static void
+extend_wordseg_dict (MWordsegDict *dict, int size)
+{
+  int i;
+
+  if (size <= dict->size)
+    return;
+  if (size < dict->size * 2)
+    size = dict->size * 2;
+  MTABLE_REALLOC (dict->base, size, MERROR_MTEXT);
+  MTABLE_REALLOC (dict->check, size, MERROR_MTEXT);
+  for (i = dict->size; i < size; i++)
+    dict->base[i] = 0, dict->check[i] = -1;
+  dict->size = size;
+}
+
+/* Make children of the node NODE for the words FROM..TO-1 whose
+   first DEPTH codes are the same.  */
+
+static void
+build_wordseg_dict_node (MWordsegDictBuilder *builder, int node, int depth,
+			 int from, int to)
+{
+  MWordsegDict *dict = builder->dict;
+  int *codes, *ranges;
+  int ncodes = 0;
+  int i, pos, base;
+
+  MTABLE_MALLOC (codes, (to - from) * 2 + 1, MERROR_MTEXT);
+  ranges = codes + (to - from);
+  for (i = from; i < to; i++)
+    {
+      int code = builder->words[i][depth];
+
+      if (ncodes == 0 || codes[ncodes - 1] != code)
+	{
+	  codes[ncodes] = code;
+	  ranges[ncodes++] = i;
+	}
+    }
+  ranges[ncodes] = to;
+
+  for (pos = builder->next_free; ; pos++)
+    {
+      extend_wordseg_dict (dict, pos + 1);
+      if (dict->check[pos] >= 0)
+	{
+	  if (pos == builder->next_free)
+	    builder->next_free++;
+	  continue;
+	}
+      base = pos - codes[0];
+      if (base < 1)
+	continue;
+      extend_wordseg_dict (dict, base + codes[ncodes - 1] + 1);
+      for (i = 1; i < ncodes; i++)
+	if (dict->check[base + codes[i]] >= 0)
+	  break;
+      if (i == ncodes)
+	break;
+    }
+
+  dict->base[node] = base;
+  for (i = 0; i < ncodes; i++)
+    dict->check[base + codes[i]] = node;
+  for (i = 0; i < ncodes; i++)
+    if (codes[i] > 0)
+      build_wordseg_dict_node (builder, base + codes[i], depth + 1,
+			       ranges[i], ranges[i + 1]);
+  free (codes);
+}
+
+/* Build a dictionary from the word list in FP.  */
+
+static MWordsegDict *
+build_wordseg_dict (FILE *fp)
+{
+  MWordsegDictBuilder builder;
+  MWordsegDict *dict;
+  char line[1024];
+  int *chars = NULL;
+  int size = 0, used = 0;
+  int nwords = 0, min_char = MCHAR_MAX, max_char = 0;
+  int i, j;
+
+  /* At first, collect all words in CHARS, each terminated by 0.  */
+  while (fgets (line, sizeof line, fp))
+    {
+      unsigned char *p = (unsigned char *) line;
+      int len = strlen (line);
+
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'
+			 || line[len - 1] == ' ' || line[len - 1] == '\t'))
+	line[--len] = '\0';
+      if (len == 0 || line[0] == ';')
+	continue;
+      if (used + len + 1 > size)
+	{
+	  size = (used + len + 1) * 2;
+	  MTABLE_REALLOC (chars, size, MERROR_MTEXT);
+	}
+      while (*p)
+	{
+	  int c = STRING_CHAR_ADVANCE (p);
+
+	  if (c < min_char)
+	    min_char = c;
+	  if (c > max_char)
+	    max_char = c;
+	  chars[used++] = c;
+	}
+      chars[used++] = 0;
+      nwords++;
+    }
+  if (nwords == 0)
+    {
+      free (chars);
+      return NULL;
+    }
+
+  MSTRUCT_CALLOC (dict, MERROR_MTEXT);
+  dict->min_char = min_char;
+  dict->max_char = max_char;
+  MTABLE_MALLOC (builder.words, nwords, MERROR_MTEXT);
+  for (i = j = 0; i < nwords; i++)
+    {
+      builder.words[i] = chars + j;
+      for (; chars[j]; j++)
+	chars[j] = WORDSEG_DICT_CODE (dict, chars[j]);
+      j++;
+    }
+  qsort (builder.words, nwords, sizeof (int *), compare_dict_words);
+  for (i = j = 1; i < nwords; i++)
+    if (compare_dict_words (builder.words + j - 1, builder.words + i) != 0)
+      builder.words[j++] = builder.words[i];
+  builder.nwords = j;
+  builder.dict = dict;
+  builder.next_free = 1;
+  extend_wordseg_dict (dict, 1024);
+  dict->check[0] = -2;
+  build_wordseg_dict_node (&builder, 0, 0, 0, builder.nwords);
+
+  for (i = dict->size; i > 1 && dict->check[i - 1] < 0; i--);
+  dict->size = i;
+  free (builder.words);
+  free (chars);
+  return dict;
+}
+
+/* Load a dictionary from FILENAME.  */
+
+static MWordsegDict *
+load_wordseg_dict (char *filename)
+{
+  MWordsegDict *dict;
+  FILE *fp = fopen (filename, "r");
+
+  if (! fp)
+    return NULL;
+  dict = build_wordseg_dict (fp);
+  fclose (fp);
+  return dict;
+}
+
+static int
+dict_wordseg_init (MWordseg_Function *wordseg)
+{
+  MDatabase *mdb = mdatabase_find (msymbol ("wordseg"),
+				   msymbol ("dictionary"),
+				   wordseg->script, Mnil);
+  char *filename;
+
+  /* Even if no dictionary is installed, succeed so that
+     dict_wordseg falls back to generic_wordseg.  */
+  if (mdb && (filename = mdatabase__file (mdb)))
+    wordseg->dict = load_wordseg_dict (filename);
+  return 0;
+}
+
+static void
+dict_wordseg_fini (MWordseg_Function *wordseg)
+{
+  if (wordseg->dict)
+    {
+      free_wordseg_dict (wordseg->dict);
+      wordseg->dict = NULL;
+    }
+}
+
+/* Segment the characters CHARS[0..LEN-1] by DICT into the fewest
+   unknown characters, and then into the fewest words (i.e. the
+   longest matches).  MARKS[I] is nonzero if CHARS[I] is a combining
+   mark which never starts a segment.  On return, BOUNDARY[I] is 1 if
+   a dictionary word starts at I, -1 if an unknown segment starts at
+   I, and 0 otherwise.  */
+
+static void
+dict_segment (MWordsegDict *dict, int *chars, char *marks, int len,
+	      char *boundary)
+{
+  int *unknown, *nwords, *prev;
+  char *is_word;
+  int i, j;
+
+  MTABLE_MALLOC (unknown, (len + 1) * 3, MERROR_MTEXT);
+  nwords = unknown + (len + 1);
+  prev = nwords + (len + 1);
+  is_word = boundary;
+  unknown[0] = nwords[0] = 0;
+  for (i = 1; i <= len; i++)
+    unknown[i] = -1;
+
+#define RELAX(from, to, n_unknown, word)				\
+  do {									\
+    int u = unknown[from] + (n_unknown), w = nwords[from] + 1;		\
+									\
+    if (unknown[to] < 0 || u < unknown[to]				\
+	|| (u == unknown[to] && w < nwords[to]))			\
+      unknown[to] = u, nwords[to] = w, prev[to] = (from),		\
+	is_word[to - 1] = (word);					\
+  } while (0)
+
+  for (i = 0; i < len; i++)
+    {
+      int node = 0;
+
+      if (unknown[i] < 0)
+	continue;
+      for (j = i; j < len; j++)
+	{
+	  int code = WORDSEG_DICT_CODE (dict, chars[j]);
+	  int t;
+
+	  if (! code)
+	    break;
+	  t = dict->base[node] + code;
+	  if (t >= dict->size || dict->check[t] != node)
+	    break;
+	  node = t;
+	  t = dict->base[node];
+	  if (t < dict->size && dict->check[t] == node
+	      && (j + 1 == len || ! marks[j + 1]))
+	    RELAX (i, j + 1, 0, 1);
+	}
+      for (j = i + 1; j < len && marks[j]; j++);
+      RELAX (i, j, j - i, 0);
+    }
+#undef RELAX
+
+  /* IS_WORD[I] now tells whether the best segment ending at I + 1 is
+     a word.  Convert it to BOUNDARY in place by walking back.  */
+  for (i = len; i > 0; i = j)
+    {
+      int word = is_word[i - 1];
+
+      j = prev[i];
+      memset (boundary + j, 0, i - j);
+      boundary[j] = word ? 1 : -1;
+    }
+  free (unknown);
+}
+
+static int
+dict_wordseg (MText *mt, int pos, int *from, int *to,
+	      MWordseg_Function *wordseg)
+{
+  MTextProperty *prop;
+
+  if (! wordseg->dict)
+    return generic_wordseg (mt, pos, from, to, wordseg);
+
+  prop = mtext_get_property (mt, pos, M_dict_wordseg);
+  if (! prop)
+    {
+      int len = mtext_nchars (mt);
+      int beg, end, i, last;
+      int *chars;
+      char *marks, *boundary;
+
+      for (beg = pos; beg > 0; beg--)
+	if (mchartable_lookup (wordseg_function_table,
+			       mtext_ref_char (mt, beg - 1)) != wordseg)
+	  break;
+      for (end = pos + 1; end < len; end++)
+	if (mchartable_lookup (wordseg_function_table,
+			       mtext_ref_char (mt, end)) != wordseg)
+	  break;
+
+      MTABLE_MALLOC (chars, end - beg, MERROR_MTEXT);
+      MTABLE_MALLOC (marks, (end - beg) * 2, MERROR_MTEXT);
+      boundary = marks + (end - beg);
+      for (i = beg; i < end; i++)
+	{
+	  int c = mtext_ref_char (mt, i);
+	  MSymbol category = mchar_get_prop (c, Mcategory);
+
+	  chars[i - beg] = c;
+	  marks[i - beg] = (category != Mnil
+			    && msymbol_name (category)[0] == 'M');
+	}
+      dict_segment (wordseg->dict, chars, marks, end - beg, boundary);
+
+      /* Consecutive unknown segments are merged into one.  */
+      for (i = last = beg; i <= end; i++)
+	if (i == end
+	    || (i > last && boundary[i - beg]
+		&& (boundary[i - beg] > 0 || boundary[last - beg] > 0)))
+	  {
+	    MSymbol category = mchar_get_prop (chars[last - beg], Mcategory);
+	    char cathead = category != Mnil ? msymbol_name (category)[0] : 0;
+	    int in_word = (boundary[last - beg] > 0
+			   || cathead == 'L' || cathead == 'M'
+			   || cathead == 'N');
+	    MTextProperty *this
+	      = mtext_property (M_dict_wordseg, in_word ? Mt : Mnil,
+				MTEXTPROP_VOLATILE_WEAK | MTEXTPROP_NO_MERGE);
+
+	    mtext_attach_property (mt, last, i, this);
+	    if (pos >= last && pos < i)
+	      prop = this;
+	    M17N_OBJECT_UNREF (this);
+	    last = i;
+	  }
+      free (chars);
+      free (marks);
+    }
+
+  if (from)
+    *from = MTEXTPROP_START (prop);
+  if (to)
+    *to = MTEXTPROP_END (prop);
+  return (MTEXTPROP_VAL (prop) == Mt);
+}
+
 
 /* Internal API */
 
@@ -351,7 +780,7 @@ mtext__wseg_fini ()
 
 	  if (wordseg_function_list->initialized > 0
 	      && wordseg_function_list->fini)
-	    wordseg_function_list->fini ();
+	    wordseg_function_list->fini (wordseg_function_list);
 	  free (wordseg_function_list);
 	  wordseg_function_list = next;
 	}
@@ -374,6 +803,7 @@ mtext__word_segment (MText *mt, int pos, int *from, int *to)
 {
   int c = mtext_ref_char (mt, pos);
   MWordseg_Function *wordseg;
+  int i;
 
   if (! wordseg_function_table)
     {
@@ -396,6 +826,27 @@ mtext__word_segment (MText *mt, int pos, int *from, int *to)
 			    wordseg);
       M_thai_wordseg = msymbol ("  thai-wordseg");
 #endif
+
+      M_dict_wordseg = msymbol ("  dict-wordseg");
+      for (i = 0; i < (sizeof wordseg_dict_ranges
+		       / sizeof wordseg_dict_ranges[0]); i++)
+	{
+	  MSymbol script = msymbol (wordseg_dict_ranges[i].script);
+
+	  if (i == 0 || wordseg->script != script)
+	    {
+	      MSTRUCT_CALLOC (wordseg, MERROR_MTEXT);
+	      wordseg->init = dict_wordseg_init;
+	      wordseg->fini = dict_wordseg_fini;
+	      wordseg->wseg = dict_wordseg;
+	      wordseg->script = script;
+	      wordseg->next = wordseg_function_list;
+	      wordseg_function_list = wordseg;
+	    }
+	  mchartable_set_range (wordseg_function_table,
+				wordseg_dict_ranges[i].from,
+				wordseg_dict_ranges[i].to, wordseg);
+	}
     }
 
   wordseg = mchartable_lookup (wordseg_function_table, c);
@@ -404,7 +855,7 @@ mtext__word_segment (MText *mt, int pos, int *from, int *to)
       if (! wordseg->initialized)
 	{
 	  if (wordseg->init
-	      && wordseg->init () < 0)
+	      && wordseg->init (wordseg) < 0)
 	    {
 	      wordseg->initialized = -1;
 	      return -1;
@@ -1220,6 +1220,22 @@ mtext__free_plist (MText *mt){
 }
 
 
+/** Return 1 if MT has a property whose key is not KEY, else return
+    0.  */
+
+int
+mtext__other_property_p (MText *mt, MSymbol key)
+{
+  MTextPlist *plist;
+
+  for (plist = mt->plist; plist; plist = plist->next)
+    if (plist->key != key
+	&& (plist->head != plist->tail || plist->head->nprops > 0))
+      return 1;
+  return 0;
+}
+
+
 /** Extract intervals between FROM and TO of all properties (except
     for volatile ones) in PLIST, and make a new plist from them for
     M-text MT.  */
@@ -61,6 +61,8 @@ extern struct MTextPlist *mtext__copy_plist (struct MTextPlist *,
 
 extern void mtext__free_plist (MText *mt);
 
+extern int mtext__other_property_p (MText *mt, MSymbol key);
+
 extern void mtext__adjust_plist_for_delete (MText *, int, int);
 
 extern void mtext__adjust_plist_for_insert (MText *, int, int,